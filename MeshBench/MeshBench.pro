@@ -0,0 +1,67 @@
+#-------------------------------------------------
+#
+# Benchmarks for the CPU side geometry code of MyGLWindow
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = MeshBench
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# The classes under test are compiled straight from the MyGLWindow template
+SOURCES += \
+    main.cpp \
+    ../MyGLWindow/mesh.cpp \
+    ../MyGLWindow/model.cpp \
+    ../MyGLWindow/vertexwelder.cpp \
+    ../MyGLWindow/normalgenerator.cpp \
+    ../MyGLWindow/geometrykernels.cpp \
+    ../MyGLWindow/geometrycache.cpp \
+    ../MyGLWindow/vertexcacheoptimizer.cpp \
+    fragmentcounter.cpp \
+    ../MyGLWindow/overdrawoptimizer.cpp \
+    ../MyGLWindow/vertexquantizer.cpp \
+    ../MyGLWindow/meshsimplifier.cpp \
+    ../MyGLWindow/meshletbuilder.cpp \
+    ../MyGLWindow/trianglebvh.cpp \
+    ../MyGLWindow/assetmanager.cpp \
+    ../MyGLWindow/textureatlas.cpp \
+    ../MyGLWindow/indirectdrawlist.cpp \
+    ../MyGLWindow/renderqueue.cpp \
+    ../MyGLWindow/cpuprofiler.cpp
+
+HEADERS += \
+    ../MyGLWindow/mesh.h \
+    ../MyGLWindow/model.h \
+    ../MyGLWindow/parallel.h \
+    ../MyGLWindow/vertexwelder.h \
+    ../MyGLWindow/normalgenerator.h \
+    ../MyGLWindow/stridedview.h \
+    ../MyGLWindow/geometrykernels.h \
+    ../MyGLWindow/arrayview.h \
+    ../MyGLWindow/geometrycache.h \
+    ../MyGLWindow/vertexcacheoptimizer.h \
+    fragmentcounter.h \
+    ../MyGLWindow/overdrawoptimizer.h \
+    ../MyGLWindow/vertexquantizer.h \
+    ../MyGLWindow/meshsimplifier.h \
+    ../MyGLWindow/meshletbuilder.h \
+    ../MyGLWindow/trianglebvh.h \
+    ../MyGLWindow/assetmanager.h \
+    ../MyGLWindow/textureatlas.h \
+    ../MyGLWindow/indirectdrawlist.h \
+    ../MyGLWindow/renderqueue.h \
+    ../MyGLWindow/cpuprofiler.h
+
+INCLUDEPATH += \
+    $$PWD/../MyGLWindow \
+    $$PWD/../glm \
+    $$PWD/../assimp-v.5.0.0.rc1/include
+
+LIBS += \
+    -L$$PWD/../assimp-v.5.0.0.rc1/lib/ -lassimp
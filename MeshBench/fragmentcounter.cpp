@@ -0,0 +1,78 @@
+#include "fragmentcounter.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using glm::vec3;
+
+FragmentCounter::FragmentCounter(int resolution) : mResolution(resolution), mShaded(0) {
+    mDepth.assign(size_t(resolution) * size_t(resolution), FLT_MAX);
+    begin(vec3(0.0f, 0.0f, 1.0f));
+}
+
+void FragmentCounter::begin(const vec3& direction) {
+    std::fill(mDepth.begin(), mDepth.end(), FLT_MAX);
+    mShaded = 0;
+    //A right handed camera at direction that looks to the origin
+    mForward = glm::normalize(direction);
+    vec3 up = std::fabs(mForward.y) < 0.99f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    mRight = glm::normalize(glm::cross(up, mForward));
+    mUp = glm::cross(mForward, mRight);
+}
+
+void FragmentCounter::draw(const std::vector<Vertex>& vertices, const unsigned int* indices, size_t count, int baseVertex) {
+    //The unit cube (centered at the origin) fills the whole buffer from any direction
+    const float half = 0.5f * float(mResolution);
+    const float scale = half / 0.87f;
+    for (size_t t = 0; t + 2 < count; t += 3) {
+        float x[3];
+        float y[3];
+        float z[3];
+        for (int c = 0; c < 3; ++c) {
+            const vec3& p = vertices[size_t(baseVertex + int(indices[t + size_t(c)]))].position;
+            x[c] = half + scale * glm::dot(p, mRight);
+            y[c] = half + scale * glm::dot(p, mUp);
+            //Smaller is closer to the camera
+            z[c] = -glm::dot(p, mForward);
+        }
+        //Twice the signed area, positive if counter clockwise (front facing)
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area <= 0.0f) {
+            continue;
+        }
+        int minX = std::max(0, int(std::floor(std::min(x[0], std::min(x[1], x[2])))));
+        int maxX = std::min(mResolution - 1, int(std::ceil(std::max(x[0], std::max(x[1], x[2])))));
+        int minY = std::max(0, int(std::floor(std::min(y[0], std::min(y[1], y[2])))));
+        int maxY = std::min(mResolution - 1, int(std::ceil(std::max(y[0], std::max(y[1], y[2])))));
+        for (int j = minY; j <= maxY; ++j) {
+            for (int i = minX; i <= maxX; ++i) {
+                //Sample at the pixel center with the edge functions
+                float px = float(i) + 0.5f;
+                float py = float(j) + 0.5f;
+                float w0 = (x[2] - x[1]) * (py - y[1]) - (y[2] - y[1]) * (px - x[1]);
+                float w1 = (x[0] - x[2]) * (py - y[2]) - (y[0] - y[2]) * (px - x[2]);
+                float w2 = (x[1] - x[0]) * (py - y[0]) - (y[1] - y[0]) * (px - x[0]);
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                    continue;
+                }
+                float depth = (w0 * z[0] + w1 * z[1] + w2 * z[2]) / area;
+                float& stored = mDepth[size_t(j) * size_t(mResolution) + size_t(i)];
+                if (depth < stored) {
+                    stored = depth;
+                    ++mShaded;
+                }
+            }
+        }
+    }
+}
+
+size_t FragmentCounter::shaded() const {
+    return mShaded;
+}
+
+size_t FragmentCounter::covered() const {
+    return size_t(std::count_if(mDepth.begin(), mDepth.end(), [](float depth) {
+        return depth != FLT_MAX;
+    }));
+}
@@ -0,0 +1,41 @@
+#ifndef FRAGMENTCOUNTER_H
+#define FRAGMENTCOUNTER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+//! A tiny software rasterizer that counts the fragments a GPU would shade.
+/*!
+  It draws triangles, in order, into a square depth buffer with back face
+  culling (counter clockwise is front, as in OpenGL) and a less than depth
+  test. A fragment that passes the depth test is the one that the early depth
+  test of a GPU lets into the fragment shader. So shaded() / covered() is the
+  overdraw that the triangle order causes: 1 would be perfect.
+
+  The views are orthographic, looking at the origin from a direction. The
+  mesh is expected to be inside the unit cube (See \class Mesh toUnitCube).
+*/
+class FragmentCounter {
+public:
+    explicit FragmentCounter(int resolution = 512);
+    //! Clear the depth buffer and the counters, and look from direction
+    void begin(const glm::vec3& direction);
+    //! Draw count indices of vertices, adding baseVertex to every index
+    void draw(const std::vector<Vertex>& vertices, const unsigned int* indices, size_t count, int baseVertex = 0);
+    //! Fragments that passed the depth test (were shaded) since begin
+    size_t shaded() const;
+    //! Pixels covered by the mesh since begin
+    size_t covered() const;
+
+private:
+    int mResolution;
+    std::vector<float> mDepth;
+    glm::vec3 mRight;
+    glm::vec3 mUp;
+    glm::vec3 mForward;
+    size_t mShaded;
+};
+
+#endif // FRAGMENTCOUNTER_H
@@ -0,0 +1,1468 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+#include <QDir>
+#include <QFileInfo>
+
+#define GLM_FORCE_PURE
+#define GLM_FORCE_RADIANS
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "assetmanager.h"
+#include "cpuprofiler.h"
+#include "fragmentcounter.h"
+#include "indirectdrawlist.h"
+#include "mesh.h"
+#include "meshletbuilder.h"
+#include "meshsimplifier.h"
+#include "model.h"
+#include "renderqueue.h"
+#include "textureatlas.h"
+#include "trianglebvh.h"
+#include "vertexquantizer.h"
+
+using glm::vec3;
+
+namespace {
+
+//! Only the suite mode turns the counters on, the other modes just pay for the size header
+std::atomic<bool> countAllocations(false);
+//! What the replaced operator new has handed out, read by the suite mode
+std::atomic<size_t> allocationCount(0);
+std::atomic<size_t> allocatedBytes(0);
+std::atomic<size_t> liveBytes(0);
+std::atomic<size_t> peakLiveBytes(0);
+//! Each block starts with its counted size (0 when not counted), padded so the memory after it
+//! keeps the malloc alignment
+const size_t ALLOCATION_HEADER = alignof(std::max_align_t);
+
+void* countedAllocate(size_t size) {
+    void* block = std::malloc(size + ALLOCATION_HEADER);
+    if (!block) {
+        return nullptr;
+    }
+    if (!countAllocations.load(std::memory_order_relaxed)) {
+        *static_cast<size_t*>(block) = 0;
+        return static_cast<char*>(block) + ALLOCATION_HEADER;
+    }
+    *static_cast<size_t*>(block) = size;
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    const size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return static_cast<char*>(block) + ALLOCATION_HEADER;
+}
+
+void countedFree(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    char* block = static_cast<char*>(pointer) - ALLOCATION_HEADER;
+    const size_t size = *reinterpret_cast<size_t*>(block);
+    if (size > 0) {
+        liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+    std::free(block);
+}
+
+} // namespace
+
+//Every new and delete of the program (the Qt and Assimp ones too) go through the counters,
+//which count only once the suite mode has turned them on
+void* operator new(size_t size) {
+    void* pointer = countedAllocate(size > 0 ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size > 0 ? size : 1);
+}
+
+void operator delete(void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(const Clock::time_point& start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//! A wavy height field tessellated as a triangle soup of (at least) count triangles
+/*!
+  Every inner vertex is repeated by six triangles, which is what a scanner or
+  an STL file give us before welding.
+*/
+std::vector<Triangle> makeTriangleSoup(size_t count) {
+    size_t side = 1;
+    while (2 * side * side < count) {
+        ++side;
+    }
+    const float step = 1.0f / float(side);
+    auto point = [step](size_t i, size_t j) {
+        float x = float(i) * step;
+        float y = float(j) * step;
+        return vec3(x, y, 0.05f * glm::sin(20.0f * x) * glm::cos(20.0f * y));
+    };
+    std::vector<Triangle> soup;
+    soup.reserve(2 * side * side);
+    for (size_t i = 0; i < side; ++i) {
+        for (size_t j = 0; j < side; ++j) {
+            vec3 a = point(i, j);
+            vec3 b = point(i + 1, j);
+            vec3 c = point(i + 1, j + 1);
+            vec3 d = point(i, j + 1);
+            soup.push_back(Triangle{a, b, c});
+            soup.push_back(Triangle{a, c, d});
+        }
+    }
+    return soup;
+}
+
+//! The std::set based indexing that Mesh::loadFromTriangles used to do
+void legacyWeld(const std::vector<Triangle>& triangles,
+                std::vector<vec3>& positions, std::vector<unsigned int>& indices) {
+    auto lessThan = [](const vec3& a, const vec3& b){
+        const float EPSILON = 0.00000001f;
+        if (glm::length2(a - b) < EPSILON) {
+            return false;
+        }
+        if (glm::abs(a.x - b.x) > EPSILON) {
+            return a.x < b.x;
+        } else if (glm::abs(a.y - b.y) > EPSILON) {
+            return a.y < b.y;
+        } else {
+            return a.z < b.z;
+        }
+    };
+    std::set<vec3, decltype(lessThan)> tmpStorage(lessThan);
+    for (const auto& t : triangles) {
+        tmpStorage.insert(t.p0);
+        tmpStorage.insert(t.p1);
+        tmpStorage.insert(t.p2);
+    }
+    indices.clear();
+    for (const auto& t : triangles) {
+        for (const vec3* p : {&t.p0, &t.p1, &t.p2}) {
+            auto it = tmpStorage.find(*p);
+            indices.push_back(static_cast<unsigned int>(std::distance(tmpStorage.begin(), it)));
+        }
+    }
+    positions.assign(tmpStorage.begin(), tmpStorage.end());
+}
+
+void benchWelding(size_t triangles, bool legacy) {
+    std::vector<Triangle> soup = makeTriangleSoup(triangles);
+
+    Mesh mesh;
+    Clock::time_point start = Clock::now();
+    mesh.loadFromTriangles(soup);
+    double weldTime = secondsSince(start);
+    std::printf("weld    %10zu triangles  grid hash %9.3f s  (%zu vertices)\n",
+                soup.size(), weldTime, mesh.vertexCount());
+
+    if (!legacy) {
+        return;
+    }
+    std::vector<vec3> positions;
+    std::vector<unsigned int> indices;
+    start = Clock::now();
+    legacyWeld(soup, positions, indices);
+    double legacyTime = secondsSince(start);
+
+    std::vector<Vertex> vertices = mesh.getVertices();
+    bool same = indices == mesh.getIndices() && positions.size() == vertices.size();
+    for (size_t i = 0; same && i < positions.size(); ++i) {
+        same = positions[i] == vertices[i].position;
+    }
+    std::printf("weld    %10zu triangles  std::set  %9.3f s  speedup %.1fx  %s\n",
+                soup.size(), legacyTime, legacyTime / weldTime,
+                same ? "identical" : "DIFFERENT");
+}
+
+//! Exposes the bounding box pass, which is protected in Mesh
+class BenchMesh : public Mesh {
+public:
+    using Mesh::updateBoundingBox;
+};
+
+//! Time the position only passes of a mesh of (at least) count vertices in a layout
+void benchLayout(size_t count, VertexLayout layout) {
+    std::vector<Triangle> soup = makeTriangleSoup(count);
+    BenchMesh mesh;
+    mesh.setLayout(layout);
+    Clock::time_point start = Clock::now();
+    mesh.loadFromTriangles(soup);
+    double weldTime = secondsSince(start);
+    soup.clear();
+    soup.shrink_to_fit();
+    //With normals, so transform also has to update them
+    mesh.recalculateNormals();
+
+    const int repetitions = 5;
+    start = Clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        mesh.updateBoundingBox();
+    }
+    double boxTime = secondsSince(start) / repetitions;
+    start = Clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        mesh.transform(glm::mat4(1.0f));
+    }
+    double transformTime = secondsSince(start) / repetitions;
+    start = Clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        mesh.toUnitCube();
+    }
+    double unitCubeTime = secondsSince(start) / repetitions;
+
+    //Bytes that each pass has to bring from memmory
+    const double megabyte = 1024.0 * 1024.0;
+    double vertices = double(mesh.vertexCount());
+    double positionBytes = vertices * (layout == SEPARATED_LAYOUT ? sizeof(glm::vec3) : sizeof(Vertex));
+    double normalBytes = vertices * (layout == SEPARATED_LAYOUT ? 2 * sizeof(glm::vec3) : sizeof(Vertex));
+    const char* name = layout == SEPARATED_LAYOUT ? "separated  " : "interleaved";
+    std::printf("layout  %10zu vertices  %s  weld %8.3f s  bbox %8.4f s (%7.0f MB)"
+                "  transform %8.4f s (%7.0f MB)  unit cube %8.4f s\n",
+                mesh.vertexCount(), name, weldTime, boxTime, positionBytes / megabyte,
+                transformTime, normalBytes / megabyte, unitCubeTime);
+}
+
+void printVertexCacheReport(const char* name, size_t triangles, const VertexCacheReport& report, double seconds) {
+    std::printf("vcache  %10zu triangles  %-24s ACMR %.3f -> %.3f  ATVR %.3f -> %.3f  %8.3f s\n",
+                triangles, name, double(report.before.acmr()), double(report.after.acmr()),
+                double(report.before.atvr()), double(report.after.atvr()), seconds);
+}
+
+//! Optimize a welded grid whose triangles come in random order
+void benchVertexCache(size_t triangles) {
+    std::vector<Triangle> soup = makeTriangleSoup(triangles);
+    std::shuffle(soup.begin(), soup.end(), std::mt19937(1));
+    Mesh mesh;
+    mesh.loadFromTriangles(soup);
+    Clock::time_point start = Clock::now();
+    VertexCacheReport report = mesh.optimizeVertexCache();
+    printVertexCacheReport("shuffled grid", mesh.trianglesCount(), report, secondsSince(start));
+}
+
+//! Optimize a model file, as it comes from Assimp
+void benchVertexCache(const char* fileName) {
+    Model model;
+    if (!model.load(QString(fileName))) {
+        std::printf("vcache  unable to load %s\n", fileName);
+        return;
+    }
+    Clock::time_point start = Clock::now();
+    VertexCacheReport report = model.optimizeVertexCache();
+    printVertexCacheReport(fileName, model.trianglesCount(), report, secondsSince(start));
+}
+
+//! A 3x3x3 lattice of bumpy spheres, so most views have several layers of surface
+std::vector<Triangle> makeSphereLattice(size_t count) {
+    //Triangles per sphere: 2 * rings * rings
+    size_t rings = 2;
+    while (27 * 2 * rings * rings < count) {
+        ++rings;
+    }
+    const float pi = 3.14159265f;
+    std::vector<Triangle> soup;
+    soup.reserve(27 * 2 * rings * rings);
+    for (int s = 0; s < 27; ++s) {
+        vec3 center = 0.33f * vec3(float(s % 3 - 1), float(s / 3 % 3 - 1), float(s / 9 - 1));
+        auto point = [&](size_t i, size_t j) {
+            float theta = pi * float(i) / float(rings);
+            float phi = 2.0f * pi * float(j % rings) / float(rings);
+            float r = 0.15f * (1.0f + 0.2f * glm::sin(7.0f * theta) * glm::sin(7.0f * phi));
+            return center + r * vec3(glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi));
+        };
+        for (size_t i = 0; i < rings; ++i) {
+            for (size_t j = 0; j < rings; ++j) {
+                //Counter clockwise seen from outside
+                vec3 a = point(i, j);
+                vec3 b = point(i, j + 1);
+                vec3 c = point(i + 1, j + 1);
+                vec3 d = point(i + 1, j);
+                soup.push_back(Triangle{a, b, c});
+                soup.push_back(Triangle{a, c, d});
+            }
+        }
+    }
+    return soup;
+}
+
+//! Shaded fragments per covered pixel, averaged over views from 14 directions
+double measureOverdraw(const Mesh& mesh) {
+    static const vec3 directions[] = {
+        vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1),
+        vec3(1, 1, 1), vec3(-1, 1, 1), vec3(1, -1, 1), vec3(1, 1, -1),
+        vec3(-1, -1, 1), vec3(-1, 1, -1), vec3(1, -1, -1), vec3(-1, -1, -1)
+    };
+    const Model* model = dynamic_cast<const Model*>(&mesh);
+    std::vector<Vertex> vertices = mesh.getVertices();
+    const std::vector<unsigned int>& indices = mesh.getIndices();
+    FragmentCounter counter;
+    double overdraw = 0.0;
+    for (const vec3& direction : directions) {
+        counter.begin(direction);
+        if (model) {
+            for (const MeshData& sep : model->getSeparators()) {
+                counter.draw(vertices, indices.data() + sep.startIndex, size_t(sep.howMany), sep.startVertex);
+            }
+        } else {
+            counter.draw(vertices, indices.data(), indices.size());
+        }
+        overdraw += double(counter.shaded()) / double(std::max<size_t>(counter.covered(), 1));
+    }
+    return overdraw / double(sizeof(directions) / sizeof(directions[0]));
+}
+
+//! Compare the triangle order as loaded, cache optimized and overdraw optimized
+template <typename MeshType>
+void benchOverdraw(const char* name, const MeshType& loaded) {
+    MeshType cacheOrder = loaded;
+    cacheOrder.optimizeVertexCache();
+    MeshType overdrawOrder = loaded;
+    Clock::time_point start = Clock::now();
+    overdrawOrder.optimizeVertexCache(VertexCacheOptimizer::DEFAULT_CACHE_SIZE, 1.05f);
+    double seconds = secondsSince(start);
+    std::printf("overdraw %9zu triangles  %-24s loaded: ACMR %.3f overdraw %.3f"
+                "  vcache: ACMR %.3f overdraw %.3f  vcache+overdraw: ACMR %.3f overdraw %.3f  %7.3f s\n",
+                loaded.trianglesCount(), name,
+                double(loaded.vertexCacheStats().acmr()), measureOverdraw(loaded),
+                double(cacheOrder.vertexCacheStats().acmr()), measureOverdraw(cacheOrder),
+                double(overdrawOrder.vertexCacheStats().acmr()), measureOverdraw(overdrawOrder), seconds);
+}
+
+//! Compress the vertices of every mesh to \struct CompactVertex and report the error
+void benchCompact(const char* name, const std::vector<Vertex>& vertices, const std::vector<MeshData>& separators) {
+    std::vector<CompactVertex> compact;
+    std::vector<QuantizationBox> boxes;
+    Clock::time_point start = Clock::now();
+    QuantizationError error = VertexQuantizer().quantize(vertices, separators, compact, boxes);
+    double seconds = secondsSince(start);
+    std::printf("compact %10zu vertices  %-24s %zu -> %zu bytes  max error: position %.6f normal %.4f deg"
+                " texture %.6f  %7.3f s\n", vertices.size(), name, vertices.size() * sizeof(Vertex),
+                compact.size() * sizeof(CompactVertex), double(error.position), double(error.normal),
+                double(error.textCoords), seconds);
+}
+
+//! Simplify a mesh to half, a quarter... of its triangles
+void benchLod(const char* name, const Mesh& mesh) {
+    std::vector<Vertex> vertices = mesh.getVertices();
+    const std::vector<unsigned int>& indices = mesh.getIndices();
+    StridedView<const vec3> positions(&vertices[0].position, vertices.size(), sizeof(Vertex));
+    std::vector<size_t> targets;
+    for (int k = 1; k <= MAX_LODS; ++k) {
+        targets.push_back(indices.size() >> k);
+    }
+    std::vector<std::vector<unsigned int>> levels;
+    std::vector<float> errors;
+    Clock::time_point start = Clock::now();
+    MeshSimplifier().simplify(indices.data(), indices.size(), positions, targets, levels, errors);
+    double seconds = secondsSince(start);
+    std::printf("lod     %10zu triangles  %-24s", indices.size() / 3, name);
+    for (size_t k = 0; k < levels.size(); ++k) {
+        std::printf(" %zu (%.5f)", levels[k].size() / 3, double(errors[k]));
+    }
+    std::printf("  %7.3f s\n", seconds);
+}
+
+//! Generate the levels of detail of every mesh of a model file
+void benchLod(const char* fileName) {
+    Model model;
+    if (!model.load(QString(fileName))) {
+        std::printf("lod     unable to load %s\n", fileName);
+        return;
+    }
+    model.optimizeVertexCache();
+    Clock::time_point start = Clock::now();
+    model.generateLods();
+    double seconds = secondsSince(start);
+    size_t triangles[MAX_LODS] = {};
+    float errors[MAX_LODS] = {};
+    for (const MeshData& sep : model.getSeparators()) {
+        for (int k = 0; k < MAX_LODS; ++k) {
+            //A mesh without this level is drawn with its coarsest one
+            const MeshLod* lod = sep.lodCount > 0 ? &sep.lods[std::min(k, sep.lodCount - 1)] : nullptr;
+            triangles[k] += size_t(lod ? lod->howMany : sep.howMany) / 3;
+            errors[k] = std::max(errors[k], lod ? lod->error : 0.0f);
+        }
+    }
+    std::printf("lod     %10zu triangles  %-24s", model.trianglesCount(), fileName);
+    for (int k = 0; k < MAX_LODS; ++k) {
+        std::printf(" %zu (%.5f)", triangles[k], double(errors[k]));
+    }
+    std::printf("  %7.3f s\n", seconds);
+}
+
+//! Split the meshes (in the unit cube) in meshlets and cull them from 14 directions
+void benchMeshlets(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                   const std::vector<MeshData>& separators) {
+    static const vec3 directions[] = {
+        vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1),
+        vec3(1, 1, 1), vec3(-1, 1, 1), vec3(1, -1, 1), vec3(1, 1, -1),
+        vec3(-1, -1, 1), vec3(-1, 1, -1), vec3(1, -1, -1), vec3(-1, -1, -1)
+    };
+    StridedView<const vec3> positions(&vertices[0].position, vertices.size(), sizeof(Vertex));
+    //The meshlets of each mesh, as Model::buildMeshlets does
+    std::vector<Meshlet> meshlets;
+    std::vector<size_t> firstMeshlet;
+    size_t triangles = 0;
+    MeshletBuilder builder;
+    Clock::time_point start = Clock::now();
+    for (const MeshData& sep : separators) {
+        firstMeshlet.push_back(meshlets.size());
+        builder.build(indices.data() + sep.startIndex, size_t(sep.howMany),
+                      positions.slice(size_t(sep.startVertex), vertices.size() - size_t(sep.startVertex)), meshlets);
+        triangles += size_t(sep.howMany) / 3;
+    }
+    firstMeshlet.push_back(meshlets.size());
+    double buildSeconds = secondsSince(start);
+    //Triangles sent to the GPU after the culling, and the ones really facing the camera
+    size_t drawn = 0;
+    size_t front = 0;
+    double cullSeconds = 0.0;
+    MeshletCuller culler;
+    for (const vec3& direction : directions) {
+        //Close enough that the frustum also cuts the mesh a little
+        vec3 eye = 1.2f * glm::normalize(direction);
+        vec3 up = glm::abs(glm::normalize(direction).y) < 0.99f ? vec3(0, 1, 0) : vec3(1, 0, 0);
+        glm::mat4 PV = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 10.0f) * glm::lookAt(eye, vec3(0.0f), up);
+        start = Clock::now();
+        culler.setView(PV, eye);
+        for (const Meshlet& meshlet : meshlets) {
+            if (culler.visible(meshlet)) {
+                drawn += size_t(meshlet.howMany) / 3;
+            }
+        }
+        cullSeconds += secondsSince(start);
+        for (size_t m = 0; m < separators.size(); ++m) {
+            const MeshData& sep = separators[m];
+            StridedView<const vec3> meshPositions = positions.slice(size_t(sep.startVertex),
+                                                                    vertices.size() - size_t(sep.startVertex));
+            const unsigned int* meshIndices = indices.data() + sep.startIndex;
+            for (GLsizei t = 0; t + 2 < sep.howMany; t += 3) {
+                const vec3& p0 = meshPositions[meshIndices[t]];
+                vec3 n = glm::cross(meshPositions[meshIndices[t + 1]] - p0, meshPositions[meshIndices[t + 2]] - p0);
+                front += glm::dot(n, p0 - eye) < 0.0f ? 1 : 0;
+            }
+        }
+    }
+    const double views = double(sizeof(directions) / sizeof(directions[0]));
+    std::printf("meshlet %10zu triangles  %-24s %zu meshlets (%.1f triangles each)  drawn %.1f%%"
+                "  front facing %.1f%%  build %.3f s  cull %.3f ms per view\n",
+                triangles, name, meshlets.size(), double(triangles) / double(std::max<size_t>(meshlets.size(), 1)),
+                100.0 * double(drawn) / (views * double(triangles)), 100.0 * double(front) / (views * double(triangles)),
+                buildSeconds, 1000.0 * cullSeconds / views);
+}
+
+//! Ray that hits the triangle closest to its origin, testing all of them
+bool bruteForceHit(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                   const std::vector<MeshData>& separators, const vec3& origin, const vec3& direction, RayHit& hit) {
+    vec3 d = glm::normalize(direction);
+    for (size_t m = 0; m < separators.size(); ++m) {
+        const MeshData& sep = separators[m];
+        const unsigned int* meshIndices = indices.data() + sep.startIndex;
+        for (GLsizei t = 0; t + 2 < sep.howMany; t += 3) {
+            const vec3& p0 = vertices[size_t(sep.startVertex) + meshIndices[t]].position;
+            vec3 e1 = vertices[size_t(sep.startVertex) + meshIndices[t + 1]].position - p0;
+            vec3 e2 = vertices[size_t(sep.startVertex) + meshIndices[t + 2]].position - p0;
+            vec3 p = glm::cross(d, e2);
+            float det = glm::dot(e1, p);
+            if (det == 0.0f) {
+                continue;
+            }
+            vec3 s = origin - p0;
+            float u = glm::dot(s, p) / det;
+            vec3 q = glm::cross(s, e1);
+            float v = glm::dot(d, q) / det;
+            float distance = glm::dot(e2, q) / det;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance > 0.0f && distance < hit.distance) {
+                hit.distance = distance;
+                hit.mesh = int(m);
+                hit.triangle = unsigned(t / 3);
+            }
+        }
+    }
+    return hit.mesh >= 0;
+}
+
+//! Build the picking BVH of the meshes (in the unit cube) and trace random rays through it
+void benchPick(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+               const std::vector<MeshData>& separators) {
+    const size_t RAYS = 100000;
+    const size_t CHECKED = 16;
+    std::vector<BvhMesh> meshes;
+    size_t triangles = 0;
+    for (const MeshData& sep : separators) {
+        BvhMesh mesh = {indices.data() + sep.startIndex, size_t(sep.howMany), sizeof(unsigned int), size_t(sep.startVertex)};
+        meshes.push_back(mesh);
+        triangles += size_t(sep.howMany) / 3;
+    }
+    TriangleBvh bvh;
+    Clock::time_point start = Clock::now();
+    bvh.build(StridedView<const vec3>(&vertices[0].position, vertices.size(), sizeof(Vertex)), meshes);
+    double buildSeconds = secondsSince(start);
+    //From a sphere around the model towards a point inside it, like a click on the model
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<vec3> origins(RAYS);
+    std::vector<vec3> directions(RAYS);
+    for (size_t i = 0; i < RAYS; ++i) {
+        vec3 around(unit(random), unit(random), unit(random));
+        origins[i] = 2.0f * glm::normalize(around + vec3(0.0f, 0.0f, 1.0e-6f));
+        directions[i] = 0.5f * vec3(unit(random), unit(random), unit(random)) - origins[i];
+    }
+    size_t hits = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < RAYS; ++i) {
+        RayHit hit;
+        hits += bvh.intersect(origins[i], directions[i], hit) ? 1 : 0;
+    }
+    double querySeconds = secondsSince(start);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < CHECKED; ++i) {
+        RayHit hit;
+        RayHit expected;
+        bool found = bvh.intersect(origins[i], directions[i], hit);
+        bool expectedFound = bruteForceHit(vertices, indices, separators, origins[i], directions[i], expected);
+        if (found != expectedFound || (found && glm::abs(hit.distance - expected.distance) > 1.0e-5f)) {
+            ++mismatches;
+        }
+    }
+    std::printf("pick    %10zu triangles  %-24s %zu nodes  build %.3f s  %.2f us per ray  hits %.1f%%"
+                "  %zu of %zu differ from brute force\n",
+                triangles, name, bvh.nodeCount(), buildSeconds, 1.0e6 * querySeconds / double(RAYS),
+                100.0 * double(hits) / double(RAYS), mismatches, CHECKED);
+}
+
+//! An Assimp scene, as if it was just imported, with meshes of a strip of trianglesPerMesh triangles each
+aiScene* makeScene(size_t meshCount, size_t trianglesPerMesh) {
+    aiScene* scene = new aiScene();
+    scene->mNumMeshes = static_cast<unsigned int>(meshCount);
+    scene->mMeshes = new aiMesh*[meshCount];
+    scene->mRootNode = new aiNode();
+    scene->mRootNode->mNumMeshes = scene->mNumMeshes;
+    scene->mRootNode->mMeshes = new unsigned int[meshCount];
+    for (size_t m = 0; m < meshCount; ++m) {
+        aiMesh* mesh = new aiMesh();
+        mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+        mesh->mNumVertices = static_cast<unsigned int>(trianglesPerMesh + 2);
+        mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+        mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+        mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+        mesh->mNumUVComponents[0] = 2;
+        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+            float x = float(i / 2);
+            float y = float(i % 2) + float(m);
+            mesh->mVertices[i] = aiVector3D(x, y, 0.0f);
+            mesh->mNormals[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+            mesh->mTextureCoords[0][i] = aiVector3D(x / float(trianglesPerMesh), y, 0.0f);
+        }
+        mesh->mNumFaces = static_cast<unsigned int>(trianglesPerMesh);
+        mesh->mFaces = new aiFace[trianglesPerMesh];
+        for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
+            mesh->mFaces[t].mNumIndices = 3;
+            mesh->mFaces[t].mIndices = new unsigned int[3];
+            mesh->mFaces[t].mIndices[0] = t;
+            mesh->mFaces[t].mIndices[1] = t % 2 == 0 ? t + 1 : t + 2;
+            mesh->mFaces[t].mIndices[2] = t % 2 == 0 ? t + 2 : t + 1;
+        }
+        scene->mMeshes[m] = mesh;
+        scene->mRootNode->mMeshes[m] = static_cast<unsigned int>(m);
+    }
+    return scene;
+}
+
+//! The import as it was before: one mesh after the other, one push_back at a time
+void legacyImport(const aiScene* scene, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    for (unsigned int m = 0; m < scene->mRootNode->mNumMeshes; ++m) {
+        const aiMesh* mesh = scene->mMeshes[scene->mRootNode->mMeshes[m]];
+        for (unsigned int t = 0; t < mesh->mNumFaces; ++t) {
+            for (unsigned int i = 0; i < mesh->mFaces[t].mNumIndices; ++i) {
+                indices.push_back(mesh->mFaces[t].mIndices[i]);
+            }
+        }
+        Vertex v;
+        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+            v.position = vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            v.normal = vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            v.textCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+            vertices.push_back(v);
+        }
+    }
+}
+
+//! Convert a scene of 1M triangles split in meshCount meshes, with Model::load and as it was before
+void benchImport(size_t meshCount, bool legacy) {
+    const size_t TRIANGLES = 1000000;
+    meshCount = std::max<size_t>(meshCount, 1);
+    aiScene* scene = makeScene(meshCount, TRIANGLES / meshCount);
+    Model model;
+    Clock::time_point start = Clock::now();
+    model.load(scene);
+    double importTime = secondsSince(start);
+    std::printf("import  %10zu meshes     two passes %8.3f s  (%zu triangles)\n",
+                meshCount, importTime, model.trianglesCount());
+    if (legacy) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        start = Clock::now();
+        legacyImport(scene, vertices, indices);
+        double legacyTime = secondsSince(start);
+        bool same = indices == model.getIndices() && vertices.size() == model.vertexCount();
+        std::vector<Vertex> converted = model.getVertices();
+        for (size_t i = 0; same && i < vertices.size(); ++i) {
+            same = vertices[i].position == converted[i].position && vertices[i].normal == converted[i].normal &&
+                   vertices[i].textCoords == converted[i].textCoords;
+        }
+        std::printf("import  %10zu meshes     push_back  %8.3f s  speedup %.1fx  %s\n",
+                    meshCount, legacyTime, legacyTime / importTime, same ? "identical" : "DIFFERENT");
+    }
+    delete scene;
+}
+
+//! Decode the images one after the other (as MeshLoad did) and all at the same time with the AssetManager
+void benchDecode(const std::vector<const char*>& files) {
+    Clock::time_point start = Clock::now();
+    std::vector<QImage> serial;
+    for (const char* file : files) {
+        serial.push_back(QImage(QString(file)).mirrored());
+    }
+    double serialTime = secondsSince(start);
+    AssetManager manager;
+    std::vector<AssetHandle<DecodedImage>> handles;
+    start = Clock::now();
+    for (const char* file : files) {
+        handles.push_back(manager.loadImage(QString(file)));
+    }
+    for (const AssetHandle<DecodedImage>& handle : handles) {
+        handle.wait();
+    }
+    double parallelTime = secondsSince(start);
+    bool same = true;
+    std::set<QByteArray> contents;
+    for (size_t i = 0; i < files.size(); ++i) {
+        same = same && serial[i].convertToFormat(QImage::Format_RGBA8888) == handles[i].get().image;
+        contents.insert(handles[i].get().contentHash);
+    }
+    std::printf("decode  %10zu images     serial %8.3f s  workers %8.3f s  speedup %.1fx  %s  %zu different\n",
+                files.size(), serialTime, parallelTime, serialTime / parallelTime, same ? "identical" : "DIFFERENT",
+                contents.size());
+}
+
+//! Sort the render queue of a frame of itemCount meshes with 64 materials, against std::stable_sort
+void benchQueue(size_t itemCount) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> depths(0.1f, 100.0f);
+    RenderQueue queue;
+    std::vector<RenderItem> items(itemCount);
+    for (size_t i = 0; i < itemCount; ++i) {
+        items[i].key = RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, 0, unsigned(random() % 64), depths(random));
+        items[i].index = uint32_t(i);
+    }
+    const int frames = 20;
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        queue.clear();
+        for (const RenderItem& item : items) {
+            queue.push(item.key, item.index);
+        }
+        queue.sort();
+    }
+    double radixTime = secondsSince(start) / frames;
+    std::vector<RenderItem> sorted;
+    start = Clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        sorted = items;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const RenderItem& a, const RenderItem& b) {
+            return a.key < b.key;
+        });
+    }
+    double stdTime = secondsSince(start) / frames;
+    bool same = true;
+    for (size_t i = 0; i < itemCount; ++i) {
+        same = same && sorted[i].index == queue.items()[i].index;
+    }
+    //Material binds, in the order of the file and sorted
+    size_t unsortedBinds = 0;
+    size_t sortedBinds = 0;
+    for (size_t i = 0; i < itemCount; ++i) {
+        unsortedBinds += i == 0 || RenderQueue::material(items[i].key) != RenderQueue::material(items[i - 1].key);
+        sortedBinds += i == 0 || RenderQueue::material(queue.items()[i].key) !=
+                                 RenderQueue::material(queue.items()[i - 1].key);
+    }
+    std::printf("queue   %10zu items  radix %8.3f ms  stable_sort %8.3f ms  speedup %.1fx  binds %zu -> %zu  %s\n",
+                itemCount, radixTime * 1000.0, stdTime * 1000.0, stdTime / radixTime, unsortedBinds, sortedBinds,
+                same ? "same order" : "DIFFERENT");
+}
+
+//! Fill the indirect draws of a frame of meshCount meshes, and count the OpenGL calls of both ways to draw them
+void benchIndirect(size_t meshCount) {
+    //Half of the meshes with 16 bits indices, as Model packIndices leaves a model of small meshes
+    std::vector<MeshData> separators(meshCount, MeshData());
+    std::vector<DrawMaterial> materials(meshCount);
+    std::mt19937 random(1);
+    GLint indexOffset = 0;
+    for (size_t i = 0; i < meshCount; ++i) {
+        MeshData& sep = separators[i];
+        sep.howMany = GLsizei(3 * (100 + random() % 1000));
+        sep.indexType = i % 2 == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        sep.indexOffset = indexOffset;
+        sep.startVertex = GLint(i * 1000);
+        indexOffset += sep.howMany * 4;
+        TextureSlot slot;
+        slot.array = int(i % TextureAtlas::MAX_ARRAYS);
+        slot.layer = int(i);
+        materials[i] = IndirectDrawList::material(slot, slot, QuantizationBox{glm::vec3(0.0f), glm::vec3(1.0f)});
+    }
+    IndirectDrawList draws;
+    const int frames = 100;
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        draws.clear();
+        for (size_t i = 0; i < meshCount; ++i) {
+            const MeshData& sep = separators[i];
+            draws.add(sep.indexType, sep.howMany, sep.indexOffset, sep.startVertex, materials[i]);
+        }
+    }
+    double frameTime = secondsSince(start) / frames;
+    bool same = draws.drawCount() == meshCount;
+    for (int batch = 0; batch < IndirectDrawList::BATCH_COUNT; ++batch) {
+        for (size_t k = 0; k < draws.commands(batch).size(); ++k) {
+            const MeshData& sep = separators[2 * k + size_t(batch)];
+            const GLuint indexSize = batch == 0 ? 2 : 4;
+            same = same && draws.commands(batch)[k].firstIndex * indexSize == GLuint(sep.indexOffset) &&
+                   draws.commands(batch)[k].count == GLuint(sep.howMany);
+        }
+    }
+    //Per mesh: 2 binds and 2 sampler uniforms (or 6 slot uniforms with the texture arrays), the draw and a release.
+    //Indirect: binding and orphaning 2 buffers, 2 uploads and a uniform and a multi draw per batch, 2 unbinds
+    const size_t perMeshCalls = meshCount * 6;
+    const size_t indirectCalls = 2 * 2 + 4 + 2 * IndirectDrawList::BATCH_COUNT + 2;
+    std::printf("indirect %9zu meshes  fill %8.3f us/frame  %zu bytes/frame  GL calls: a draw per mesh %zu, indirect %zu  %s\n",
+                meshCount, frameTime * 1.0e6, meshCount * (sizeof(DrawElementsIndirectCommand) + sizeof(DrawMaterial)),
+                perMeshCalls, indirectCalls, same ? "ok" : "WRONG");
+}
+
+//! Cost of a CPU profiler zone, on one thread and on several at once, and check that the trace has them all
+void benchTrace(size_t zoneCount) {
+    CpuProfiler& profiler = CpuProfiler::instance();
+    //Some work inside each zone, that the compiler can not drop
+    volatile unsigned int sink = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < zoneCount; ++i) {
+        sink = sink + unsigned(i);
+    }
+    double bareTime = secondsSince(start);
+    start = Clock::now();
+    for (size_t i = 0; i < zoneCount; ++i) {
+        CpuZone zone("bench zone");
+        sink = sink + unsigned(i);
+    }
+    double zoneTime = secondsSince(start);
+    const double perZone = (zoneTime - bareTime) / double(zoneCount);
+    //Several threads at once, each one in its own ring
+    const size_t threadCount = 4;
+    start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([zoneCount, threadCount] {
+            for (size_t i = 0; i < zoneCount / threadCount; ++i) {
+                CpuZone zone("worker zone");
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double threadsTime = secondsSince(start);
+    profiler.frame();
+    start = Clock::now();
+    const std::string json = profiler.traceJson();
+    double exportTime = secondsSince(start);
+    //Each ring keeps its last zones, the threads of this call are the last ones to register
+    std::map<int, size_t> threadEvents;
+    for (size_t line = json.find("\"ph\":\"X\""); line != std::string::npos; line = json.find("\"ph\":\"X\"", line + 1)) {
+        ++threadEvents[std::atoi(json.c_str() + json.find("\"tid\":", line) + 6)];
+    }
+    //Once a ring is full, the slot that its thread may be writing is not exported
+    const size_t kept = size_t(CpuProfiler::THREAD_EVENTS);
+    const size_t expected = zoneCount / threadCount < kept ? zoneCount / threadCount : kept - 1;
+    bool same = threadEvents.size() > threadCount;
+    auto thread = threadEvents.rbegin();
+    for (size_t t = 0; t < threadCount && thread != threadEvents.rend(); ++t, ++thread) {
+        same = same && thread->second == expected;
+    }
+    //MeshLoad records about 10 zones per frame, at 60 frames per second
+    const double overhead = 10.0 * perZone * 60.0 * 100.0;
+    std::printf("trace  %10zu zones  %6.1f ns/zone  %zu threads %8.3f ms  export %8.3f ms  %zu bytes  overhead at 10 zones/frame, 60 fps %.4f%%  %s\n",
+                zoneCount, perZone * 1.0e9, threadCount, threadsTime * 1000.0, exportTime * 1000.0, json.size(), overhead,
+                same ? "ok" : "WRONG");
+}
+
+//! Images of several sizes (some of them byte-identical), as the materials of a big model
+std::vector<DecodedImage> makeMaterialImages(size_t count) {
+    const int sizes[][2] = {{1024, 1024}, {512, 512}, {1024, 512}, {256, 256}, {300, 200}, {512, 512}, {128, 64}};
+    std::vector<DecodedImage> images(count);
+    for (size_t i = 0; i < count; ++i) {
+        //Every eighth one repeats the contents of the previous one
+        if (i % 8 == 7) {
+            images[i] = images[i - 1];
+            continue;
+        }
+        const int* size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        QImage image(size[0], size[1], QImage::Format_RGBA8888);
+        for (int y = 0; y < image.height(); ++y) {
+            uchar* row = image.scanLine(y);
+            for (int x = 0; x < 4 * image.width(); ++x) {
+                row[x] = uchar((i * 131 + size_t(y) * 31 + size_t(x) * 7) & 0xFF);
+            }
+        }
+        images[i].image = image;
+        images[i].contentHash = QByteArray::number(int(i));
+    }
+    return images;
+}
+
+//! Pack the images in a texture array, and check that every image is at its slot, with its gutter
+void benchAtlas(const char* name, const std::vector<DecodedImage>& decoded) {
+    std::vector<const DecodedImage*> images;
+    for (const DecodedImage& image : decoded) {
+        images.push_back(image.image.isNull() ? nullptr : &image);
+    }
+    TextureAtlas atlas;
+    Clock::time_point start = Clock::now();
+    atlas.pack(images);
+    double packTime = secondsSince(start);
+    //The pixel of an image, and where it is in the layer. Outside of the image it is the gutter
+    auto texel = [](const QImage& image, int x, int y) {
+        x = ((x % image.width()) + image.width()) % image.width();
+        y = ((y % image.height()) + image.height()) % image.height();
+        return image.constScanLine(y) + 4 * x;
+    };
+    bool same = true;
+    size_t layerBytes = 0;
+    std::vector<uchar> pixels;
+    start = Clock::now();
+    for (int array = 0; array < atlas.arrayCount(); ++array) {
+        const int width = atlas.layerSize(array).width();
+        const int height = atlas.layerSize(array).height();
+        layerBytes += size_t(width) * size_t(height) * 4 * size_t(atlas.layerCount(array));
+        for (int layer = 0; layer < atlas.layerCount(array); ++layer) {
+            atlas.compose(array, layer, images, pixels);
+            for (size_t i = 0; i < images.size(); ++i) {
+                const TextureSlot& slot = atlas.textureSlots()[i];
+                if (slot.array != array || slot.layer != layer) {
+                    continue;
+                }
+                const QImage& image = images[i]->image;
+                const int x0 = int(glm::round(slot.offset.x * width));
+                const int y0 = int(glm::round(slot.offset.y * height));
+                //The corners, the center and just outside of the corners (the gutter, if there is one)
+                const bool gutter = image.width() < width;
+                const int xs[] = {0, image.width() / 2, image.width() - 1, -1, image.width()};
+                const int ys[] = {0, image.height() / 2, image.height() - 1, -1, image.height()};
+                for (int x : xs) {
+                    for (int y : ys) {
+                        const bool inside = x >= 0 && x < image.width() && y >= 0 && y < image.height();
+                        if (!inside && !gutter) {
+                            continue;
+                        }
+                        const uchar* packed = pixels.data() + 4 * (size_t(y0 + y) * size_t(width) + size_t(x0 + x));
+                        same = same && std::memcmp(packed, texel(image, x, y), 4) == 0;
+                    }
+                }
+            }
+        }
+    }
+    double composeTime = secondsSince(start);
+    size_t bytes = 0;
+    for (const DecodedImage& image : decoded) {
+        bytes += size_t(image.image.bytesPerLine()) * size_t(image.image.height());
+    }
+    std::printf("atlas   %-24s %5zu images  %4d layers in %d arrays  occupancy %5.1f%%  %zu shared (%zu bytes)\n",
+                name, images.size(), atlas.layerCount(), atlas.arrayCount(), 100.0f * atlas.occupancy(),
+                atlas.sharedCount(), atlas.savedBytes());
+    std::printf("        images %zu bytes, layers %zu bytes  pack %8.3f ms  compose %8.3f s  binds per mesh 2 -> 0  %s\n",
+                bytes, layerBytes, packTime * 1000.0, composeTime, same ? "ok" : "WRONG");
+}
+
+//! Peak resident memory of the process in bytes, 0 where it can not be read
+size_t peakRssBytes() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return size_t(std::strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+        }
+    }
+#endif
+#ifdef __unix__
+    //The peak of the whole run, it can not be reset
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return size_t(usage.ru_maxrss) * 1024;
+    }
+#endif
+    return 0;
+}
+
+//! Start the peak resident memory again from the current one (only Linux can)
+void resetPeakRss() {
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+//! A pass of the suite on an input, the median time of its repetitions
+struct SuiteResult {
+    std::string name;
+    std::string input;
+    size_t vertices;
+    size_t triangles;
+    //! What the pass reads: the triangles, the vertices or the file
+    size_t bytes;
+    int repetitions;
+    double seconds;
+    size_t allocations;
+    size_t allocatedBytes;
+    //! The most heap in use above what there was before the pass
+    size_t peakHeapBytes;
+    size_t peakRssBytes;
+    bool ok;
+};
+
+//! Run setup (not timed) and then run, repetitions times
+template <typename Setup, typename Run>
+SuiteResult measureSuite(const char* name, const std::string& input, int repetitions, Setup setup, Run run) {
+    SuiteResult result = SuiteResult();
+    result.name = name;
+    result.input = input;
+    result.repetitions = repetitions;
+    result.ok = true;
+    std::vector<double> times;
+    for (int i = 0; i < repetitions; ++i) {
+        setup();
+        resetPeakRss();
+        const size_t count = allocationCount.load(std::memory_order_relaxed);
+        const size_t bytes = allocatedBytes.load(std::memory_order_relaxed);
+        const size_t live = liveBytes.load(std::memory_order_relaxed);
+        peakLiveBytes.store(live, std::memory_order_relaxed);
+        Clock::time_point start = Clock::now();
+        result.ok = run() && result.ok;
+        times.push_back(secondsSince(start));
+        //Every repetition allocates the same, the peaks are the biggest one
+        result.allocations = allocationCount.load(std::memory_order_relaxed) - count;
+        result.allocatedBytes = allocatedBytes.load(std::memory_order_relaxed) - bytes;
+        result.peakHeapBytes = std::max(result.peakHeapBytes, peakLiveBytes.load(std::memory_order_relaxed) - live);
+        result.peakRssBytes = std::max(result.peakRssBytes, peakRssBytes());
+    }
+    std::sort(times.begin(), times.end());
+    result.seconds = times[times.size() / 2];
+    std::fprintf(stderr, "suite   %-18s %-28s %9.3f ms  %9zu allocations  %s\n", name, input.c_str(),
+                 result.seconds * 1000.0, result.allocations, result.ok ? "ok" : "FAILED");
+    return result;
+}
+
+//! Time the passes over the vertices of a loaded mesh
+void suitePasses(BenchMesh& mesh, const std::string& input, int repetitions, std::vector<SuiteResult>& results) {
+    const size_t vertexBytes = mesh.vertexCount() * sizeof(Vertex);
+    const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(10.0f), vec3(0.0f, 1.0f, 0.0f));
+    auto nothing = []() {};
+    std::vector<SuiteResult> passes;
+    passes.push_back(measureSuite("updateBoundingBox", input, repetitions, nothing, [&mesh]() {
+        mesh.updateBoundingBox();
+        return true;
+    }));
+    passes.push_back(measureSuite("transform", input, repetitions, nothing, [&mesh, &rotation]() {
+        mesh.transform(rotation);
+        return true;
+    }));
+    passes.push_back(measureSuite("toUnitCube", input, repetitions, nothing, [&mesh]() {
+        mesh.toUnitCube();
+        return true;
+    }));
+    for (SuiteResult& result : passes) {
+        result.vertices = mesh.vertexCount();
+        result.triangles = mesh.trianglesCount();
+        result.bytes = vertexBytes;
+        results.push_back(result);
+    }
+}
+
+//! Time loading a model file with Mesh::loadFromFile and Model::load, and the passes over it
+void suiteFile(const QString& fileName, const std::string& input, int repetitions, std::vector<SuiteResult>& results) {
+    const size_t fileBytes = size_t(QFileInfo(fileName).size());
+    Mesh mesh;
+    SuiteResult result = measureSuite("Mesh::loadFromFile", input, repetitions, [&mesh]() {
+        mesh.clear();
+    }, [&mesh, &fileName]() {
+        return mesh.loadFromFile(fileName);
+    });
+    result.vertices = mesh.vertexCount();
+    result.triangles = mesh.trianglesCount();
+    result.bytes = fileBytes;
+    results.push_back(result);
+
+    Model model;
+    result = measureSuite("Model::load", input, repetitions, [&model]() {
+        model.clear();
+    }, [&model, &fileName]() {
+        return model.load(fileName);
+    });
+    result.vertices = model.vertexCount();
+    result.triangles = model.trianglesCount();
+    result.bytes = fileBytes;
+    results.push_back(result);
+
+    if (!model.empthy()) {
+        BenchMesh loaded;
+        loaded.loadVerticesAndIndices(model.getVertices(), model.getIndices(), model.hasNormals(), model.hasTexture());
+        suitePasses(loaded, input, repetitions, results);
+    }
+}
+
+//! Weld a grid of (at least) count triangles, time the passes over it, and save and load it back as an obj file
+void suiteSynthetic(size_t count, int repetitions, std::vector<SuiteResult>& results) {
+    const std::string input = "grid " + std::to_string(count);
+    std::vector<Triangle> soup = makeTriangleSoup(count);
+    BenchMesh mesh;
+    SuiteResult result = measureSuite("loadFromTriangles", input, repetitions, [&mesh]() {
+        mesh.clear();
+    }, [&mesh, &soup]() {
+        return mesh.loadFromTriangles(soup);
+    });
+    result.vertices = mesh.vertexCount();
+    result.triangles = mesh.trianglesCount();
+    result.bytes = soup.size() * sizeof(Triangle);
+    results.push_back(result);
+
+    //Like a loaded model, and the obj exporter needs the normals
+    mesh.recalculateNormals();
+    suitePasses(mesh, input, repetitions, results);
+
+    const QString fileName = QDir::tempPath() + "/meshbench_grid_" + QString::number(qulonglong(count)) + ".obj";
+    result = measureSuite("Mesh::save", input, repetitions, [&fileName]() {
+        QFile::remove(fileName);
+    }, [&mesh, &fileName]() {
+        return mesh.save(fileName) && QFileInfo(fileName).size() > 0;
+    });
+    result.vertices = mesh.vertexCount();
+    result.triangles = mesh.trianglesCount();
+    result.bytes = size_t(QFileInfo(fileName).size());
+    results.push_back(result);
+
+    suiteFile(fileName, input + " obj", repetitions, results);
+    QFile::remove(fileName);
+}
+
+std::string suiteString(const std::string& text) {
+    std::string json = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+        }
+        json += c;
+    }
+    return json + "\"";
+}
+
+std::string suiteNumber(double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.4f", value);
+    return number;
+}
+
+//! The results in the same order and with the same keys every run, so two runs can be diffed
+std::string suiteJson(const std::vector<SuiteResult>& results) {
+    std::string json = "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SuiteResult& result = results[i];
+        const double seconds = std::max(result.seconds, 1.0e-9);
+        json += i == 0 ? "\n" : ",\n";
+        json += "    {\"name\": " + suiteString(result.name) +
+                ", \"input\": " + suiteString(result.input) +
+                ", \"vertices\": " + std::to_string(result.vertices) +
+                ", \"triangles\": " + std::to_string(result.triangles) +
+                ", \"bytes\": " + std::to_string(result.bytes) +
+                ", \"repetitions\": " + std::to_string(result.repetitions) +
+                ", \"ms\": " + suiteNumber(result.seconds * 1000.0) +
+                ", \"vertices_per_second\": " + suiteNumber(double(result.vertices) / seconds) +
+                ", \"mb_per_second\": " + suiteNumber(double(result.bytes) / seconds * 1.0e-6) +
+                ", \"allocations\": " + std::to_string(result.allocations) +
+                ", \"allocated_bytes\": " + std::to_string(result.allocatedBytes) +
+                ", \"peak_heap_bytes\": " + std::to_string(result.peakHeapBytes) +
+                ", \"peak_rss_bytes\": " + std::to_string(result.peakRssBytes) +
+                ", \"ok\": " + (result.ok ? "true" : "false") + "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+void usage(const char* program) {
+    std::printf("Usage: %s [weld|layout|vcache|overdraw|compact|lod|meshlet|pick|import|decode|atlas|indirect|queue|trace|suite] [--no-legacy] [--output file.json] [size|file ...]\n"
+                "  weld    welds triangle soups of 10K, 1M and 10M triangles (default)\n"
+                "          --no-legacy skips the old std::set path (minutes at 10M)\n"
+                "  layout  position only passes in both vertex layouts, 1M and 10M vertices\n"
+                "  vcache  vertex cache optimization of shuffled grids of 100K and 1M triangles\n"
+                "          and of the given model files\n"
+                "  overdraw shaded fragments (software counted) of a shuffled lattice of spheres\n"
+                "          of 100K triangles and of the given model files, before and after\n"
+                "          the overdraw optimization\n"
+                "  compact size and quantization error of the compact vertices of a lattice of\n"
+                "          spheres of 100K triangles and of the given model files\n"
+                "  lod     triangles and error of each level of detail of a lattice of spheres\n"
+                "          of 100K triangles and of the given model files\n"
+                "  meshlet triangles left after the meshlet culling from 14 directions, for a\n"
+                "          lattice of spheres of 1M triangles and the given model files\n"
+                "  pick    build time of the picking BVH and time per ray, for lattices of spheres\n"
+                "          of 1M and 10M triangles and the given model files\n"
+                "  import  conversion of a scene of 1M triangles in 1, 100 and 1000 meshes\n"
+                "          (or the given numbers of meshes) with Model::load, and as before\n"
+                "  decode  decoding (and flipping) the given images one by one, and in the\n"
+                "          workers of the AssetManager\n"
+                "  atlas   packing of 256 synthetic materials of several sizes (or the given\n"
+                "          count) and of the given images in a texture array\n"
+                "  indirect the indirect draws of a frame of 200, 2K and 20K meshes\n"
+                "  queue   sorting a render queue of 1K, 10K and 100K items\n"
+                "  trace   cost of 100K and 10M zones of the CPU profiler, and of exporting them\n"
+                "  suite   time, allocations and peak memory of the Mesh and Model passes over\n"
+                "          grids of 10K, 100K and 1M triangles (saved and loaded back as obj)\n"
+                "          and over the given model files, as JSON (also in --output)\n", program);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string mode = "weld";
+    bool legacy = true;
+    std::vector<size_t> sizes;
+    std::vector<const char*> files;
+    const char* output = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--no-legacy") == 0) {
+            legacy = false;
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (std::strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (std::strcmp(argv[i], "weld") == 0 || std::strcmp(argv[i], "layout") == 0 ||
+                   std::strcmp(argv[i], "vcache") == 0 || std::strcmp(argv[i], "overdraw") == 0 ||
+                   std::strcmp(argv[i], "compact") == 0 || std::strcmp(argv[i], "lod") == 0 ||
+                   std::strcmp(argv[i], "meshlet") == 0 || std::strcmp(argv[i], "pick") == 0 ||
+                   std::strcmp(argv[i], "import") == 0 || std::strcmp(argv[i], "decode") == 0 ||
+                   std::strcmp(argv[i], "atlas") == 0 || std::strcmp(argv[i], "indirect") == 0 ||
+                   std::strcmp(argv[i], "queue") == 0 || std::strcmp(argv[i], "trace") == 0 ||
+                   std::strcmp(argv[i], "suite") == 0) {
+            mode = argv[i];
+        } else if (std::isdigit(static_cast<unsigned char>(argv[i][0]))) {
+            sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (mode == "suite") {
+        const int REPETITIONS = 5;
+        countAllocations.store(true, std::memory_order_relaxed);
+        if (sizes.empty() && files.empty()) {
+            sizes = {10000, 100000, 1000000};
+        }
+        std::vector<SuiteResult> results;
+        for (size_t triangles : sizes) {
+            suiteSynthetic(triangles, REPETITIONS, results);
+        }
+        for (const char* fileName : files) {
+            suiteFile(QString(fileName), fileName, REPETITIONS, results);
+        }
+        const std::string json = suiteJson(results);
+        std::fputs(json.c_str(), stdout);
+        if (output) {
+            std::ofstream file(output, std::ios::binary);
+            if (!(file << json)) {
+                std::fprintf(stderr, "Unable to write %s\n", output);
+                return EXIT_FAILURE;
+            }
+        }
+        bool ok = true;
+        for (const SuiteResult& result : results) {
+            ok = ok && result.ok;
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (mode == "trace") {
+        if (sizes.empty()) {
+            sizes = {100000, 10000000};
+        }
+        for (size_t zones : sizes) {
+            benchTrace(zones);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "queue") {
+        if (sizes.empty()) {
+            sizes = {1000, 10000, 100000};
+        }
+        for (size_t items : sizes) {
+            benchQueue(items);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "indirect") {
+        if (sizes.empty()) {
+            sizes = {200, 2000, 20000};
+        }
+        for (size_t meshes : sizes) {
+            benchIndirect(meshes);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "atlas") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {256};
+        }
+        for (size_t count : sizes) {
+            benchAtlas("materials", makeMaterialImages(count));
+        }
+        if (!files.empty()) {
+            std::vector<DecodedImage> images(files.size());
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (!loadAsset(QString(files[i]), images[i])) {
+                    std::printf("atlas   unable to load %s\n", files[i]);
+                }
+            }
+            benchAtlas("files", images);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "decode") {
+        if (files.empty()) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        benchDecode(files);
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "import") {
+        if (sizes.empty()) {
+            sizes = {1, 100, 1000};
+        }
+        for (size_t meshes : sizes) {
+            benchImport(meshes, legacy);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "pick") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {1000000, 10000000};
+        }
+        for (size_t triangles : sizes) {
+            Mesh mesh;
+            mesh.loadFromTriangles(makeSphereLattice(triangles));
+            mesh.toUnitCube();
+            MeshData whole = MeshData();
+            whole.howMany = GLsizei(mesh.getIndices().size());
+            benchPick("spheres", mesh.getVertices(), mesh.getIndices(), std::vector<MeshData>(1, whole));
+        }
+        for (const char* file : files) {
+            Model model;
+            if (!model.load(QString(file))) {
+                std::printf("pick    unable to load %s\n", file);
+                continue;
+            }
+            model.toUnitCube();
+            benchPick(file, model.getVertices(), model.getIndices(), model.getSeparators());
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "meshlet") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {1000000};
+        }
+        for (size_t triangles : sizes) {
+            Mesh mesh;
+            mesh.loadFromTriangles(makeSphereLattice(triangles));
+            mesh.toUnitCube();
+            mesh.optimizeVertexCache();
+            MeshData whole = MeshData();
+            whole.howMany = GLsizei(mesh.getIndices().size());
+            benchMeshlets("spheres", mesh.getVertices(), mesh.getIndices(), std::vector<MeshData>(1, whole));
+        }
+        for (const char* file : files) {
+            Model model;
+            if (!model.load(QString(file))) {
+                std::printf("meshlet unable to load %s\n", file);
+                continue;
+            }
+            model.toUnitCube();
+            model.optimizeVertexCache();
+            benchMeshlets(file, model.getVertices(), model.getIndices(), model.getSeparators());
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "lod") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {100000};
+        }
+        for (size_t triangles : sizes) {
+            Mesh mesh;
+            mesh.loadFromTriangles(makeSphereLattice(triangles));
+            benchLod("spheres", mesh);
+        }
+        for (const char* file : files) {
+            benchLod(file);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "compact") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {100000};
+        }
+        for (size_t triangles : sizes) {
+            Mesh mesh;
+            mesh.loadFromTriangles(makeSphereLattice(triangles));
+            mesh.recalculateNormals();
+            //A single mesh, so a single bounding box
+            MeshData whole = MeshData();
+            whole.howMany = GLsizei(mesh.getIndices().size());
+            benchCompact("spheres", mesh.getVertices(), std::vector<MeshData>(1, whole));
+        }
+        for (const char* file : files) {
+            Model model;
+            if (!model.load(QString(file))) {
+                std::printf("compact unable to load %s\n", file);
+                continue;
+            }
+            benchCompact(file, model.getVertices(), model.getSeparators());
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "overdraw") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {100000};
+        }
+        for (size_t triangles : sizes) {
+            std::vector<Triangle> soup = makeSphereLattice(triangles);
+            std::shuffle(soup.begin(), soup.end(), std::mt19937(1));
+            Mesh mesh;
+            mesh.loadFromTriangles(soup);
+            mesh.toUnitCube();
+            benchOverdraw("shuffled spheres", mesh);
+        }
+        for (const char* file : files) {
+            Model model;
+            if (!model.load(QString(file))) {
+                std::printf("overdraw unable to load %s\n", file);
+                continue;
+            }
+            model.toUnitCube();
+            benchOverdraw(file, model);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "vcache") {
+        if (sizes.empty() && files.empty()) {
+            sizes = {100000, 1000000};
+        }
+        for (size_t triangles : sizes) {
+            benchVertexCache(triangles);
+        }
+        for (const char* file : files) {
+            benchVertexCache(file);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == "layout") {
+        if (sizes.empty()) {
+            sizes = {1000000, 10000000};
+        }
+        for (size_t vertices : sizes) {
+            //The soup has about twice as many triangles as welded vertices
+            benchLayout(2 * vertices, INTERLEAVED_LAYOUT);
+            benchLayout(2 * vertices, SEPARATED_LAYOUT);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (sizes.empty()) {
+        sizes = {10000, 1000000, 10000000};
+    }
+    for (size_t triangles : sizes) {
+        benchWelding(triangles, legacy);
+    }
+
+    return EXIT_SUCCESS;
+}
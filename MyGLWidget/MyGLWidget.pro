@@ -28,13 +28,19 @@ SOURCES += \
     baseoglwidget.cpp \
     testoglwidget.cpp \
     trackball.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    trianglebvh.cpp \
+    gpuprofiler.cpp
 
 HEADERS += \
     baseoglwidget.h \
     testoglwidget.h \
     trackball.h \
-    mainwindow.h
+    mainwindow.h \
+    trianglebvh.h \
+    stridedview.h \
+    parallel.h \
+    gpuprofiler.h
 
 # Assimp it's not required to use this template. However, you can use the commented lines
 # as examples of how to include and link exernal libraries to use them in the porject.
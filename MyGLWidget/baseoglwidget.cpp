@@ -266,6 +266,24 @@ void BaseOGLWidget::mouseMoveEvent(QMouseEvent* event) {
     event->accept();
 }
 
+// Unproject the pixel at the near (z = -1) and far (z = 1) planes
+void BaseOGLWidget::pixelRay(const QPointF& pixel, const glm::mat4& VM, glm::vec3& origin, glm::vec3& direction) const {
+    float x = 2.0f * float(pixel.x()) / float(width()) - 1.0f;
+    float y = 1.0f - 2.0f * float(pixel.y()) / float(height());
+    glm::mat4 inversePVM = glm::inverse(mP * VM);
+    glm::vec4 nearPoint = inversePVM * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inversePVM * glm::vec4(x, y, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
+bool BaseOGLWidget::pick(const QPointF& pixel, const TriangleBvh& bvh, RayHit& hit) const {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    pixelRay(pixel, mV * mBall.getRotation() * mM, origin, direction);
+    return bvh.intersect(origin, direction, hit);
+}
+
 // We use the wheel to zoom in/out by changing the camera's fovy (field of view along y axis)
 void BaseOGLWidget::wheelEvent(QWheelEvent* event) {
     QPoint numDegrees{event->angleDelta() / 16};
@@ -11,6 +11,8 @@
 #include <QMouseEvent>
 
 #include "trackball.h"
+#include "trianglebvh.h"
+#include "gpuprofiler.h"
 
 #include <glm/glm.hpp>
 
@@ -85,6 +87,16 @@ protected:
     void mouseMoveEvent(QMouseEvent* event) override;
     //!  To control camera fovy (which is zoom in and out)
     void wheelEvent(QWheelEvent* event) override;
+    //!  Ray through a pixel (in window coordinates) in the space where VM applies
+    /*!
+      It goes from the near to the far plane, so direction is not normalized.
+      With VM = mV * mBall.getRotation() * mM the ray is in model space.
+    */
+    void pixelRay(const QPointF& pixel, const glm::mat4& VM, glm::vec3& origin, glm::vec3& direction) const;
+    //!  Find the triangle of bvh (built in model space) under a pixel, e.g. the mouse position
+    bool pick(const QPointF& pixel, const TriangleBvh& bvh, RayHit& hit) const;
+    //!  GPU times of the parts of a frame, create it in initializeGL (See \class GpuProfiler)
+    GpuProfiler mGpuProfiler;
 
 protected slots:
     //!  To handle an incoming OpenGL errors
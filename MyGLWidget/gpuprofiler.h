@@ -0,0 +1,112 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <QString>
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+//! Times zones of the GPU work of each frame, without ever waiting for the GPU
+/*!
+  Each zone puts a GL_TIMESTAMP query where it starts and another one where
+  it ends. The queries of a frame are only read FRAMES frames later, when
+  the GPU is long done with them, so asking for their results never stalls
+  the CPU. If they are not there yet the frame is dropped (See dropped).
+
+  The zones are told apart by their name (a string that outlives the
+  profiler, usually a literal) and an index, e.g. one zone per mesh. They
+  can be nested. Each one keeps the average of its last WINDOW frames. A
+  frame can have any number of zones, the queries are created as needed.
+
+  Create it with the context current, call beginFrame before the work of
+  each frame, and time its parts with a \class GpuZone.
+*/
+class GpuProfiler {
+public:
+    static const int FRAMES = 4;
+    //! Zones that each frame has queries for at first, it gets more when it needs them
+    static const int INITIAL_ZONES = 64;
+    //! Frames in the rolling average
+    static const int WINDOW = 64;
+    GpuProfiler();
+    //! Create the queries, with the context current
+    bool create(QOpenGLFunctions_4_5_Core* gl);
+    void destroy();
+    bool isCreated() const;
+    //! Read the oldest frame in flight, and reuse its queries for this one
+    void beginFrame();
+    //! Start a zone, returns the slot to end it with (-1 if the profiler is not created)
+    int beginZone(const char* name, int index = -1);
+    void endZone(int slot);
+    //! Zones that have been started, their times arrive FRAMES frames later
+    int zoneCount() const;
+    //! The name, followed by the index if it has one
+    QString zoneName(int zone) const;
+    //! Average of the last frames, in milliseconds
+    double average(int zone) const;
+    //! Time of the last frame read, in milliseconds
+    double last(int zone) const;
+    //! Frames whose queries were not ready when they were read
+    int dropped() const;
+    //! One line per zone, with its average and last time
+    QString report() const;
+
+private:
+    struct ZoneStats {
+        const char* name;
+        int index;
+        double samples[WINDOW];
+        int count;
+        int next;
+        double sum;
+    };
+    struct FrameZone {
+        int zone;
+        bool ended;
+    };
+    struct Frame {
+        std::vector<FrameZone> zones;
+        //! Two per zone slot
+        std::vector<GLuint> queries;
+        //! The query issued last, all the others are ready when it is
+        int lastQuery;
+    };
+    //! A zone is its name (compared by its characters) and index
+    struct ZoneKey {
+        const char* name;
+        int index;
+        bool operator<(const ZoneKey& other) const {
+            return index != other.index ? index < other.index : std::strcmp(name, other.name) < 0;
+        }
+    };
+    int findZone(const char* name, int index);
+    //! Create queries for count more zones
+    void addQueries(Frame& frame, size_t count);
+    void collect(Frame& frame);
+    QOpenGLFunctions_4_5_Core* mGL;
+    Frame mFrames[FRAMES];
+    int mFrame;
+    std::vector<ZoneStats> mZones;
+    std::map<ZoneKey, int> mZoneIds;
+    int mDropped;
+};
+
+//! Times the GPU work from its construction to its destruction (See \class GpuProfiler)
+class GpuZone {
+public:
+    GpuZone(GpuProfiler& profiler, const char* name, int index = -1) : mProfiler(profiler),
+        mSlot(profiler.beginZone(name, index)) {}
+    ~GpuZone() {
+        mProfiler.endZone(mSlot);
+    }
+    GpuZone(const GpuZone&) = delete;
+    GpuZone& operator=(const GpuZone&) = delete;
+
+private:
+    GpuProfiler& mProfiler;
+    int mSlot;
+};
+
+#endif // GPUPROFILER_H
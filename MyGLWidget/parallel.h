@@ -0,0 +1,107 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//! Helpers to split CPU side geometry work across all the cores.
+/*!
+  The \class Mesh and \class Model classes use them for the passes that
+  touch every vertex or every triangle. They only depend on the standard
+  library, so (as the rest of the loader code) they know nothing about
+  OpenGL or the GPU.
+*/
+namespace parallel {
+
+//! Number of worker threads that the helpers will use (at least one)
+inline unsigned int workerCount() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+//! Number of chunks in which a range of count elements will be split
+/*!
+  A range is never split in chunks smaller than minChunk elements, so small
+  meshes are still processed in the calling thread without any overhead.
+*/
+inline unsigned int chunkCount(size_t count, size_t minChunk = 16384) {
+    size_t chunks = count / std::max<size_t>(minChunk, 1);
+    chunks = std::min<size_t>(chunks, workerCount());
+    return static_cast<unsigned int>(std::max<size_t>(chunks, 1));
+}
+
+//! Call f(chunk, begin, end) over the range [0, count) split in chunks
+/*!
+  The chunks are contiguous and ordered. So chunk c always covers elements
+  before chunk c + 1, this is what makes the per chunk reductions of the
+  callers deterministic. The call blocks until all the chunks are done.
+*/
+template <typename Function>
+void forChunks(size_t count, unsigned int chunks, Function f) {
+    if (chunks <= 1) {
+        f(0u, size_t(0), count);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    size_t step = (count + chunks - 1) / chunks;
+    for (unsigned int c = 1; c < chunks; ++c) {
+        size_t begin = std::min(count, c * step);
+        size_t end = std::min(count, begin + step);
+        workers.emplace_back(f, c, begin, end);
+    }
+    //The calling thread does its share of the work too
+    f(0u, size_t(0), std::min(count, step));
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+//! Call f(begin, end) over the range [0, count) using all the cores
+template <typename Function>
+void forRange(size_t count, Function f, size_t minChunk = 16384) {
+    forChunks(count, chunkCount(count, minChunk),
+              [&f](unsigned int, size_t begin, size_t end) {
+        f(begin, end);
+    });
+}
+
+//! Sort [first, last) sorting chunks concurrently and then merging them
+/*!
+  Same result as std::sort for a strict weak ordering that has no ties
+  (callers break ties with the element position to keep it deterministic).
+*/
+template <typename Iterator, typename Compare>
+void sort(Iterator first, Iterator last, Compare comp, size_t minChunk = 65536) {
+    size_t count = static_cast<size_t>(last - first);
+    unsigned int chunks = chunkCount(count, minChunk);
+    if (chunks <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+    size_t step = (count + chunks - 1) / chunks;
+    forChunks(count, chunks, [&](unsigned int, size_t begin, size_t end) {
+        std::sort(first + begin, first + end, comp);
+    });
+    //Merge neighbour runs until there is a single one
+    for (size_t width = step; width < count; width *= 2) {
+        size_t pairs = (count + 2 * width - 1) / (2 * width);
+        unsigned int merges = static_cast<unsigned int>(std::min<size_t>(pairs, workerCount()));
+        forChunks(pairs, merges, [&](unsigned int, size_t begin, size_t end) {
+            for (size_t p = begin; p < end; ++p) {
+                size_t b = p * 2 * width;
+                size_t m = std::min(count, b + width);
+                size_t e = std::min(count, b + 2 * width);
+                if (m < e) {
+                    std::inplace_merge(first + b, first + m, first + e, comp);
+                }
+            }
+        });
+    }
+}
+
+} // namespace parallel
+
+#endif // PARALLEL_H
@@ -0,0 +1,59 @@
+#ifndef STRIDEDVIEW_H
+#define STRIDEDVIEW_H
+
+#include <cstddef>
+#include <type_traits>
+
+//! A non owning view of count elements of type T placed every stride bytes.
+/*!
+  It lets the same loop walk an attribute in an interleaved array (where the
+  stride is the size of the whole vertex) or in a separated stream (where the
+  stride is the size of the attribute). Use a const T for read only views.
+*/
+template <typename T>
+class StridedView {
+    typedef typename std::conditional<std::is_const<T>::value, const char, char>::type Byte;
+
+public:
+    //! An empthy view
+    StridedView() : mFirst(nullptr), mCount(0), mStride(sizeof(T)) {}
+    //! A view of count elements, the first one at first
+    StridedView(T* first, size_t count, size_t stride = sizeof(T)) :
+        mFirst(first), mCount(count), mStride(stride) {}
+    //! A mutable view can always be used as a read only one
+    operator StridedView<const T>() const {
+        return StridedView<const T>(mFirst, mCount, mStride);
+    }
+    //! Access the i-th element (no bounds checking)
+    T& operator[](size_t i) const {
+        return *reinterpret_cast<T*>(reinterpret_cast<Byte*>(mFirst) + i * mStride);
+    }
+    //! The view of count elements starting at the first-th element
+    StridedView slice(size_t first, size_t count) const {
+        return StridedView(reinterpret_cast<T*>(reinterpret_cast<Byte*>(mFirst) + first * mStride),
+                           count, mStride);
+    }
+    //! Number of elements in the view
+    size_t size() const {
+        return mCount;
+    }
+    //! Queries if the view has no elements
+    bool empty() const {
+        return mCount == 0;
+    }
+    //! Distance in bytes between two consecutive elements
+    size_t stride() const {
+        return mStride;
+    }
+    //! Queries if the elements are packed one after the other
+    bool contiguous() const {
+        return mStride == sizeof(T);
+    }
+
+private:
+    T* mFirst;
+    size_t mCount;
+    size_t mStride;
+};
+
+#endif // STRIDEDVIEW_H
@@ -0,0 +1,417 @@
+#include "trianglebvh.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+using glm::vec2;
+using glm::vec3;
+
+namespace {
+//Candidate split planes per axis
+const int BIN_COUNT = 16;
+//A node with more triangles is always split, even if the SAH says otherwise
+const unsigned int MAX_LEAF_SIZE = 8;
+//Triangles tested at the same time by the leaf kernel
+const unsigned int PACKET_SIZE = 4;
+//Cost of visiting a node, relative to testing a triangle
+const float TRAVERSAL_COST = 1.0f;
+//Nodes with less triangles are binned in the calling thread
+const size_t PARALLEL_BINNING = 65536;
+//Deeper than any tree that the SAH builds in practice, a deeper one uses the heap
+const unsigned int STACK_SIZE = 128;
+
+struct Bounds {
+    vec3 lower;
+    vec3 upper;
+    Bounds() : lower(FLT_MAX), upper(-FLT_MAX) {}
+    void grow(const vec3& p) {
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+    void grow(const Bounds& other) {
+        lower = glm::min(lower, other.lower);
+        upper = glm::max(upper, other.upper);
+    }
+    float area() const {
+        vec3 size = upper - lower;
+        if (size.x < 0.0f) {
+            return 0.0f;
+        }
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+};
+
+struct Bin {
+    Bounds bounds;
+    unsigned int count;
+    Bin() : count(0) {}
+};
+
+//Bounds of the triangles and of their centroids
+struct RangeBounds {
+    Bounds triangles;
+    Bounds centroids;
+};
+
+struct BuildTask {
+    size_t node;
+    size_t begin;
+    size_t end;
+    //Inner nodes above this one
+    unsigned int depth;
+};
+
+unsigned int readIndex(const void* indices, size_t indexSize, size_t i) {
+    if (indexSize == sizeof(uint16_t)) {
+        uint16_t index;
+        std::memcpy(&index, static_cast<const unsigned char*>(indices) + i * indexSize, sizeof(index));
+        return index;
+    }
+    uint32_t index;
+    std::memcpy(&index, static_cast<const unsigned char*>(indices) + i * indexSize, sizeof(index));
+    return index;
+}
+
+int binOf(float centroid, float lower, float scale) {
+    return std::min(BIN_COUNT - 1, std::max(0, int((centroid - lower) * scale)));
+}
+
+//Distance where the ray enters the box, or FLT_MAX if it misses it before maxDistance
+float enterBox(const vec3& lower, const vec3& upper, const vec3& origin, const vec3& inverse, float maxDistance) {
+    vec3 t0 = (lower - origin) * inverse;
+    vec3 t1 = (upper - origin) * inverse;
+    vec3 lowest = glm::min(t0, t1);
+    vec3 highest = glm::max(t0, t1);
+    float enter = glm::max(glm::max(lowest.x, lowest.y), glm::max(lowest.z, 0.0f));
+    float exit = glm::min(glm::min(highest.x, highest.y), glm::min(highest.z, maxDistance));
+    return enter <= exit ? enter : FLT_MAX;
+}
+}
+
+TriangleBvh::TriangleBvh() : mDepth(0) {
+}
+
+void TriangleBvh::clear() {
+    mNodes.clear();
+    mPositions.clear();
+    mTriangles.clear();
+    mMeshIds.clear();
+    mTriangleIds.clear();
+    mDepth = 0;
+}
+
+bool TriangleBvh::empty() const {
+    return mNodes.empty();
+}
+
+size_t TriangleBvh::triangleCount() const {
+    return mMeshIds.size();
+}
+
+size_t TriangleBvh::nodeCount() const {
+    return mNodes.size();
+}
+
+size_t TriangleBvh::bytes() const {
+    return mNodes.size() * sizeof(Node) + mPositions.size() * sizeof(vec3) +
+           mTriangles.size() * sizeof(unsigned int) + mMeshIds.size() * sizeof(int) +
+           mTriangleIds.size() * sizeof(unsigned int);
+}
+
+void TriangleBvh::build(StridedView<const vec3> positions, const std::vector<BvhMesh>& meshes) {
+    clear();
+    mPositions.resize(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        mPositions[i] = positions[i];
+    }
+    //Gather the triangles of all the meshes (the ones out of the positions are skipped)
+    std::vector<unsigned int> triangles;
+    std::vector<int> meshIds;
+    std::vector<unsigned int> triangleIds;
+    size_t capacity = 0;
+    for (const BvhMesh& mesh : meshes) {
+        capacity += mesh.indexCount / 3;
+    }
+    triangles.reserve(3 * capacity);
+    meshIds.reserve(capacity);
+    triangleIds.reserve(capacity);
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        const BvhMesh& mesh = meshes[m];
+        for (size_t t = 0; t + 2 < mesh.indexCount; t += 3) {
+            unsigned int v[3];
+            bool inside = true;
+            for (size_t c = 0; c < 3; ++c) {
+                v[c] = static_cast<unsigned int>(mesh.baseVertex + readIndex(mesh.indices, mesh.indexSize, t + c));
+                inside = inside && v[c] < mPositions.size();
+            }
+            if (inside) {
+                triangles.insert(triangles.end(), v, v + 3);
+                meshIds.push_back(static_cast<int>(m));
+                triangleIds.push_back(static_cast<unsigned int>(t / 3));
+            }
+        }
+    }
+    const size_t count = meshIds.size();
+    if (count == 0) {
+        return;
+    }
+    std::vector<Bounds> bounds(count);
+    std::vector<vec3> centroids(count);
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            for (size_t c = 0; c < 3; ++c) {
+                bounds[t].grow(mPositions[triangles[3 * t + c]]);
+            }
+            centroids[t] = 0.5f * (bounds[t].lower + bounds[t].upper);
+        }
+    });
+    std::vector<unsigned int> order(count);
+    std::iota(order.begin(), order.end(), 0u);
+
+    mNodes.reserve(2 * count);
+    mNodes.push_back(Node());
+    std::vector<BuildTask> tasks(1, BuildTask{0, 0, count, 0});
+    std::vector<RangeBounds> chunkBounds;
+    std::vector<Bin> chunkBins;
+    while (!tasks.empty()) {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+        const size_t n = task.end - task.begin;
+        //Most nodes are small, those skip asking for the number of cores
+        const unsigned int chunks = n >= 2 * PARALLEL_BINNING ? parallel::chunkCount(n, PARALLEL_BINNING) : 1u;
+
+        //Bounds of the node and of the centroids of its triangles
+        chunkBounds.assign(chunks, RangeBounds());
+        parallel::forChunks(n, chunks, [&](unsigned int chunk, size_t begin, size_t end) {
+            RangeBounds& b = chunkBounds[chunk];
+            for (size_t i = task.begin + begin; i < task.begin + end; ++i) {
+                b.triangles.grow(bounds[order[i]]);
+                b.centroids.grow(centroids[order[i]]);
+            }
+        });
+        RangeBounds range;
+        for (const RangeBounds& b : chunkBounds) {
+            range.triangles.grow(b.triangles);
+            range.centroids.grow(b.centroids);
+        }
+        mNodes[task.node].lower = range.triangles.lower;
+        mNodes[task.node].upper = range.triangles.upper;
+        mNodes[task.node].first = static_cast<unsigned int>(task.begin);
+        mNodes[task.node].count = static_cast<unsigned int>(n);
+        mDepth = std::max(mDepth, task.depth);
+        if (n <= 2) {
+            continue;
+        }
+
+        //Count the triangles (by centroid) of each bin of each axis
+        const vec3 extent = range.centroids.upper - range.centroids.lower;
+        vec3 scale(0.0f);
+        for (int axis = 0; axis < 3; ++axis) {
+            scale[axis] = extent[axis] > 0.0f ? float(BIN_COUNT) / extent[axis] : 0.0f;
+        }
+        chunkBins.assign(size_t(chunks) * 3 * BIN_COUNT, Bin());
+        parallel::forChunks(n, chunks, [&](unsigned int chunk, size_t begin, size_t end) {
+            Bin* bins = chunkBins.data() + size_t(chunk) * 3 * BIN_COUNT;
+            for (size_t i = task.begin + begin; i < task.begin + end; ++i) {
+                unsigned int t = order[i];
+                for (int axis = 0; axis < 3; ++axis) {
+                    Bin& bin = bins[axis * BIN_COUNT + binOf(centroids[t][axis], range.centroids.lower[axis], scale[axis])];
+                    bin.bounds.grow(bounds[t]);
+                    ++bin.count;
+                }
+            }
+        });
+        for (unsigned int chunk = 1; chunk < chunks; ++chunk) {
+            for (int b = 0; b < 3 * BIN_COUNT; ++b) {
+                chunkBins[size_t(b)].bounds.grow(chunkBins[size_t(chunk) * 3 * BIN_COUNT + size_t(b)].bounds);
+                chunkBins[size_t(b)].count += chunkBins[size_t(chunk) * 3 * BIN_COUNT + size_t(b)].count;
+            }
+        }
+
+        //Sweep the planes between bins: the left side from the left, the right from the right
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestBin = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (scale[axis] == 0.0f) {
+                continue;
+            }
+            const Bin* bins = chunkBins.data() + axis * BIN_COUNT;
+            float rightCost[BIN_COUNT];
+            Bounds right;
+            unsigned int rightCount = 0;
+            for (int b = BIN_COUNT - 1; b > 0; --b) {
+                right.grow(bins[b].bounds);
+                rightCount += bins[b].count;
+                rightCost[b] = right.area() * float(rightCount);
+            }
+            Bounds left;
+            unsigned int leftCount = 0;
+            for (int b = 0; b < BIN_COUNT - 1; ++b) {
+                left.grow(bins[b].bounds);
+                leftCount += bins[b].count;
+                float cost = left.area() * float(leftCount) + rightCost[b + 1];
+                if (leftCount > 0 && leftCount < n && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+        const float area = range.triangles.area();
+        const float splitCost = TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+        if (n <= MAX_LEAF_SIZE && (bestAxis < 0 || splitCost >= float(n))) {
+            continue;
+        }
+
+        size_t middle = task.begin + n / 2;
+        if (bestAxis >= 0) {
+            const int axis = bestAxis;
+            const float lower = range.centroids.lower[axis];
+            const float s = scale[axis];
+            middle = size_t(std::partition(order.begin() + long(task.begin), order.begin() + long(task.end),
+                                           [&](unsigned int t) {
+                return binOf(centroids[t][axis], lower, s) <= bestBin;
+            }) - order.begin());
+        }
+        const size_t children = mNodes.size();
+        mNodes[task.node].first = static_cast<unsigned int>(children);
+        mNodes[task.node].count = 0;
+        mNodes.push_back(Node());
+        mNodes.push_back(Node());
+        tasks.push_back(BuildTask{children + 1, middle, task.end, task.depth + 1});
+        tasks.push_back(BuildTask{children, task.begin, middle, task.depth + 1});
+    }
+
+    //The triangles in the order of the leaves
+    mTriangles.resize(triangles.size());
+    mMeshIds.resize(count);
+    mTriangleIds.resize(count);
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned int t = order[i];
+            for (size_t c = 0; c < 3; ++c) {
+                mTriangles[3 * i + c] = triangles[3 * t + c];
+            }
+            mMeshIds[i] = meshIds[t];
+            mTriangleIds[i] = triangleIds[t];
+        }
+    });
+}
+
+bool TriangleBvh::intersect(const vec3& origin, const vec3& direction, RayHit& hit, float maxDistance) const {
+    float length = glm::length(direction);
+    if (mNodes.empty() || length == 0.0f) {
+        return false;
+    }
+    const vec3 d = direction / length;
+    const vec3 inverse(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+    float best = maxDistance;
+    size_t bestTriangle = 0;
+    vec2 bestBarycentric(0.0f);
+    bool found = false;
+
+    //Each lane of the kernel, one triangle
+    float v0[3][PACKET_SIZE];
+    float e1[3][PACKET_SIZE];
+    float e2[3][PACKET_SIZE];
+    float t[PACKET_SIZE];
+    float u[PACKET_SIZE];
+    float v[PACKET_SIZE];
+    const float o[3] = {origin.x, origin.y, origin.z};
+    const float dir[3] = {d.x, d.y, d.z};
+
+    //At most one node waits per level, so a tree deeper than the stack would drop some
+    unsigned int localStack[STACK_SIZE];
+    std::vector<unsigned int> deepStack;
+    unsigned int* stack = localStack;
+    if (mDepth > STACK_SIZE) {
+        deepStack.resize(mDepth);
+        stack = deepStack.data();
+    }
+    unsigned int stackSize = 0;
+    unsigned int node = 0;
+    if (enterBox(mNodes[0].lower, mNodes[0].upper, origin, inverse, best) == FLT_MAX) {
+        return false;
+    }
+    while (true) {
+        const Node& current = mNodes[node];
+        if (current.count > 0) {
+            for (unsigned int first = current.first; first < current.first + current.count; first += PACKET_SIZE) {
+                unsigned int lanes = std::min(PACKET_SIZE, current.first + current.count - first);
+                //Gather the packet, the missing lanes are degenerate triangles
+                for (unsigned int k = 0; k < PACKET_SIZE; ++k) {
+                    const unsigned int* triangle = mTriangles.data() + 3 * size_t(first + std::min(k, lanes - 1));
+                    const vec3& p0 = mPositions[triangle[0]];
+                    vec3 a = mPositions[triangle[1]] - p0;
+                    vec3 b = mPositions[triangle[2]] - p0;
+                    float valid = k < lanes ? 1.0f : 0.0f;
+                    for (int c = 0; c < 3; ++c) {
+                        v0[c][k] = p0[c];
+                        e1[c][k] = valid * a[c];
+                        e2[c][k] = valid * b[c];
+                    }
+                }
+                //Moller and Trumbore, in every lane at the same time
+                for (unsigned int k = 0; k < PACKET_SIZE; ++k) {
+                    float px = dir[1] * e2[2][k] - dir[2] * e2[1][k];
+                    float py = dir[2] * e2[0][k] - dir[0] * e2[2][k];
+                    float pz = dir[0] * e2[1][k] - dir[1] * e2[0][k];
+                    float det = e1[0][k] * px + e1[1][k] * py + e1[2][k] * pz;
+                    float inverseDet = det != 0.0f ? 1.0f / det : 0.0f;
+                    float sx = o[0] - v0[0][k];
+                    float sy = o[1] - v0[1][k];
+                    float sz = o[2] - v0[2][k];
+                    u[k] = (sx * px + sy * py + sz * pz) * inverseDet;
+                    float qx = sy * e1[2][k] - sz * e1[1][k];
+                    float qy = sz * e1[0][k] - sx * e1[2][k];
+                    float qz = sx * e1[1][k] - sy * e1[0][k];
+                    v[k] = (dir[0] * qx + dir[1] * qy + dir[2] * qz) * inverseDet;
+                    t[k] = (e2[0][k] * qx + e2[1][k] * qy + e2[2][k] * qz) * inverseDet;
+                }
+                for (unsigned int k = 0; k < lanes; ++k) {
+                    if (u[k] >= 0.0f && v[k] >= 0.0f && u[k] + v[k] <= 1.0f && t[k] > 0.0f && t[k] < best) {
+                        best = t[k];
+                        bestTriangle = first + k;
+                        bestBarycentric = vec2(u[k], v[k]);
+                        found = true;
+                    }
+                }
+            }
+        } else {
+            //Visit the nearest child first, and the other one later if it can still be closer
+            unsigned int first = current.first;
+            unsigned int second = current.first + 1;
+            float firstEnter = enterBox(mNodes[first].lower, mNodes[first].upper, origin, inverse, best);
+            float secondEnter = enterBox(mNodes[second].lower, mNodes[second].upper, origin, inverse, best);
+            if (secondEnter < firstEnter) {
+                std::swap(first, second);
+                std::swap(firstEnter, secondEnter);
+            }
+            if (firstEnter != FLT_MAX) {
+                if (secondEnter != FLT_MAX) {
+                    stack[stackSize++] = second;
+                }
+                node = first;
+                continue;
+            }
+        }
+        if (stackSize == 0) {
+            break;
+        }
+        node = stack[--stackSize];
+    }
+    if (!found) {
+        return false;
+    }
+    hit.distance = best;
+    hit.position = origin + best * d;
+    hit.barycentric = bestBarycentric;
+    hit.mesh = mMeshIds[bestTriangle];
+    hit.triangle = mTriangleIds[bestTriangle];
+    return true;
+}
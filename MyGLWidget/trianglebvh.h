@@ -0,0 +1,87 @@
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+#include <cfloat>
+#include <vector>
+#include <glm/glm.hpp>
+#include "stridedview.h"
+
+//! The triangles of a mesh, as they are given to \class TriangleBvh build
+/*!
+  The indices can be 16 or 32 bits (indexSize 2 or 4), so a packed index
+  buffer can be used as it is. They are relative to baseVertex.
+*/
+struct BvhMesh {
+    const void* indices;
+    size_t indexCount;
+    size_t indexSize;
+    size_t baseVertex;
+};
+
+//! The closest triangle that a ray hits
+struct RayHit {
+    //! Distance along the (normalized) direction of the ray
+    float distance;
+    //! Where the ray hits, in the space of the positions of the \class TriangleBvh
+    glm::vec3 position;
+    //! Barycentric coordinates of the hit, of the second and third vertex
+    glm::vec2 barycentric;
+    //! Index of the mesh (as given to build), e.g. of its \struct MeshData
+    int mesh;
+    //! Index of the triangle inside its mesh: its indices start at 3 * triangle
+    unsigned int triangle;
+    RayHit() : distance(FLT_MAX), position(0.0f), barycentric(0.0f), mesh(-1), triangle(0) {}
+};
+
+//! A bounding volume hierarchy over the triangles of one or several meshes, to trace rays.
+/*!
+  It is built with the surface area heuristic (SAH): the triangles of each
+  node are split by the plane (among 16 per axis) that minimizes the
+  expected cost of a ray, which is proportional to the area of each child
+  times its number of triangles. The leaves have a few triangles, and a ray
+  tests them four at a time: the kernel works on arrays of 4 lanes, that
+  the compiler turns into SIMD code without any platform intrinsics (the
+  templates build with GLM_FORCE_PURE).
+
+  It keeps its own copy of the positions, so the geometry can be released
+  (e.g. after uploading it to the GPU) and the BVH still be used to pick.
+*/
+class TriangleBvh {
+public:
+    TriangleBvh();
+    //! Build over the triangles of meshes, whose vertices are in positions
+    void build(StridedView<const glm::vec3> positions, const std::vector<BvhMesh>& meshes);
+    void clear();
+    bool empty() const;
+    size_t triangleCount() const;
+    size_t nodeCount() const;
+    //! Memmory that its arrays take
+    size_t bytes() const;
+    //! Find the closest triangle that the ray hits, closer than maxDistance
+    /*!
+      The direction does not need to be normalized. Back facing triangles are
+      also hit. Returns false (and hit is not modified) if there is none.
+    */
+    bool intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit,
+                   float maxDistance = FLT_MAX) const;
+
+private:
+    //! A leaf if count > 0: its triangles are [first, first + count). Otherwise its children are first and first + 1
+    struct Node {
+        glm::vec3 lower;
+        unsigned int first;
+        glm::vec3 upper;
+        unsigned int count;
+    };
+    std::vector<Node> mNodes;
+    std::vector<glm::vec3> mPositions;
+    //! Three indices in mPositions per triangle, in the order of the leaves
+    std::vector<unsigned int> mTriangles;
+    //! Mesh and triangle inside the mesh of each triangle, in the order of the leaves
+    std::vector<int> mMeshIds;
+    std::vector<unsigned int> mTriangleIds;
+    //! Inner nodes above the deepest leaf, the nodes that a ray may leave for later
+    unsigned int mDepth;
+};
+
+#endif // TRIANGLEBVH_H
@@ -10,6 +10,7 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = MyGLWindow
 TEMPLATE = app
+CONFIG += c++14
 
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which has been marked as deprecated (the exact warnings
@@ -22,6 +23,9 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Record the zones of the CPU profiler (See cpuprofiler.h). Without it they compile to nothing
+DEFINES += CPU_PROFILER
+
 
 SOURCES += \
     main.cpp \
@@ -29,17 +33,59 @@ SOURCES += \
     mesh.cpp \
     trackball.cpp \
     baseGLwindow.cpp \
-    model.cpp
+    model.cpp \
+    vertexwelder.cpp \
+    normalgenerator.cpp \
+    geometrykernels.cpp \
+    geometrycache.cpp \
+    vertexcacheoptimizer.cpp \
+    overdrawoptimizer.cpp \
+    vertexquantizer.cpp \
+    meshsimplifier.cpp \
+    meshletbuilder.cpp \
+    trianglebvh.cpp \
+    assetmanager.cpp \
+    textureregistry.cpp \
+    textureatlas.cpp \
+    indirectdrawlist.cpp \
+    renderqueue.cpp \
+    framering.cpp \
+    gpuprofiler.cpp \
+    cpuprofiler.cpp
 
 HEADERS += \
     meshload.h \
     baseGLwindow.h \
     mesh.h \
     trackball.h \
-    model.h
+    model.h \
+    parallel.h \
+    vertexwelder.h \
+    normalgenerator.h \
+    stridedview.h \
+    geometrykernels.h \
+    arrayview.h \
+    geometrycache.h \
+    vertexcacheoptimizer.h \
+    overdrawoptimizer.h \
+    vertexquantizer.h \
+    meshsimplifier.h \
+    meshletbuilder.h \
+    trianglebvh.h \
+    assetmanager.h \
+    textureregistry.h \
+    textureatlas.h \
+    indirectdrawlist.h \
+    renderqueue.h \
+    framering.h \
+    gpuprofiler.h \
+    cpuprofiler.h
 
 DISTFILES += \
     shaders/phongTexture.frag \
+    shaders/phongTextureArray.frag \
+    shaders/phongTextureIndirect.frag \
+    shaders/texturedVertexIndirect.vert \
     shaders/texturedVertex.vert
 
 INCLUDEPATH += \
@@ -0,0 +1,56 @@
+#ifndef ARRAYVIEW_H
+#define ARRAYVIEW_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+//! A non owning view of count contiguous elements of type T.
+/*!
+  It lets a class give access to its arrays without copying them, e.g. to
+  pass them straight to QOpenGLBuffer::allocate. As any view, it is only valid
+  while the array that it looks at is alive and not resized.
+*/
+template <typename T>
+class ArrayView {
+public:
+    //! An empthy view
+    ArrayView() : mData(nullptr), mCount(0) {}
+    //! A view of count elements, the first one at data
+    ArrayView(T* data, size_t count) : mData(data), mCount(count) {}
+    //! A read only view of all the elements of a vector
+    ArrayView(const std::vector<typename std::remove_const<T>::type>& vector) :
+        mData(vector.data()), mCount(vector.size()) {}
+    //! Pointer to the first element
+    T* data() const {
+        return mData;
+    }
+    //! Number of elements in the view
+    size_t size() const {
+        return mCount;
+    }
+    //! Size of all the elements in bytes
+    size_t sizeInBytes() const {
+        return mCount * sizeof(T);
+    }
+    //! Queries if the view has no elements
+    bool empty() const {
+        return mCount == 0;
+    }
+    //! Access the i-th element (no bounds checking)
+    T& operator[](size_t i) const {
+        return mData[i];
+    }
+    T* begin() const {
+        return mData;
+    }
+    T* end() const {
+        return mData + mCount;
+    }
+
+private:
+    T* mData;
+    size_t mCount;
+};
+
+#endif // ARRAYVIEW_H
@@ -0,0 +1,271 @@
+#include "assetmanager.h"
+#include "cpuprofiler.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace {
+//Runs a function in the thread pool
+class AssetTask : public QRunnable {
+public:
+    explicit AssetTask(const std::function<void()>& function) : mFunction(function) {}
+    void run() override {
+        mFunction();
+    }
+
+private:
+    std::function<void()> mFunction;
+};
+
+//Swap the rows in place (instead of a mirrored copy), so the first one is the bottom one
+void flipRows(QImage& image) {
+    const size_t bytes = size_t(image.bytesPerLine());
+    std::vector<uchar> row(bytes);
+    for (int top = 0, bottom = image.height() - 1; top < bottom; ++top, --bottom) {
+        uchar* topRow = image.scanLine(top);
+        uchar* bottomRow = image.scanLine(bottom);
+        std::memcpy(row.data(), topRow, bytes);
+        std::memcpy(topRow, bottomRow, bytes);
+        std::memcpy(bottomRow, row.data(), bytes);
+    }
+}
+
+//Hash of everything that ends up in the texture. Only the visible bytes of each row, not the padding
+QByteArray contentHash(const QImage& image) {
+    PROFILE_ZONE("hash image");
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const int header[] = {image.width(), image.height(), int(image.format())};
+    hash.addData(reinterpret_cast<const char*>(header), int(sizeof(header)));
+    const int rowBytes = image.width() * image.depth() / 8;
+    for (int row = 0; row < image.height(); ++row) {
+        hash.addData(reinterpret_cast<const char*>(image.constScanLine(row)), rowBytes);
+    }
+    return hash.result();
+}
+}
+
+AssetEntry::AssetEntry(const QString& path) : mPath(path), mState(LOADING), mBytes(0) {
+}
+
+AssetEntry::~AssetEntry() {
+}
+
+const QString& AssetEntry::path() const {
+    return mPath;
+}
+
+AssetEntry::State AssetEntry::state() const {
+    return State(mState.load());
+}
+
+void AssetEntry::wait() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mState.load() != LOADING; });
+}
+
+size_t AssetEntry::bytes() const {
+    return mBytes;
+}
+
+void AssetEntry::finish(bool ok, size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBytes = ok ? bytes : 0;
+        mState = ok ? READY : FAILED;
+    }
+    mDone.notify_all();
+}
+
+bool loadAsset(const QString& path, ModelGeometry& geometry) {
+    PROFILE_ZONE("load model");
+    GeometryCache cache;
+    return geometry.load(path, cache);
+}
+
+bool loadAsset(const QString& path, DecodedImage& decoded) {
+    PROFILE_ZONE("decode image");
+    QImage image(path);
+    if (image.isNull()) {
+        return false;
+    }
+    //Already in the format that QOpenGLTexture uploads, so it does not convert it in the OpenGL thread.
+    //The usual 32 bits images are converted in place
+    image = std::move(image).convertToFormat(QImage::Format_RGBA8888);
+    flipRows(image);
+    //While it is still in the worker, much cheaper than the decoding
+    decoded.contentHash = contentHash(image);
+    decoded.image = std::move(image);
+    return true;
+}
+
+bool loadAsset(const QString& path, TriangleBvh& bvh) {
+    //Its own geometry, never waiting for a model task of the pool (they may be queued behind this one).
+    //Once the model is loaded it is a hit of the cache, just a mapping
+    ModelGeometry geometry;
+    {
+        PROFILE_ZONE("load model");
+        GeometryCache cache;
+        if (!geometry.load(path, cache)) {
+            return false;
+        }
+    }
+    PROFILE_ZONE("build bvh");
+    auto start = std::chrono::steady_clock::now();
+    //The packed indices are used as they are, with the type of each mesh
+    ArrayView<const MeshData> separators = geometry.separators();
+    const unsigned char* indexData = geometry.indexData().data();
+    std::vector<BvhMesh> meshes(separators.size());
+    for (size_t i = 0; i < separators.size(); ++i) {
+        const MeshData& sep = separators[i];
+        meshes[i].indexSize = sep.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        meshes[i].indices = indexData + size_t(sep.indexOffset);
+        meshes[i].indexCount = size_t(sep.howMany);
+        meshes[i].baseVertex = size_t(sep.startVertex);
+    }
+    ArrayView<const Vertex> vertices = geometry.vertices();
+    bvh.build(StridedView<const glm::vec3>(vertices.size() > 0 ? &vertices.data()->position : nullptr,
+                                           vertices.size(), sizeof(Vertex)), meshes);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    qDebug() << "Picking BVH:" << bvh.triangleCount() << "triangles," << bvh.nodeCount() << "nodes in"
+             << seconds * 1000.0 << "ms";
+    return true;
+}
+
+size_t assetBytes(const ModelGeometry& geometry) {
+    //A mapped entry costs almost nothing to keep, the OS pages it out
+    return geometry.heapBytes();
+}
+
+size_t assetBytes(const TriangleBvh& bvh) {
+    return bvh.bytes();
+}
+
+size_t assetBytes(const DecodedImage& decoded) {
+    return size_t(decoded.image.bytesPerLine()) * size_t(decoded.image.height()) + size_t(decoded.contentHash.size());
+}
+
+AssetManager::AssetManager(size_t budget, QObject* parent) : QObject(parent), mBudget(budget), mBytes(0),
+    mRequested(0), mFinished(0) {
+    mPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+AssetManager::~AssetManager() {
+    mPool.waitForDone();
+}
+
+AssetManager& AssetManager::instance() {
+    static AssetManager manager;
+    return manager;
+}
+
+AssetHandle<ModelGeometry> AssetManager::loadModel(const QString& path) {
+    return request<ModelGeometry>("model:", path);
+}
+
+AssetHandle<DecodedImage> AssetManager::loadImage(const QString& path) {
+    return request<DecodedImage>("image:", path);
+}
+
+AssetHandle<TriangleBvh> AssetManager::loadBvh(const QString& path) {
+    return request<TriangleBvh>("bvh:", path);
+}
+
+template <typename T>
+AssetHandle<T> AssetManager::request(const QString& kind, const QString& path) {
+    //The same file can be asked for by different relative paths
+    QFileInfo file(path);
+    const QString key = kind + (file.exists() ? file.canonicalFilePath() : path);
+    std::shared_ptr<TypedAssetEntry<T>> entry;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto found = mEntries.find(key);
+        if (found != mEntries.end()) {
+            //Loaded or loading, either way it is now the most recently used
+            mRecent.splice(mRecent.begin(), mRecent, found->second);
+            return AssetHandle<T>(std::static_pointer_cast<TypedAssetEntry<T>>(found->second->entry));
+        }
+        entry = std::make_shared<TypedAssetEntry<T>>(path);
+        mRecent.push_front(CacheSlot{key, entry});
+        mEntries[key] = mRecent.begin();
+        ++mRequested;
+    }
+    std::shared_ptr<AssetEntry> task = entry;
+    mPool.start(new AssetTask([this, key, task] {
+        size_t bytes = 0;
+        bool ok = task->load(bytes);
+        task->finish(ok, bytes);
+        finished(key, task, ok);
+    }));
+    return AssetHandle<T>(entry);
+}
+
+void AssetManager::finished(const QString& key, const std::shared_ptr<AssetEntry>& entry, bool ok) {
+    int finishedCount;
+    int requestedCount;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mFinished;
+        finishedCount = mFinished;
+        requestedCount = mRequested;
+        if (ok) {
+            mBytes += entry->bytes();
+            evict(mBudget);
+        } else {
+            //Not cached, so asking again tries again
+            auto found = mEntries.find(key);
+            if (found != mEntries.end()) {
+                mRecent.erase(found->second);
+                mEntries.erase(found);
+            }
+        }
+    }
+    if (!ok) {
+        qDebug() << "Unable to load" << entry->path();
+    }
+    emit loaded(entry->path(), ok);
+    emit progress(finishedCount, requestedCount);
+}
+
+void AssetManager::evict(size_t budget) {
+    //Walk the entries from the least recently used one
+    for (auto recent = mRecent.end(); recent != mRecent.begin() && mBytes > budget;) {
+        --recent;
+        const std::shared_ptr<AssetEntry>& entry = recent->entry;
+        //Only if the manager is the only one that has it, and it is not loading
+        if (entry.use_count() > 1 || entry->state() == AssetEntry::LOADING) {
+            continue;
+        }
+        mBytes -= entry->bytes();
+        mEntries.erase(recent->key);
+        recent = mRecent.erase(recent);
+    }
+}
+
+void AssetManager::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBudget = bytes;
+    evict(mBudget);
+}
+
+size_t AssetManager::budget() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBudget;
+}
+
+size_t AssetManager::cachedBytes() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBytes;
+}
+
+void AssetManager::trim() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    evict(0);
+}
@@ -0,0 +1,205 @@
+#ifndef ASSETMANAGER_H
+#define ASSETMANAGER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QImage>
+#include <QThreadPool>
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "geometrycache.h"
+#include "trianglebvh.h"
+
+//! The state of an asset, shared by the \class AssetManager and all the handles to it
+class AssetEntry {
+public:
+    enum State {LOADING, READY, FAILED};
+    explicit AssetEntry(const QString& path);
+    virtual ~AssetEntry();
+    const QString& path() const;
+    State state() const;
+    //! Block until the asset is loaded (or it failed)
+    void wait() const;
+    //! Memmory that the loaded asset takes, what counts for the cache budget
+    size_t bytes() const;
+
+protected:
+    friend class AssetManager;
+    //! Load the asset from mPath, it runs in a worker thread
+    virtual bool load(size_t& bytes) = 0;
+    //! Publish the result and wake up whoever waits for it
+    void finish(bool ok, size_t bytes);
+    QString mPath;
+    std::atomic<int> mState;
+    size_t mBytes;
+    mutable std::mutex mMutex;
+    mutable std::condition_variable mDone;
+};
+
+//! An image decoded for a texture
+struct DecodedImage {
+    QImage image;
+    //! Hash of the size, format and pixels: byte-identical images have the same one
+    QByteArray contentHash;
+};
+
+//! How each type of asset is loaded and measured
+bool loadAsset(const QString& path, ModelGeometry& geometry);
+bool loadAsset(const QString& path, DecodedImage& image);
+bool loadAsset(const QString& path, TriangleBvh& bvh);
+size_t assetBytes(const ModelGeometry& geometry);
+size_t assetBytes(const DecodedImage& image);
+size_t assetBytes(const TriangleBvh& bvh);
+
+//! An entry that holds an asset of type T
+template <typename T>
+class TypedAssetEntry : public AssetEntry {
+public:
+    explicit TypedAssetEntry(const QString& path) : AssetEntry(path) {}
+    //! Only written by the worker, before the entry is READY
+    T mValue;
+
+protected:
+    bool load(size_t& bytes) override {
+        if (!loadAsset(mPath, mValue)) {
+            mValue = T();
+            return false;
+        }
+        bytes = assetBytes(mValue);
+        return true;
+    }
+};
+
+//! A shared reference to an asset, that may still be loading (like a future)
+/*!
+  Handles are cheap to copy. While any handle to an asset is alive, the
+  \class AssetManager keeps it. Once there are none it stays in the cache
+  (so asking for it again is free) until the cache needs the room.
+*/
+template <typename T>
+class AssetHandle {
+public:
+    AssetHandle() {}
+    //! Queries if this handle refers to an asset at all
+    bool isNull() const {
+        return !mEntry;
+    }
+    bool isReady() const {
+        return mEntry && mEntry->state() == AssetEntry::READY;
+    }
+    bool isFailed() const {
+        return mEntry && mEntry->state() == AssetEntry::FAILED;
+    }
+    //! Queries if the load is over, either ready or failed
+    bool isFinished() const {
+        return mEntry && mEntry->state() != AssetEntry::LOADING;
+    }
+    //! Block until the load is over
+    void wait() const {
+        if (mEntry) {
+            mEntry->wait();
+        }
+    }
+    //! The asset, it blocks if it is still loading. If the load failed it is empthy
+    const T& get() const {
+        static const T empthy = T();
+        if (!mEntry) {
+            return empthy;
+        }
+        mEntry->wait();
+        return mEntry->mValue;
+    }
+    QString path() const {
+        return mEntry ? mEntry->path() : QString();
+    }
+
+private:
+    friend class AssetManager;
+    explicit AssetHandle(const std::shared_ptr<TypedAssetEntry<T>>& entry) : mEntry(entry) {}
+    std::shared_ptr<TypedAssetEntry<T>> mEntry;
+};
+
+//! Loads models and images in worker threads, and caches them by path
+/*!
+  Each load returns at once an \class AssetHandle, and the file is read in
+  the thread pool of the manager. Asking again for a path that is loading or
+  already loaded returns a handle to the same asset, so it is read only once
+  even if several windows open it.
+
+  The assets that no handle uses are kept in a least recently used list.
+  They are only dropped when all the cached assets take more than the
+  budget. The images are only decoded: the textures still have to be
+  created in the thread of the OpenGL context.
+
+  The loaded and progress signals are emitted from the worker threads, so
+  connect to them with a receiver (they are queued to its thread).
+*/
+class AssetManager : public QObject {
+    Q_OBJECT
+
+public:
+    static const size_t DEFAULT_BUDGET = size_t(512) << 20;
+    explicit AssetManager(size_t budget = DEFAULT_BUDGET, QObject* parent = nullptr);
+    //! Waits for the loads that are still running
+    ~AssetManager() override;
+    //! The manager that all the windows of the application share
+    static AssetManager& instance();
+    //! The geometry of a model, mapped from the \class GeometryCache (See \class ModelGeometry)
+    AssetHandle<ModelGeometry> loadModel(const QString& path);
+    //! An image for a texture, in RGBA8888 and flipped (in place) since OpenGL starts at the bottom row
+    /*!
+      The worker also hashes its pixels, so equal images that come from
+      different files can share a texture (See \class TextureRegistry).
+    */
+    AssetHandle<DecodedImage> loadImage(const QString& path);
+    //! The picking BVH of the triangles of a model, in model units
+    /*!
+      Building it takes seconds for big models, so it has its own task. The
+      task maps the geometry from the \class GeometryCache itself, so ask for
+      it once the model is loaded, or it imports the file again.
+    */
+    AssetHandle<TriangleBvh> loadBvh(const QString& path);
+    //! Bytes that the unused assets can take before they start to be dropped
+    void setBudget(size_t bytes);
+    size_t budget() const;
+    //! Bytes of all the loaded assets, used or not
+    size_t cachedBytes() const;
+    //! Drop every asset that no handle uses
+    void trim();
+
+signals:
+    //! An asset finished loading, ok is false if it failed
+    void loaded(const QString& path, bool ok);
+    //! How many of the requested loads are over
+    void progress(int finished, int requested);
+
+private:
+    struct CacheSlot {
+        //! Type of asset and canonical path
+        QString key;
+        std::shared_ptr<AssetEntry> entry;
+    };
+    template <typename T>
+    AssetHandle<T> request(const QString& kind, const QString& path);
+    void finished(const QString& key, const std::shared_ptr<AssetEntry>& entry, bool ok);
+    //! Drop unused assets, least recently used first, until the budget is met (with mMutex locked)
+    void evict(size_t budget);
+    QThreadPool mPool;
+    mutable std::mutex mMutex;
+    //! Most recently requested first
+    std::list<CacheSlot> mRecent;
+    std::map<QString, std::list<CacheSlot>::iterator> mEntries;
+    size_t mBudget;
+    size_t mBytes;
+    int mRequested;
+    int mFinished;
+};
+
+#endif // ASSETMANAGER_H
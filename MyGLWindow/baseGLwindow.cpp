@@ -7,7 +7,7 @@
 // Give default values for: the perspective projection parameters
 // the log level is in only errors and the rich text is disabled
 BaseGLWindow::BaseGLWindow() : mRichText(false), mLogLevel(0), mFovY(60.0f), mNear(0.1f),
-mFar(1000.0f), mScreenShoots(0){
+mFar(1000.0f), mScreenShoots(0), mTraces(0){
 
 }
 
@@ -196,13 +196,13 @@ QString BaseGLWindow::versionInfo() {
             "." + QString::number(GLM_VERSION % 100 / 10) +
             "." + QString::number(GLM_VERSION % 10);
     // Get OpenGL version Information form the actual current context
-    QString glType{(context()->isOpenGLES()) ? "OpenGL ES" : "OpenGL (Desktop)"};
+    QString glType{(glContext()->isOpenGLES()) ? "OpenGL ES" : "OpenGL (Desktop)"};
     QString glVersion{reinterpret_cast<const char*>(glGetString(GL_VERSION))};
     QString glRenderer{reinterpret_cast<const char*>(glGetString(GL_RENDERER))};
     QString glVendor{reinterpret_cast<const char*>(glGetString(GL_VENDOR))};
     // Get Profile Information
     QString glProfile;
-    switch (context()->format().profile())	{
+    switch (glContext()->format().profile())	{
     case QSurfaceFormat::OpenGLContextProfile::CoreProfile:
         glProfile = "Core";
         break;
@@ -235,6 +235,10 @@ QString BaseGLWindow::versionInfo() {
     }
     return info;
 }
+// A window that was never shown has no context of its own
+QOpenGLContext* BaseGLWindow::glContext() const {
+    return context() ? context() : QOpenGLContext::currentContext();
+}
 // In order to use the track ball camera correctly we need to let him know when
 // and where a dragging event started
 void BaseGLWindow::mousePressEvent(QMouseEvent* event) {
@@ -256,6 +260,24 @@ void BaseGLWindow::mouseMoveEvent(QMouseEvent* event) {
     mBall.drag(glm::vec2(event->localPos().x(), event->localPos().y()));
     event->accept();
 }
+// Unproject the pixel at the near (z = -1) and far (z = 1) planes
+void BaseGLWindow::pixelRay(const QPointF& pixel, const glm::mat4& VM, glm::vec3& origin, glm::vec3& direction) const {
+    float x = 2.0f * float(pixel.x()) / float(width()) - 1.0f;
+    float y = 1.0f - 2.0f * float(pixel.y()) / float(height());
+    glm::mat4 inversePVM = glm::inverse(mP * VM);
+    glm::vec4 nearPoint = inversePVM * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inversePVM * glm::vec4(x, y, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
+bool BaseGLWindow::pick(const QPointF& pixel, const TriangleBvh& bvh, RayHit& hit) const {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    pixelRay(pixel, mV * mBall.getRotation() * mM, origin, direction);
+    return bvh.intersect(origin, direction, hit);
+}
+
 // We use the wheel to zoom in/out by changing the camera's fovy (field of view along y axis)
 void BaseGLWindow::wheelEvent(QWheelEvent* event) {
     QPoint numDegrees = event->angleDelta() / 16;
@@ -289,6 +311,26 @@ void BaseGLWindow::keyPressEvent(QKeyEvent* event) {
         }
         break;
 
+        case Qt::Key_G:
+            qDebug().noquote() << mGpuProfiler.report();
+            event->accept();
+        break;
+
+        case Qt::Key_T:
+        {
+            // Open it in chrome://tracing or https://ui.perfetto.dev
+            QString fileName{"trace_"};
+            fileName += QString("%1").arg(mTraces++, 4, 10, QChar('0'));
+            fileName += ".json";
+            if (!CpuProfiler::compiledIn()) {
+                qDebug() << "Built without CPU_PROFILER, there are no CPU zones";
+            } else if (CpuProfiler::instance().writeTrace(fileName, CpuProfiler::FRAMES)) {
+                qDebug() << "CPU trace of the last frames written to" << fileName;
+            }
+            event->accept();
+        }
+        break;
+
         case Qt::Key_F11:
         {
             if (windowState() != Qt::WindowFullScreen) {
@@ -15,6 +15,9 @@
 #include <QMouseEvent>
 
 #include "trackball.h"
+#include "trianglebvh.h"
+#include "gpuprofiler.h"
+#include "cpuprofiler.h"
 //!  A base class for a window that will be used to render OpenGL graphics
 /*!
   This class should be used as a base class when you need a window to
@@ -66,6 +69,8 @@ protected:
     int mLogLevel;
     //!  Return an OpenGL error message formatted as a \class QString
     QString formatMsg(const QOpenGLDebugMessage& msg);
+    //!  The context of the window, or the current one when the window is rendered offscreen (never shown)
+    QOpenGLContext* glContext() const;
     //Model, View and Projection matrices.
     //Technically, I only need projection here because of trackball, but
     //I place them here to keep the code organized (all matrices in one place)
@@ -87,11 +92,24 @@ protected:
     void mouseMoveEvent(QMouseEvent* event) override;
     //!  To control camera fovy (which is zoom in and out)
     void wheelEvent(QWheelEvent* event) override;
+    //!  Ray through a pixel (in window coordinates) in the space where VM applies
+    /*!
+      It goes from the near to the far plane, so direction is not normalized.
+      With VM = mV * mBall.getRotation() * mM the ray is in model space.
+    */
+    void pixelRay(const QPointF& pixel, const glm::mat4& VM, glm::vec3& origin, glm::vec3& direction) const;
+    //!  Find the triangle of bvh (built in model space) under a pixel, e.g. the mouse position
+    bool pick(const QPointF& pixel, const TriangleBvh& bvh, RayHit& hit) const;
     //!  To count the number of screenshot taken
     int mScreenShoots;
+    //!  GPU times of the parts of a frame, create it in initializeGL (See \class GpuProfiler)
+    GpuProfiler mGpuProfiler;
+    //!  To count the number of CPU traces written
+    int mTraces;
     //!  To interact wih keyboard.
     /*!
-        Currentlly, exit application with esc and take screenshoot with space
+        Currentlly, exit application with esc, take screenshoot with space,
+        print the GPU times with G and write a CPU trace of the last frames with T
     */
     void keyPressEvent(QKeyEvent* event) override;
 
@@ -0,0 +1,163 @@
+#include "cpuprofiler.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+//Microseconds, what the trace event format uses
+void appendMicroseconds(std::string& json, int64_t nanoseconds) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.3f", double(nanoseconds) * 1.0e-3);
+    json += number;
+}
+
+void appendString(std::string& json, const char* text) {
+    json += '"';
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            json += '\\';
+        }
+        json += *c;
+    }
+    json += '"';
+}
+
+void appendEvent(std::string& json, const char* name, int tid, int64_t start, int64_t end) {
+    json += json.back() == '[' ? "\n" : ",\n";
+    json += "{\"name\":";
+    appendString(json, name);
+    json += ",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(tid) + ",\"ts\":";
+    appendMicroseconds(json, start);
+    json += ",\"dur\":";
+    appendMicroseconds(json, end - start);
+    json += "}";
+}
+
+void appendThreadName(std::string& json, int tid, const std::string& name) {
+    json += json.back() == '[' ? "\n" : ",\n";
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(tid) + ",\"args\":{\"name\":";
+    appendString(json, name.c_str());
+    json += "}}";
+}
+}
+
+CpuProfiler::CpuProfiler() : mEpoch(std::chrono::steady_clock::now()), mFrameCount(0) {
+}
+
+CpuProfiler& CpuProfiler::instance() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+bool CpuProfiler::compiledIn() {
+#ifdef CPU_PROFILER
+    return true;
+#else
+    return false;
+#endif
+}
+
+CpuProfiler::ThreadBuffer* CpuProfiler::threadBuffer() {
+    //There is only one profiler, so one ring per thread
+    static thread_local ThreadBuffer* current = nullptr;
+    if (current) {
+        return current;
+    }
+    //The rings outlive their threads, a trace can be written after the workers are gone
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+    buffer->events.reset(new EventSlot[THREAD_EVENTS]);
+    buffer->head = 0;
+    std::lock_guard<std::mutex> lock(mMutex);
+    //The frames have the first row
+    buffer->id = int(mThreads.size()) + 1;
+    mThreads.push_back(std::move(buffer));
+    current = mThreads.back().get();
+    return current;
+}
+
+void CpuProfiler::record(const char* name, int64_t start, int64_t end) {
+    ThreadBuffer* buffer = threadBuffer();
+    //Only this thread writes its ring, the release publishes the zone to the readers
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    //The head of the last zone is seen before any of the writes below (it pairs with the fence of snapshot),
+    //so a reader that copies a half written slot also sees that it is being overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    EventSlot& event = buffer->events[head % THREAD_EVENTS];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start.store(start, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfiler::frame() {
+    const uint64_t count = mFrameCount.load(std::memory_order_relaxed);
+    mFrames[count % FRAMES] = now();
+    mFrameCount.store(count + 1, std::memory_order_release);
+}
+
+uint64_t CpuProfiler::frameCount() const {
+    return mFrameCount.load(std::memory_order_acquire);
+}
+
+void CpuProfiler::snapshot(const ThreadBuffer& buffer, std::vector<TraceEvent>& events) {
+    const uint64_t head = buffer.head.load(std::memory_order_acquire);
+    uint64_t first = head > THREAD_EVENTS ? head - THREAD_EVENTS : 0;
+    std::vector<TraceEvent> copy;
+    copy.reserve(size_t(head - first));
+    for (uint64_t i = first; i < head; ++i) {
+        const EventSlot& slot = buffer.events[i % THREAD_EVENTS];
+        copy.push_back(TraceEvent{slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                                  slot.end.load(std::memory_order_relaxed)});
+    }
+    //Keep the copies above from being read after the head below
+    std::atomic_thread_fence(std::memory_order_acquire);
+    //The thread kept writing meanwhile: drop the zones it may have overwritten (or be writing)
+    const uint64_t newHead = buffer.head.load(std::memory_order_acquire);
+    const uint64_t valid = newHead >= THREAD_EVENTS ? newHead - THREAD_EVENTS + 1 : 0;
+    events.clear();
+    for (uint64_t i = std::max(first, valid); i < head; ++i) {
+        events.push_back(copy[size_t(i - first)]);
+    }
+}
+
+std::string CpuProfiler::traceJson(uint64_t frames) const {
+    //The frames, each one from its start to the start of the next one
+    const uint64_t frameCount = this->frameCount();
+    const uint64_t kept = std::min(frameCount, FRAMES);
+    const uint64_t firstFrame = frameCount - (frames > 0 ? std::min(frames, kept) : kept);
+    int64_t cutoff = 0;
+    if (frames > 0 && frameCount > firstFrame) {
+        cutoff = mFrames[firstFrame % FRAMES];
+    }
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    appendThreadName(json, 0, "frames");
+    for (uint64_t frame = firstFrame; frame + 1 < frameCount; ++frame) {
+        const std::string name = "frame " + std::to_string(frame);
+        appendEvent(json, name.c_str(), 0, mFrames[frame % FRAMES], mFrames[(frame + 1) % FRAMES]);
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::vector<TraceEvent> events;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : mThreads) {
+        appendThreadName(json, buffer->id, "thread " + std::to_string(buffer->id));
+        snapshot(*buffer, events);
+        for (const TraceEvent& event : events) {
+            if (event.end >= cutoff) {
+                appendEvent(json, event.name, buffer->id, event.start, event.end);
+            }
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+bool CpuProfiler::writeTrace(const QString& path, uint64_t frames) const {
+    const std::string json = traceJson(frames);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json.data(), qint64(json.size())) != qint64(json.size())) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
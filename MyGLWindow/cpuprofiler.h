@@ -0,0 +1,109 @@
+#ifndef CPUPROFILER_H
+#define CPUPROFILER_H
+
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! A zone of CPU time of a thread, in nanoseconds since the profiler was created
+struct TraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+//! Records where the CPU time goes, in every thread, to look at it in chrome://tracing (or Perfetto)
+/*!
+  Each thread writes its zones in a ring of its own, so recording takes no
+  lock (only the first zone of a thread registers its ring). When a ring is
+  full the oldest zones are overwritten. The starts of the last FRAMES
+  frames are kept too, to export only the recent frames.
+
+  Use the PROFILE_ZONE and PROFILE_FRAME macros: without CPU_PROFILER
+  defined they compile to nothing.
+*/
+class CpuProfiler {
+public:
+    //! Zones that each thread keeps
+    static const uint64_t THREAD_EVENTS = uint64_t(1) << 16;
+    //! Frames whose start is kept
+    static const uint64_t FRAMES = 256;
+    static CpuProfiler& instance();
+    //! If the macros were compiled in (CPU_PROFILER defined)
+    static bool compiledIn();
+    //! Nanoseconds since the profiler was created
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mEpoch).count();
+    }
+    //! Record a zone of the calling thread. name must outlive the profiler, usually a literal
+    void record(const char* name, int64_t start, int64_t end);
+    //! Mark the start of a frame
+    void frame();
+    uint64_t frameCount() const;
+    //! All the threads in the trace event format, only the zones of the last frames (all of them if frames is 0)
+    std::string traceJson(uint64_t frames = 0) const;
+    bool writeTrace(const QString& path, uint64_t frames = 0) const;
+
+private:
+    //! A zone in a ring, atomic since a reader may copy it while its thread overwrites it
+    struct EventSlot {
+        std::atomic<const char*> name;
+        std::atomic<int64_t> start;
+        std::atomic<int64_t> end;
+    };
+    struct ThreadBuffer {
+        int id;
+        std::unique_ptr<EventSlot[]> events;
+        //! Zones ever written, only the last THREAD_EVENTS are there
+        std::atomic<uint64_t> head;
+    };
+    CpuProfiler();
+    //! The ring of the calling thread, registered the first time
+    ThreadBuffer* threadBuffer();
+    //! Copy the zones of a ring that are not being overwritten
+    static void snapshot(const ThreadBuffer& buffer, std::vector<TraceEvent>& events);
+    std::chrono::steady_clock::time_point mEpoch;
+    //! Only for registering threads and reading the rings
+    mutable std::mutex mMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mThreads;
+    int64_t mFrames[FRAMES];
+    std::atomic<uint64_t> mFrameCount;
+};
+
+//! Records the CPU time from its construction to its destruction (See \class CpuProfiler)
+class CpuZone {
+public:
+    explicit CpuZone(const char* name) : mProfiler(CpuProfiler::instance()), mName(name),
+        mStart(mProfiler.now()) {}
+    ~CpuZone() {
+        mProfiler.record(mName, mStart, mProfiler.now());
+    }
+    CpuZone(const CpuZone&) = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+
+private:
+    CpuProfiler& mProfiler;
+    const char* mName;
+    int64_t mStart;
+};
+
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+
+#ifdef CPU_PROFILER
+//! Record the rest of the scope as a zone
+#define PROFILE_ZONE(name) CpuZone CPU_PROFILER_CONCAT(cpuZone, __LINE__)(name)
+//! Mark the start of a frame
+#define PROFILE_FRAME() CpuProfiler::instance().frame()
+#else
+#define PROFILE_ZONE(name) static_cast<void>(0)
+#define PROFILE_FRAME() static_cast<void>(0)
+#endif
+
+#endif // CPUPROFILER_H
@@ -0,0 +1,127 @@
+#include "framering.h"
+
+#include <algorithm>
+
+FrameRing::FrameRing() : mGL(nullptr), mBuffer(0), mData(nullptr), mFrameSize(0), mFrame(0), mUsed(0),
+    mUniformAlignment(256), mStorageAlignment(256), mStalls(0) {
+    for (int i = 0; i < FRAMES; ++i) {
+        mFences[i] = nullptr;
+    }
+}
+
+bool FrameRing::create(QOpenGLFunctions_4_5_Core* gl, GLsizeiptr frameSize) {
+    destroy();
+    mGL = gl;
+    GLint alignment;
+    mGL->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mUniformAlignment = alignment;
+    mGL->glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mStorageAlignment = alignment;
+    //Each region starts aligned for any use
+    const GLintptr regionAlignment = std::max(mUniformAlignment, mStorageAlignment);
+    mFrameSize = (frameSize + regionAlignment - 1) / regionAlignment * regionAlignment;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    mGL->glGenBuffers(1, &mBuffer);
+    mGL->glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+    mGL->glBufferStorage(GL_COPY_WRITE_BUFFER, mFrameSize * FRAMES, nullptr, flags);
+    mData = static_cast<unsigned char*>(mGL->glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mFrameSize * FRAMES, flags));
+    mGL->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!mData) {
+        destroy();
+        return false;
+    }
+    mFrame = 0;
+    mUsed = 0;
+    mStalls = 0;
+    return true;
+}
+
+void FrameRing::destroy() {
+    if (!mGL) {
+        return;
+    }
+    for (int i = 0; i < FRAMES; ++i) {
+        if (mFences[i]) {
+            mGL->glDeleteSync(mFences[i]);
+            mFences[i] = nullptr;
+        }
+    }
+    if (mBuffer) {
+        if (mData) {
+            mGL->glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+            mGL->glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            mGL->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        mGL->glDeleteBuffers(1, &mBuffer);
+    }
+    mBuffer = 0;
+    mData = nullptr;
+    mFrameSize = 0;
+    mGL = nullptr;
+}
+
+bool FrameRing::isCreated() const {
+    return mData != nullptr;
+}
+
+GLuint FrameRing::buffer() const {
+    return mBuffer;
+}
+
+GLsizeiptr FrameRing::frameSize() const {
+    return mFrameSize;
+}
+
+void FrameRing::beginFrame() {
+    if (!isCreated()) {
+        return;
+    }
+    mFrame = (mFrame + 1) % FRAMES;
+    mUsed = 0;
+    GLsync& fence = mFences[mFrame];
+    if (!fence) {
+        return;
+    }
+    //Almost always signaled already, otherwise wait (flushing so the fence does get there)
+    GLenum result = mGL->glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        ++mStalls;
+        do {
+            result = mGL->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000));
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    mGL->glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void FrameRing::endFrame() {
+    if (!isCreated()) {
+        return;
+    }
+    mFences[mFrame] = mGL->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr FrameRing::allocate(GLsizeiptr size, GLintptr alignment) {
+    GLintptr start = (mUsed + alignment - 1) / alignment * alignment;
+    if (start + size > mFrameSize) {
+        return -1;
+    }
+    mUsed = start + size;
+    return GLintptr(mFrame) * mFrameSize + start;
+}
+
+void* FrameRing::pointer(GLintptr offset) const {
+    return mData + offset;
+}
+
+GLintptr FrameRing::uniformAlignment() const {
+    return mUniformAlignment;
+}
+
+GLintptr FrameRing::storageAlignment() const {
+    return mStorageAlignment;
+}
+
+int FrameRing::stalls() const {
+    return mStalls;
+}
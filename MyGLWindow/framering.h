@@ -0,0 +1,78 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <QOpenGLFunctions_4_5_Core>
+#include <glm/glm.hpp>
+
+//! The camera block of the shaders (binding 1), with the std140 layout
+struct CameraBlock {
+    glm::mat4 VM;
+    glm::mat4 PVM;
+    glm::mat4 NormalMat;
+    float alpha;
+    //! A bool in the shader, that std140 stores in 4 bytes
+    GLint compactVertices;
+    GLint padding[2];
+};
+
+//! Binding points of the blocks that the shaders read from a \class FrameRing
+enum FrameBinding {DRAW_MATERIALS_BINDING = 0, CAMERA_BINDING = 1, DRAW_BINDING = 2};
+
+//! A buffer for the data that changes every frame (uniform blocks, draw commands...), mapped once for good
+/*!
+  The buffer is split in FRAMES regions, and each frame writes in the next
+  one straight through the persistent (and coherent) mapping, without any
+  glBufferData or glUniform call. A fence at the end of each frame tells
+  when the GPU is done with its region: beginFrame only waits if the GPU
+  is still FRAMES - 1 frames behind.
+
+  Inside a frame, allocate returns an offset in the buffer that can be
+  bound with glBindBufferRange (or as an indirect buffer) and written with
+  pointer.
+*/
+class FrameRing {
+public:
+    static const int FRAMES = 3;
+    FrameRing();
+    //! Create and map the buffer, with the context current. frameSize bytes for each frame
+    bool create(QOpenGLFunctions_4_5_Core* gl, GLsizeiptr frameSize);
+    void destroy();
+    bool isCreated() const;
+    GLuint buffer() const;
+    GLsizeiptr frameSize() const;
+    //! Move to the region of the next frame, waiting for the GPU to be done with it
+    void beginFrame();
+    //! Fence the region of this frame
+    void endFrame();
+    //! Offset of size bytes in this frame, aligned to alignment. -1 if the frame is full
+    GLintptr allocate(GLsizeiptr size, GLintptr alignment);
+    //! Where to write an allocation
+    void* pointer(GLintptr offset) const;
+    //! Allocate and copy a block, for glBindBufferRange with the alignment of the uniform buffers
+    template <typename T>
+    GLintptr write(const T& block) {
+        GLintptr offset = allocate(GLsizeiptr(sizeof(T)), mUniformAlignment);
+        if (offset >= 0) {
+            *static_cast<T*>(pointer(offset)) = block;
+        }
+        return offset;
+    }
+    GLintptr uniformAlignment() const;
+    GLintptr storageAlignment() const;
+    //! Times that beginFrame had to wait for the GPU
+    int stalls() const;
+
+private:
+    QOpenGLFunctions_4_5_Core* mGL;
+    GLuint mBuffer;
+    unsigned char* mData;
+    GLsizeiptr mFrameSize;
+    GLsync mFences[FRAMES];
+    int mFrame;
+    GLintptr mUsed;
+    GLintptr mUniformAlignment;
+    GLintptr mStorageAlignment;
+    int mStalls;
+};
+
+#endif // FRAMERING_H
@@ -0,0 +1,534 @@
+#include "geometrycache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+using glm::vec3;
+
+namespace {
+//Change it every time that the layout of the file (or of Vertex, MeshData...) changes
+const uint32_t FORMAT_VERSION = 6;
+const char MAGIC[8] = {'Q', 'T', 'G', 'L', 'G', 'E', 'O', '\0'};
+//Every array starts at a multiple of this
+const uint64_t ALIGNMENT = 16;
+
+enum HeaderFlags {HAS_NORMALS = 1, HAS_TEXTURE = 2};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t importFlags;
+    //Key: the source file as it was when the entry was written
+    int64_t sourceTime;
+    int64_t sourceSize;
+    //Sizes of the structs, so a different compiler or platform is a miss
+    uint32_t vertexSize;
+    uint32_t meshDataSize;
+    uint32_t meshletSize;
+    uint32_t flags;
+    uint32_t textureCount;
+    uint32_t padding;
+    float lowerCorner[3];
+    float upperCorner[3];
+    uint64_t vertexCount;
+    uint64_t indexBytes;
+    uint64_t separatorCount;
+    uint64_t meshletCount;
+    uint64_t stringsSize;
+    uint64_t dependencyCount;
+    //Byte offsets of each section from the begining of the file
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t separatorOffset;
+    uint64_t meshletOffset;
+    uint64_t textureOffset;
+    uint64_t stringsOffset;
+    uint64_t dependencyOffset;
+    uint64_t fileSize;
+};
+
+//An entry of the textures table, the path is in the strings section
+struct TextureRecord {
+    uint32_t type;
+    uint32_t pathOffset;
+    uint32_t pathSize;
+    uint32_t padding;
+};
+
+//Another file that the import read (an obj's materials), the entry is stale if it changes too.
+//The path is in the strings section
+struct DependencyRecord {
+    int64_t time;
+    int64_t size;
+    uint32_t pathOffset;
+    uint32_t pathSize;
+};
+
+//Modification time and size of a file, -1 for both if it does not exist
+void fileStamp(const QFileInfo& info, int64_t& time, int64_t& size) {
+    time = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+    size = info.exists() ? info.size() : -1;
+}
+
+//The material files that Assimp reads along with sourceFile: the mtllib of an obj, or the obj
+//name with .mtl when one is missing (as the importer falls back to it). The other formats embed them
+std::vector<QString> materialFiles(const QFileInfo& source) {
+    std::vector<QString> files;
+    if (source.suffix().toLower() != "obj") {
+        return files;
+    }
+    QFile obj(source.absoluteFilePath());
+    if (!obj.open(QIODevice::ReadOnly)) {
+        return files;
+    }
+    const QDir folder = source.absoluteDir();
+    while (!obj.atEnd()) {
+        const QByteArray line = obj.readLine().trimmed();
+        if (!line.startsWith("mtllib") || line.size() < 7 || !std::isspace(static_cast<unsigned char>(line[6]))) {
+            continue;
+        }
+        const QString path = folder.filePath(QString::fromUtf8(line.mid(7).trimmed()));
+        files.push_back(path);
+        if (!QFileInfo(path).exists()) {
+            files.push_back(folder.filePath(source.completeBaseName() + ".mtl"));
+        }
+    }
+    return files;
+}
+
+uint64_t align(uint64_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+//Checks that count elements of size bytes starting at offset are inside the file
+bool inside(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize) {
+    if (offset > fileSize || (size != 0 && count > (fileSize - offset) / size)) {
+        return false;
+    }
+    return true;
+}
+
+//Checks that the count indices at offset (in bytes) address vertices below vertexCount
+template <typename Index>
+bool indicesBelow(const unsigned char* indexData, uint64_t offset, uint64_t count, uint64_t vertexCount) {
+    const Index* indices = reinterpret_cast<const Index*>(indexData + offset);
+    Index biggest = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        biggest = std::max(biggest, indices[i]);
+    }
+    return count == 0 || uint64_t(biggest) < vertexCount;
+}
+
+bool validIndices(const unsigned char* indexData, GLenum type, uint64_t offset, uint64_t count, uint64_t vertexCount) {
+    if (type == GL_UNSIGNED_SHORT) {
+        return offset % sizeof(GLushort) == 0 && indicesBelow<GLushort>(indexData, offset, count, vertexCount);
+    }
+    return offset % sizeof(unsigned int) == 0 && indicesBelow<unsigned int>(indexData, offset, count, vertexCount);
+}
+
+//Checks that a texture of a mesh is -1 (none) or in the textures table
+bool validTexture(int index, uint64_t textureCount) {
+    return index >= -1 && (index < 0 || uint64_t(index) < textureCount);
+}
+
+bool writeAt(QSaveFile& file, uint64_t offset, const void* data, uint64_t size) {
+    if (size == 0) {
+        return true;
+    }
+    return file.seek(qint64(offset)) &&
+           file.write(static_cast<const char*>(data), qint64(size)) == qint64(size);
+}
+}
+
+CachedModel::CachedModel() : mHasNormals(false), mHasTexture(false) {
+    mLowerCorner = mUpperCorner = vec3(0.0f);
+}
+
+CachedModel::~CachedModel() {
+    close();
+}
+
+bool CachedModel::isOpen() const {
+    return mFile != nullptr;
+}
+
+void CachedModel::close() {
+    //The file unmaps its memmory when it is closed
+    mFile.reset();
+    mVertices = ArrayView<const Vertex>();
+    mIndexData = ArrayView<const unsigned char>();
+    mSeparators = ArrayView<const MeshData>();
+    mMeshlets = ArrayView<const Meshlet>();
+    mTextures.clear();
+    mHasNormals = mHasTexture = false;
+    mLowerCorner = mUpperCorner = vec3(0.0f);
+}
+
+ArrayView<const Vertex> CachedModel::vertices() const {
+    return mVertices;
+}
+
+ArrayView<const unsigned char> CachedModel::indexData() const {
+    return mIndexData;
+}
+
+ArrayView<const MeshData> CachedModel::separators() const {
+    return mSeparators;
+}
+
+ArrayView<const Meshlet> CachedModel::meshlets() const {
+    return mMeshlets;
+}
+
+const std::vector<TextureImage>& CachedModel::textures() const {
+    return mTextures;
+}
+
+bool CachedModel::hasNormals() const {
+    return mHasNormals;
+}
+
+bool CachedModel::hasTexture() const {
+    return mHasTexture;
+}
+
+vec3 CachedModel::lowerCorner() const {
+    return mLowerCorner;
+}
+
+vec3 CachedModel::upperCorner() const {
+    return mUpperCorner;
+}
+
+GeometryCache::GeometryCache(const QString& directory) : mDirectory(directory) {
+    QDir().mkpath(mDirectory);
+}
+
+QString GeometryCache::defaultDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/geometry";
+}
+
+QString GeometryCache::directory() const {
+    return mDirectory;
+}
+
+QString GeometryCache::entryPath(const QString& sourceFile, unsigned int importFlags) const {
+    //The name of the entry is a hash of the key that does not change with the file
+    QString key = QFileInfo(sourceFile).absoluteFilePath() + "|" + QString::number(importFlags);
+    QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+    return mDirectory + "/" + QString::fromLatin1(hash.toHex()) + ".geo";
+}
+
+bool GeometryCache::open(const QString& sourceFile, unsigned int importFlags, CachedModel& cached) const {
+    cached.close();
+    QFileInfo source(sourceFile);
+    if (!source.exists()) {
+        return false;
+    }
+    std::unique_ptr<QFile> file(new QFile(entryPath(sourceFile, importFlags)));
+    if (!file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const uint64_t fileSize = uint64_t(file->size());
+    if (fileSize < sizeof(Header)) {
+        return false;
+    }
+    const uchar* data = file->map(0, file->size());
+    if (!data) {
+        return false;
+    }
+
+    //Anything that does not match the source file or this build is a miss
+    Header header;
+    std::memcpy(&header, data, sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != FORMAT_VERSION ||
+        header.importFlags != importFlags ||
+        header.sourceTime != source.lastModified().toMSecsSinceEpoch() ||
+        header.sourceSize != source.size() ||
+        header.vertexSize != sizeof(Vertex) ||
+        header.meshDataSize != sizeof(MeshData) ||
+        header.meshletSize != sizeof(Meshlet) ||
+        header.fileSize != fileSize) {
+        return false;
+    }
+    //Never trust the counts to stay inside the file, nor the arrays to be aligned as they were written
+    const uint64_t offsets[] = {header.vertexOffset, header.indexOffset, header.separatorOffset,
+                                header.meshletOffset, header.textureOffset, header.dependencyOffset};
+    for (uint64_t offset : offsets) {
+        if (offset % ALIGNMENT != 0) {
+            qDebug() << "Corrupted geometry cache entry" << file->fileName();
+            return false;
+        }
+    }
+    if (!inside(header.vertexOffset, header.vertexCount, sizeof(Vertex), fileSize) ||
+        !inside(header.indexOffset, header.indexBytes, 1, fileSize) ||
+        !inside(header.separatorOffset, header.separatorCount, sizeof(MeshData), fileSize) ||
+        !inside(header.meshletOffset, header.meshletCount, sizeof(Meshlet), fileSize) ||
+        !inside(header.textureOffset, header.textureCount, sizeof(TextureRecord), fileSize) ||
+        !inside(header.stringsOffset, header.stringsSize, 1, fileSize) ||
+        !inside(header.dependencyOffset, header.dependencyCount, sizeof(DependencyRecord), fileSize)) {
+        qDebug() << "Corrupted geometry cache entry" << file->fileName();
+        return false;
+    }
+    //The materials are in the entry too, so it is stale once any of them changes
+    const char* strings = reinterpret_cast<const char*>(data + header.stringsOffset);
+    for (size_t i = 0; i < header.dependencyCount; ++i) {
+        DependencyRecord record;
+        std::memcpy(&record, data + header.dependencyOffset + i * sizeof(DependencyRecord), sizeof(DependencyRecord));
+        if (!inside(record.pathOffset, record.pathSize, 1, header.stringsSize)) {
+            qDebug() << "Corrupted geometry cache entry" << file->fileName();
+            return false;
+        }
+        int64_t time;
+        int64_t size;
+        fileStamp(QFileInfo(QString::fromUtf8(strings + record.pathOffset, int(record.pathSize))), time, size);
+        if (time != record.time || size != record.size) {
+            return false;
+        }
+    }
+
+    std::vector<TextureImage> textures(header.textureCount);
+    for (size_t i = 0; i < textures.size(); ++i) {
+        TextureRecord record;
+        std::memcpy(&record, data + header.textureOffset + i * sizeof(TextureRecord), sizeof(TextureRecord));
+        if (!inside(record.pathOffset, record.pathSize, 1, header.stringsSize)) {
+            qDebug() << "Corrupted geometry cache entry" << file->fileName();
+            return false;
+        }
+        textures[i].type = TextType(record.type);
+        textures[i].filePath.assign(strings + record.pathOffset, record.pathSize);
+    }
+
+    //Neither the meshes: their index ranges, the vertices their indices use and their textures
+    const unsigned char* indexData = data + header.indexOffset;
+    const MeshData* separators = reinterpret_cast<const MeshData*>(data + header.separatorOffset);
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+    for (size_t i = 0; i < header.separatorCount; ++i) {
+        const MeshData& sep = separators[i];
+        uint64_t size = sep.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(unsigned int);
+        if ((sep.indexType != GL_UNSIGNED_SHORT && sep.indexType != GL_UNSIGNED_INT) ||
+            sep.indexOffset < 0 || sep.howMany < 0 || sep.startVertex < 0 ||
+            uint64_t(sep.startVertex) > header.vertexCount ||
+            !inside(uint64_t(sep.indexOffset), uint64_t(sep.howMany), size, header.indexBytes) ||
+            !validIndices(indexData, sep.indexType, uint64_t(sep.indexOffset), uint64_t(sep.howMany),
+                          header.vertexCount - uint64_t(sep.startVertex)) ||
+            !validTexture(sep.diffuseIndex, header.textureCount) ||
+            !validTexture(sep.specIndex, header.textureCount) ||
+            sep.lodCount < 0 || sep.lodCount > MAX_LODS ||
+            sep.firstMeshlet < 0 || sep.meshletCount < 0 ||
+            !inside(uint64_t(sep.firstMeshlet), uint64_t(sep.meshletCount), 1, header.meshletCount)) {
+            qDebug() << "Corrupted geometry cache entry" << file->fileName();
+            return false;
+        }
+        for (int k = 0; k < sep.lodCount; ++k) {
+            const MeshLod& lod = sep.lods[k];
+            if (lod.indexOffset < 0 || lod.howMany < 0 ||
+                !inside(uint64_t(lod.indexOffset), uint64_t(lod.howMany), size, header.indexBytes) ||
+                !validIndices(indexData, sep.indexType, uint64_t(lod.indexOffset), uint64_t(lod.howMany),
+                              header.vertexCount - uint64_t(sep.startVertex))) {
+                qDebug() << "Corrupted geometry cache entry" << file->fileName();
+                return false;
+            }
+        }
+        for (int k = sep.firstMeshlet; k < sep.firstMeshlet + sep.meshletCount; ++k) {
+            const Meshlet& meshlet = meshlets[k];
+            if (meshlet.firstIndex < 0 || meshlet.howMany < 0 ||
+                !inside(uint64_t(meshlet.firstIndex), uint64_t(meshlet.howMany), 1, uint64_t(sep.howMany))) {
+                qDebug() << "Corrupted geometry cache entry" << file->fileName();
+                return false;
+            }
+        }
+    }
+
+    //The vertices are not touched, the views just point into the mapping
+    cached.mVertices = ArrayView<const Vertex>(reinterpret_cast<const Vertex*>(data + header.vertexOffset),
+                                               size_t(header.vertexCount));
+    cached.mIndexData = ArrayView<const unsigned char>(data + header.indexOffset, size_t(header.indexBytes));
+    cached.mSeparators = ArrayView<const MeshData>(separators, size_t(header.separatorCount));
+    cached.mMeshlets = ArrayView<const Meshlet>(meshlets, size_t(header.meshletCount));
+    cached.mTextures.swap(textures);
+    cached.mHasNormals = (header.flags & HAS_NORMALS) != 0;
+    cached.mHasTexture = (header.flags & HAS_TEXTURE) != 0;
+    cached.mLowerCorner = vec3(header.lowerCorner[0], header.lowerCorner[1], header.lowerCorner[2]);
+    cached.mUpperCorner = vec3(header.upperCorner[0], header.upperCorner[1], header.upperCorner[2]);
+    cached.mFile = std::move(file);
+    return true;
+}
+
+ModelGeometry::ModelGeometry() {
+}
+
+bool ModelGeometry::load(const QString& fileName, const GeometryCache& cache) {
+    mCached.close();
+    mModel = Model();
+    mIndexData.clear();
+    mSeparators.clear();
+    if (cache.open(fileName, Model::IMPORT_FLAGS, mCached)) {
+        return true;
+    }
+    //A miss: the import writes the entry, which is then used as if it was a hit
+    if (!mModel.load(fileName, cache)) {
+        mModel = Model();
+        return false;
+    }
+    if (cache.open(fileName, Model::IMPORT_FLAGS, mCached)) {
+        mModel = Model();
+        return true;
+    }
+    qDebug() << "No geometry cache entry for" << fileName << ", keeping the imported model";
+    mModel.packIndices(mIndexData, mSeparators);
+    return true;
+}
+
+bool ModelGeometry::isMapped() const {
+    return mCached.isOpen();
+}
+
+ArrayView<const Vertex> ModelGeometry::vertices() const {
+    return isMapped() ? mCached.vertices() : mModel.verticesView();
+}
+
+ArrayView<const unsigned char> ModelGeometry::indexData() const {
+    return isMapped() ? mCached.indexData() : ArrayView<const unsigned char>(mIndexData);
+}
+
+ArrayView<const MeshData> ModelGeometry::separators() const {
+    return isMapped() ? mCached.separators() : ArrayView<const MeshData>(mSeparators);
+}
+
+ArrayView<const Meshlet> ModelGeometry::meshlets() const {
+    return isMapped() ? mCached.meshlets() : ArrayView<const Meshlet>(mModel.getMeshlets());
+}
+
+const std::vector<TextureImage>& ModelGeometry::textures() const {
+    return isMapped() ? mCached.textures() : mModel.getTextures();
+}
+
+vec3 ModelGeometry::lowerCorner() const {
+    return isMapped() ? mCached.lowerCorner() : mModel.getBBLowerCorner();
+}
+
+vec3 ModelGeometry::upperCorner() const {
+    return isMapped() ? mCached.upperCorner() : mModel.getBBUpperCorner();
+}
+
+size_t ModelGeometry::heapBytes() const {
+    size_t bytes = textures().size() * sizeof(TextureImage);
+    for (const TextureImage& texture : textures()) {
+        bytes += texture.filePath.size();
+    }
+    if (!isMapped()) {
+        bytes += mModel.vertexCount() * sizeof(Vertex) + mModel.getIndices().size() * sizeof(unsigned int) +
+                 mModel.getSeparators().size() * sizeof(MeshData) + mModel.getMeshlets().size() * sizeof(Meshlet) +
+                 mIndexData.size() + mSeparators.size() * sizeof(MeshData);
+    }
+    return bytes;
+}
+
+bool GeometryCache::store(const QString& sourceFile, unsigned int importFlags, const Model& model) const {
+    QFileInfo source(sourceFile);
+    if (!source.exists()) {
+        return false;
+    }
+    //In the separated layout the vertices need to be interleaved first
+    std::vector<Vertex> interleaved;
+    ArrayView<const Vertex> vertices = model.verticesView();
+    if (vertices.size() != model.vertexCount()) {
+        interleaved = model.getVertices();
+        vertices = ArrayView<const Vertex>(interleaved);
+    }
+    std::vector<unsigned char> indexData;
+    std::vector<MeshData> separators;
+    model.packIndices(indexData, separators);
+    const std::vector<Meshlet>& meshlets = model.getMeshlets();
+    ArrayView<const TextureImage> textures = model.texturesView();
+
+    std::vector<TextureRecord> records(textures.size());
+    std::string strings;
+    for (size_t i = 0; i < textures.size(); ++i) {
+        records[i].type = uint32_t(textures[i].type);
+        records[i].pathOffset = uint32_t(strings.size());
+        records[i].pathSize = uint32_t(textures[i].filePath.size());
+        records[i].padding = 0;
+        strings += textures[i].filePath;
+    }
+    const std::vector<QString> materials = materialFiles(source);
+    std::vector<DependencyRecord> dependencies(materials.size());
+    for (size_t i = 0; i < materials.size(); ++i) {
+        const QByteArray path = materials[i].toUtf8();
+        fileStamp(QFileInfo(materials[i]), dependencies[i].time, dependencies[i].size);
+        dependencies[i].pathOffset = uint32_t(strings.size());
+        dependencies[i].pathSize = uint32_t(path.size());
+        strings.append(path.constData(), size_t(path.size()));
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.importFlags = importFlags;
+    header.sourceTime = source.lastModified().toMSecsSinceEpoch();
+    header.sourceSize = source.size();
+    header.vertexSize = sizeof(Vertex);
+    header.meshDataSize = sizeof(MeshData);
+    header.meshletSize = sizeof(Meshlet);
+    header.flags = (model.hasNormals() ? HAS_NORMALS : 0) | (model.hasTexture() ? HAS_TEXTURE : 0);
+    header.textureCount = uint32_t(records.size());
+    const vec3 lower = model.getBBLowerCorner();
+    const vec3 upper = model.getBBUpperCorner();
+    for (int i = 0; i < 3; ++i) {
+        header.lowerCorner[i] = lower[i];
+        header.upperCorner[i] = upper[i];
+    }
+    header.vertexCount = vertices.size();
+    header.indexBytes = indexData.size();
+    header.separatorCount = separators.size();
+    header.meshletCount = meshlets.size();
+    header.stringsSize = strings.size();
+    header.dependencyCount = dependencies.size();
+    header.vertexOffset = align(sizeof(Header));
+    header.indexOffset = align(header.vertexOffset + vertices.sizeInBytes());
+    header.separatorOffset = align(header.indexOffset + indexData.size());
+    header.meshletOffset = align(header.separatorOffset + separators.size() * sizeof(MeshData));
+    header.textureOffset = align(header.meshletOffset + meshlets.size() * sizeof(Meshlet));
+    header.stringsOffset = align(header.textureOffset + records.size() * sizeof(TextureRecord));
+    header.dependencyOffset = align(header.stringsOffset + header.stringsSize);
+    header.fileSize = header.dependencyOffset + dependencies.size() * sizeof(DependencyRecord);
+
+    //QSaveFile writes a temporary file and renames it on commit. So a reader
+    //never maps a half written entry
+    QSaveFile file(entryPath(sourceFile, importFlags));
+    if (!file.open(QIODevice::WriteOnly) || !file.resize(qint64(header.fileSize))) {
+        qDebug() << "Unable to write the geometry cache entry" << file.fileName();
+        return false;
+    }
+    bool written = writeAt(file, 0, &header, sizeof(Header)) &&
+                   writeAt(file, header.vertexOffset, vertices.data(), vertices.sizeInBytes()) &&
+                   writeAt(file, header.indexOffset, indexData.data(), indexData.size()) &&
+                   writeAt(file, header.separatorOffset, separators.data(), separators.size() * sizeof(MeshData)) &&
+                   writeAt(file, header.meshletOffset, meshlets.data(), meshlets.size() * sizeof(Meshlet)) &&
+                   writeAt(file, header.textureOffset, records.data(), records.size() * sizeof(TextureRecord)) &&
+                   writeAt(file, header.stringsOffset, strings.data(), strings.size()) &&
+                   writeAt(file, header.dependencyOffset, dependencies.data(), dependencies.size() * sizeof(DependencyRecord));
+    if (!written) {
+        file.cancelWriting();
+        qDebug() << "Unable to write the geometry cache entry" << file.fileName();
+        return false;
+    }
+    return file.commit();
+}
+
+bool GeometryCache::remove(const QString& sourceFile, unsigned int importFlags) const {
+    return QFile::remove(entryPath(sourceFile, importFlags));
+}
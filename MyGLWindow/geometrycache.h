@@ -0,0 +1,145 @@
+#ifndef GEOMETRYCACHE_H
+#define GEOMETRYCACHE_H
+
+#include <QString>
+#include <QFile>
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "arrayview.h"
+#include "model.h"
+
+//! A \class Model, as it is stored by the \class GeometryCache, mapped into memmory
+/*!
+  The vertices, indices and separators are not copied nor parsed: the views
+  point straight into the mapped file. So they can be passed as they are to
+  QOpenGLBuffer::allocate. Only the vertices are not read at all when the
+  entry is opened, the indices are checked to stay inside them.
+
+  The views are valid while this object is alive and not closed.
+*/
+class CachedModel {
+public:
+    CachedModel();
+    ~CachedModel();
+    CachedModel(CachedModel&& other) = default;
+    CachedModel& operator=(CachedModel&& other) = default;
+    //! Queries if there is a file mapped
+    bool isOpen() const;
+    //! Unmap the file. All the views become empthy
+    void close();
+    //! The interleaved vertices of all the meshes
+    ArrayView<const Vertex> vertices() const;
+    //! The bytes of the index buffer, packed as Model packIndices does
+    ArrayView<const unsigned char> indexData() const;
+    //! The separators of the meshes, with the type and offset of their packed indices
+    ArrayView<const MeshData> separators() const;
+    //! The meshlets of the meshes (See MeshData firstMeshlet)
+    ArrayView<const Meshlet> meshlets() const;
+    //! The textures table (this one is small, so it is parsed)
+    const std::vector<TextureImage>& textures() const;
+    bool hasNormals() const;
+    bool hasTexture() const;
+    //! Corners of the axis aligned bounding box of the model
+    glm::vec3 lowerCorner() const;
+    glm::vec3 upperCorner() const;
+
+private:
+    friend class GeometryCache;
+    std::unique_ptr<QFile> mFile;
+    ArrayView<const Vertex> mVertices;
+    ArrayView<const unsigned char> mIndexData;
+    ArrayView<const MeshData> mSeparators;
+    ArrayView<const Meshlet> mMeshlets;
+    std::vector<TextureImage> mTextures;
+    bool mHasNormals;
+    bool mHasTexture;
+    glm::vec3 mLowerCorner;
+    glm::vec3 mUpperCorner;
+};
+
+//! An on disk cache of the \class Model after Assimp has imported and post-processed it
+/*!
+  Importing a model with Assimp (parsing the text file, triangulate, generate
+  normals, join identical vertices...) takes far longer than reading its
+  final arrays. So, the first time that a model is imported its arrays are
+  stored in a binary file. The next loads just map that file. Since the
+  entries are written once, \class Model stores them already optimized for
+  the vertex cache and with the levels of detail and meshlets of every mesh. The indices are stored packed (16 bits for the meshes
+  that allow it), ready to be the index buffer.
+
+  There is one entry per source file and import flags. An entry is only used
+  if it was written by the same version of the format for the same source
+  path, flags, modification time and size of the file. The material files
+  of an obj (its mtllib) are checked the same way, since the textures table
+  comes from them. Otherwise it is just rewritten on the next store.
+
+  The entries are written in the native byte order, since they are only
+  meant to be read by the machine that wrote them.
+*/
+class GeometryCache {
+public:
+    //! A cache that keeps its entries in directory (It is created if needed)
+    explicit GeometryCache(const QString& directory = defaultDirectory());
+    //! The application's cache location (See QStandardPaths)
+    static QString defaultDirectory();
+    //! The directory where the entries are
+    QString directory() const;
+    //! The file of the entry for the source file imported with importFlags
+    QString entryPath(const QString& sourceFile, unsigned int importFlags) const;
+    //! Map the entry of sourceFile into cached
+    /*!
+      Returns false (and leaves cached closed) if there is no entry or it is
+      stale, corrupted or from another version of the format.
+    */
+    bool open(const QString& sourceFile, unsigned int importFlags, CachedModel& cached) const;
+    //! Write (or replace) the entry of sourceFile with the data of model
+    bool store(const QString& sourceFile, unsigned int importFlags, const Model& model) const;
+    //! Delete the entry of sourceFile, if there is one
+    bool remove(const QString& sourceFile, unsigned int importFlags) const;
+
+private:
+    QString mDirectory;
+};
+
+//! The geometry of a \class Model as it goes to the GPU: interleaved vertices and packed indices
+/*!
+  It is the mapped entry of the \class GeometryCache whenever there is one.
+  On a miss the file is imported by \class Model, which writes the entry,
+  and then that entry is mapped too. So the buffers are uploaded straight
+  from the file and, once the upload is done, no copy of the arrays is left
+  in memmory (the OS drops the pages when it needs them).
+
+  Only if the entry can not be written, the imported Model is kept with its
+  indices packed (See Model packIndices).
+*/
+class ModelGeometry {
+public:
+    ModelGeometry();
+    //! Load the model of fileName through cache. False if it can not be imported
+    bool load(const QString& fileName, const GeometryCache& cache);
+    //! Queries if the arrays are the mapped cache entry
+    bool isMapped() const;
+    ArrayView<const Vertex> vertices() const;
+    //! The bytes of the index buffer, with the indices of each mesh packed
+    ArrayView<const unsigned char> indexData() const;
+    //! The separators of the meshes, with the type and offset of their packed indices
+    ArrayView<const MeshData> separators() const;
+    ArrayView<const Meshlet> meshlets() const;
+    const std::vector<TextureImage>& textures() const;
+    glm::vec3 lowerCorner() const;
+    glm::vec3 upperCorner() const;
+    //! Bytes of the heap that it takes (the mapped entry is not counted)
+    size_t heapBytes() const;
+
+private:
+    CachedModel mCached;
+    //! Only if there is no entry mapped
+    Model mModel;
+    std::vector<unsigned char> mIndexData;
+    std::vector<MeshData> mSeparators;
+};
+
+#endif // GEOMETRYCACHE_H
@@ -0,0 +1,210 @@
+#include "geometrykernels.h"
+#include "parallel.h"
+
+#include <cfloat>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GEOMETRY_SSE
+#include <immintrin.h>
+#endif
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+
+namespace {
+//Below this many vertices a pass is not worth splitting across threads
+const size_t MIN_CHUNK = 65536;
+
+struct Box {
+    vec3 lower;
+    vec3 upper;
+};
+
+Box emptyBox() {
+    return Box{vec3(FLT_MAX), vec3(-FLT_MAX)};
+}
+
+void merge(Box& box, const Box& other) {
+    box.lower = glm::min(box.lower, other.lower);
+    box.upper = glm::max(box.upper, other.upper);
+}
+
+#ifdef GEOMETRY_SSE
+//Load a vec3 as (x, y, z, 0) without reading past its last component
+inline __m128 load3(const vec3& p) {
+    __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(&p.x)));
+    return _mm_movelh_ps(xy, _mm_load_ss(&p.z));
+}
+
+inline void store3(vec3& p, __m128 v) {
+    _mm_storel_pi(reinterpret_cast<__m64*>(&p.x), v);
+    _mm_store_ss(&p.z, _mm_movehl_ps(v, v));
+}
+
+inline vec3 toVec3(__m128 v) {
+    vec3 p;
+    store3(p, v);
+    return p;
+}
+
+//The columns of a matrix, as GLM multiplies: (c0 * x + c1 * y) + (c2 * z + c3 * w)
+struct Columns {
+    __m128 c[4];
+    explicit Columns(const mat4& M) {
+        for (int i = 0; i < 4; ++i) {
+            c[i] = _mm_loadu_ps(&M[i][0]);
+        }
+    }
+};
+
+//w is 1 for the positions and 0 for the normals, in every component
+inline __m128 multiply(const Columns& M, __m128 v, __m128 w) {
+    __m128 xy = _mm_add_ps(_mm_mul_ps(M.c[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))),
+                           _mm_mul_ps(M.c[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    __m128 zw = _mm_add_ps(_mm_mul_ps(M.c[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))),
+                           _mm_mul_ps(M.c[3], w));
+    return _mm_add_ps(xy, zw);
+}
+
+#ifdef __AVX__
+//Two vertices at once, one in each 128 bits lane
+struct WideColumns {
+    __m256 c[4];
+    explicit WideColumns(const Columns& M) {
+        for (int i = 0; i < 4; ++i) {
+            c[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(M.c[i]), M.c[i], 1);
+        }
+    }
+};
+
+inline __m256 load3x2(const vec3& p, const vec3& q) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(load3(p)), load3(q), 1);
+}
+
+inline void store3x2(vec3& p, vec3& q, __m256 v) {
+    store3(p, _mm256_castps256_ps128(v));
+    store3(q, _mm256_extractf128_ps(v, 1));
+}
+
+inline __m256 multiply(const WideColumns& M, __m256 v, __m256 w) {
+    __m256 xy = _mm256_add_ps(_mm256_mul_ps(M.c[0], _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0))),
+                              _mm256_mul_ps(M.c[1], _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1))));
+    __m256 zw = _mm256_add_ps(_mm256_mul_ps(M.c[2], _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2))),
+                              _mm256_mul_ps(M.c[3], w));
+    return _mm256_add_ps(xy, zw);
+}
+#endif
+
+Box boundsRange(StridedView<const vec3> positions, size_t begin, size_t end) {
+    __m128 lower = _mm_set1_ps(FLT_MAX);
+    __m128 upper = _mm_set1_ps(-FLT_MAX);
+    for (size_t i = begin; i < end; ++i) {
+        __m128 p = load3(positions[i]);
+        lower = _mm_min_ps(lower, p);
+        upper = _mm_max_ps(upper, p);
+    }
+    return Box{toVec3(lower), toVec3(upper)};
+}
+
+Box transformRange(StridedView<vec3> positions, StridedView<vec3> normals,
+                   const mat4& T, const mat4& N, size_t begin, size_t end) {
+    const Columns pointMat(T);
+    const Columns normalMat(N);
+    const bool hasNormals = !normals.empty();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 lower = _mm_set1_ps(FLT_MAX);
+    __m128 upper = _mm_set1_ps(-FLT_MAX);
+    size_t i = begin;
+#ifdef __AVX__
+    const WideColumns widePointMat(pointMat);
+    const WideColumns wideNormalMat(normalMat);
+    __m256 wideLower = _mm256_set1_ps(FLT_MAX);
+    __m256 wideUpper = _mm256_set1_ps(-FLT_MAX);
+    const __m256 wideOne = _mm256_set1_ps(1.0f);
+    const __m256 wideZero = _mm256_setzero_ps();
+    for (; i + 1 < end; i += 2) {
+        __m256 p = multiply(widePointMat, load3x2(positions[i], positions[i + 1]), wideOne);
+        store3x2(positions[i], positions[i + 1], p);
+        wideLower = _mm256_min_ps(wideLower, p);
+        wideUpper = _mm256_max_ps(wideUpper, p);
+        if (hasNormals) {
+            store3x2(normals[i], normals[i + 1], multiply(wideNormalMat, load3x2(normals[i], normals[i + 1]), wideZero));
+        }
+    }
+    lower = _mm_min_ps(_mm256_castps256_ps128(wideLower), _mm256_extractf128_ps(wideLower, 1));
+    upper = _mm_max_ps(_mm256_castps256_ps128(wideUpper), _mm256_extractf128_ps(wideUpper, 1));
+#endif
+    for (; i < end; ++i) {
+        __m128 p = multiply(pointMat, load3(positions[i]), one);
+        store3(positions[i], p);
+        lower = _mm_min_ps(lower, p);
+        upper = _mm_max_ps(upper, p);
+        if (hasNormals) {
+            store3(normals[i], multiply(normalMat, load3(normals[i]), zero));
+        }
+    }
+    return Box{toVec3(lower), toVec3(upper)};
+}
+#else
+Box boundsRange(StridedView<const vec3> positions, size_t begin, size_t end) {
+    Box box = emptyBox();
+    for (size_t i = begin; i < end; ++i) {
+        box.lower = glm::min(box.lower, positions[i]);
+        box.upper = glm::max(box.upper, positions[i]);
+    }
+    return box;
+}
+
+Box transformRange(StridedView<vec3> positions, StridedView<vec3> normals,
+                   const mat4& T, const mat4& N, size_t begin, size_t end) {
+    Box box = emptyBox();
+    const bool hasNormals = !normals.empty();
+    for (size_t i = begin; i < end; ++i) {
+        positions[i] = vec3(T * vec4(positions[i], 1.0f));
+        box.lower = glm::min(box.lower, positions[i]);
+        box.upper = glm::max(box.upper, positions[i]);
+        if (hasNormals) {
+            normals[i] = vec3(N * vec4(normals[i], 0.0f));
+        }
+    }
+    return box;
+}
+#endif
+}
+
+namespace geometry {
+
+void bounds(StridedView<const vec3> positions, vec3& lower, vec3& upper) {
+    unsigned int chunks = parallel::chunkCount(positions.size(), MIN_CHUNK);
+    std::vector<Box> boxes(chunks, emptyBox());
+    parallel::forChunks(positions.size(), chunks, [&](unsigned int chunk, size_t begin, size_t end) {
+        boxes[chunk] = boundsRange(positions, begin, end);
+    });
+    Box box = emptyBox();
+    for (const Box& b : boxes) {
+        merge(box, b);
+    }
+    lower = box.lower;
+    upper = box.upper;
+}
+
+void transform(StridedView<vec3> positions, StridedView<vec3> normals,
+               const mat4& T, vec3& lower, vec3& upper) {
+    const mat4 normalMat = glm::inverse(glm::transpose(T));
+    unsigned int chunks = parallel::chunkCount(positions.size(), MIN_CHUNK);
+    std::vector<Box> boxes(chunks, emptyBox());
+    parallel::forChunks(positions.size(), chunks, [&](unsigned int chunk, size_t begin, size_t end) {
+        boxes[chunk] = transformRange(positions, normals, T, normalMat, begin, end);
+    });
+    Box box = emptyBox();
+    for (const Box& b : boxes) {
+        merge(box, b);
+    }
+    lower = box.lower;
+    upper = box.upper;
+}
+
+} // namespace geometry
@@ -0,0 +1,35 @@
+#ifndef GEOMETRYKERNELS_H
+#define GEOMETRYKERNELS_H
+
+#include <glm/glm.hpp>
+#include "stridedview.h"
+
+//! The vertex passes of \class Mesh, vectorized and split across the cores.
+/*!
+  They use SSE on x86 (and two vertices per instruction with AVX, when the
+  compiler targets it) with a plain GLM fallback for other CPUs. The matrix
+  products add the terms in the same pairs as GLM 0.9.9 does, so the paths
+  give the same results (unless the compiler fuses the multiplies and adds
+  of the fallback).
+*/
+namespace geometry {
+
+//! Get the axis aligned bounding box of the positions in one pass
+/*!
+  If there are no positions the box is inverted: lower is FLT_MAX and upper
+  is -FLT_MAX in every axis.
+*/
+void bounds(StridedView<const glm::vec3> positions, glm::vec3& lower, glm::vec3& upper);
+
+//! Transform positions (by T) and normals (by its inverse transpose) in a single pass
+/*!
+  The bounding box of the transformed positions is calculated on the way, so
+  there is no need for a second pass. The normals view can be empthy if there
+  are no normals to transform. As before, normals are not re-normalized.
+*/
+void transform(StridedView<glm::vec3> positions, StridedView<glm::vec3> normals,
+               const glm::mat4& T, glm::vec3& lower, glm::vec3& upper);
+
+} // namespace geometry
+
+#endif // GEOMETRYKERNELS_H
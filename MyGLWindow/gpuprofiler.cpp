@@ -0,0 +1,169 @@
+#include "gpuprofiler.h"
+
+#include <algorithm>
+
+GpuProfiler::GpuProfiler() : mGL(nullptr), mFrame(0), mDropped(0) {
+    for (Frame& frame : mFrames) {
+        frame.lastQuery = -1;
+    }
+}
+
+bool GpuProfiler::create(QOpenGLFunctions_4_5_Core* gl) {
+    destroy();
+    mGL = gl;
+    for (Frame& frame : mFrames) {
+        frame.zones.clear();
+        frame.zones.reserve(INITIAL_ZONES);
+        addQueries(frame, INITIAL_ZONES);
+        frame.lastQuery = -1;
+    }
+    mFrame = 0;
+    mZones.clear();
+    mZoneIds.clear();
+    mDropped = 0;
+    return true;
+}
+
+void GpuProfiler::destroy() {
+    if (!mGL) {
+        return;
+    }
+    for (Frame& frame : mFrames) {
+        mGL->glDeleteQueries(GLsizei(frame.queries.size()), frame.queries.data());
+        frame.queries.clear();
+    }
+    mGL = nullptr;
+}
+
+bool GpuProfiler::isCreated() const {
+    return mGL != nullptr;
+}
+
+void GpuProfiler::beginFrame() {
+    if (!isCreated()) {
+        return;
+    }
+    mFrame = (mFrame + 1) % FRAMES;
+    Frame& frame = mFrames[mFrame];
+    collect(frame);
+    frame.zones.clear();
+    frame.lastQuery = -1;
+}
+
+void GpuProfiler::addQueries(Frame& frame, size_t count) {
+    const size_t first = frame.queries.size();
+    frame.queries.resize(first + 2 * count, 0);
+    mGL->glGenQueries(GLsizei(2 * count), frame.queries.data() + first);
+}
+
+void GpuProfiler::collect(Frame& frame) {
+    const std::vector<GLuint>& queries = frame.queries;
+    if (frame.lastQuery < 0) {
+        return;
+    }
+    //The timestamps arrive in order, so if the last one is there all of them are
+    GLint available = 0;
+    mGL->glGetQueryObjectiv(queries[frame.lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        ++mDropped;
+        return;
+    }
+    for (size_t slot = 0; slot < frame.zones.size(); ++slot) {
+        const FrameZone& zone = frame.zones[slot];
+        if (!zone.ended) {
+            continue;
+        }
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        mGL->glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &start);
+        mGL->glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+        //The oldest sample leaves the window
+        ZoneStats& stats = mZones[size_t(zone.zone)];
+        if (stats.count == WINDOW) {
+            stats.sum -= stats.samples[stats.next];
+        } else {
+            ++stats.count;
+        }
+        stats.samples[stats.next] = double(end - start) * 1.0e-6;
+        stats.sum += stats.samples[stats.next];
+        stats.next = (stats.next + 1) % WINDOW;
+    }
+}
+
+int GpuProfiler::findZone(const char* name, int index) {
+    auto found = mZoneIds.insert(std::make_pair(ZoneKey{name, index}, int(mZones.size())));
+    if (!found.second) {
+        return found.first->second;
+    }
+    ZoneStats stats;
+    stats.name = name;
+    stats.index = index;
+    stats.count = 0;
+    stats.next = 0;
+    stats.sum = 0.0;
+    mZones.push_back(stats);
+    return int(mZones.size()) - 1;
+}
+
+int GpuProfiler::beginZone(const char* name, int index) {
+    Frame& frame = mFrames[mFrame];
+    if (!isCreated()) {
+        return -1;
+    }
+    const int slot = int(frame.zones.size());
+    if (frame.queries.size() < 2 * frame.zones.size() + 2) {
+        //Twice as many, so a frame with many zones only grows a few times
+        addQueries(frame, std::max(frame.zones.size(), size_t(INITIAL_ZONES)));
+    }
+    frame.zones.push_back(FrameZone{findZone(name, index), false});
+    frame.lastQuery = 2 * slot;
+    mGL->glQueryCounter(frame.queries[size_t(frame.lastQuery)], GL_TIMESTAMP);
+    return slot;
+}
+
+void GpuProfiler::endZone(int slot) {
+    if (slot < 0 || !isCreated()) {
+        return;
+    }
+    Frame& frame = mFrames[mFrame];
+    frame.zones[size_t(slot)].ended = true;
+    frame.lastQuery = 2 * slot + 1;
+    mGL->glQueryCounter(frame.queries[size_t(frame.lastQuery)], GL_TIMESTAMP);
+}
+
+int GpuProfiler::zoneCount() const {
+    return int(mZones.size());
+}
+
+QString GpuProfiler::zoneName(int zone) const {
+    const ZoneStats& stats = mZones[size_t(zone)];
+    QString name(stats.name);
+    if (stats.index >= 0) {
+        name += " " + QString::number(stats.index);
+    }
+    return name;
+}
+
+double GpuProfiler::average(int zone) const {
+    const ZoneStats& stats = mZones[size_t(zone)];
+    return stats.count > 0 ? stats.sum / stats.count : 0.0;
+}
+
+double GpuProfiler::last(int zone) const {
+    const ZoneStats& stats = mZones[size_t(zone)];
+    return stats.count > 0 ? stats.samples[(stats.next + WINDOW - 1) % WINDOW] : 0.0;
+}
+
+int GpuProfiler::dropped() const {
+    return mDropped;
+}
+
+QString GpuProfiler::report() const {
+    QString lines;
+    for (int zone = 0; zone < zoneCount(); ++zone) {
+        lines += zoneName(zone) + ": " + QString::number(average(zone), 'f', 3) + " ms (last " +
+                 QString::number(last(zone), 'f', 3) + " ms)\n";
+    }
+    lines += "Dropped frames: " + QString::number(dropped()) + "\n";
+    return lines;
+}
@@ -0,0 +1,58 @@
+#include "indirectdrawlist.h"
+
+GLenum IndirectDrawList::indexType(int batch) {
+    return batch == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+DrawMaterial IndirectDrawList::material(const TextureSlot& diffuse, const TextureSlot& specular,
+                                        const QuantizationBox& box) {
+    DrawMaterial material;
+    material.diffuseSlot = glm::vec4(diffuse.offset, diffuse.scale);
+    material.specularSlot = glm::vec4(specular.offset, specular.scale);
+    material.positionOffset = glm::vec4(box.offset, 0.0f);
+    material.positionScale = glm::vec4(box.scale, 0.0f);
+    material.layers[0] = diffuse.array;
+    material.layers[1] = diffuse.layer;
+    material.layers[2] = specular.array;
+    material.layers[3] = specular.layer;
+    return material;
+}
+
+void IndirectDrawList::clear() {
+    //Keep the memmory, the list is filled again every frame
+    for (int batch = 0; batch < BATCH_COUNT; ++batch) {
+        mCommands[batch].clear();
+        mMaterials[batch].clear();
+    }
+}
+
+void IndirectDrawList::add(GLenum indexType, GLsizei count, GLint indexOffset, GLint baseVertex,
+                           const DrawMaterial& material) {
+    const int batch = indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+    const GLuint indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    DrawElementsIndirectCommand command;
+    command.count = GLuint(count);
+    command.instanceCount = 1;
+    //Model packIndices aligns each mesh to the size of its indices
+    command.firstIndex = GLuint(indexOffset) / indexSize;
+    command.baseVertex = baseVertex;
+    command.baseInstance = 0;
+    mCommands[batch].push_back(command);
+    mMaterials[batch].push_back(material);
+}
+
+const std::vector<DrawElementsIndirectCommand>& IndirectDrawList::commands(int batch) const {
+    return mCommands[batch];
+}
+
+const std::vector<DrawMaterial>& IndirectDrawList::materials(int batch) const {
+    return mMaterials[batch];
+}
+
+size_t IndirectDrawList::drawCount() const {
+    size_t count = 0;
+    for (int batch = 0; batch < BATCH_COUNT; ++batch) {
+        count += mCommands[batch].size();
+    }
+    return count;
+}
@@ -0,0 +1,62 @@
+#ifndef INDIRECTDRAWLIST_H
+#define INDIRECTDRAWLIST_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "model.h"
+#include "textureatlas.h"
+#include "vertexquantizer.h"
+
+//! A command of glMultiDrawElementsIndirect, as the GPU reads it from the buffer
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    //! In indices, not in bytes
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+//! What the shaders need of each draw, with the std430 layout of the storage buffer
+struct DrawMaterial {
+    //! Offset in xy and scale in zw of the textures in their layer (See \struct TextureSlot)
+    glm::vec4 diffuseSlot;
+    glm::vec4 specularSlot;
+    //! To decode compact positions (See \struct QuantizationBox), w is padding
+    glm::vec4 positionOffset;
+    glm::vec4 positionScale;
+    //! Array and layer of the diffuse texture, and of the specular one
+    GLint layers[4];
+};
+
+//! The draws of a frame, to submit all of them with glMultiDrawElementsIndirect
+/*!
+  A draw is a range of the indices of a mesh (e.g. a level of detail or a
+  run of visible meshlets) and its \struct DrawMaterial. The draws are kept
+  in one batch per index type, since a multi draw takes only one: the
+  commands of a batch go to the indirect buffer, and its materials to a
+  storage buffer, in the same order, so the shader finds the material of
+  a draw by its gl_DrawID (plus the first draw of its batch).
+*/
+class IndirectDrawList {
+public:
+    //! Batches: GL_UNSIGNED_SHORT indices first, then GL_UNSIGNED_INT
+    static const int BATCH_COUNT = 2;
+    static GLenum indexType(int batch);
+    //! The material of a mesh, where its textures and its quantization box are
+    static DrawMaterial material(const TextureSlot& diffuse, const TextureSlot& specular, const QuantizationBox& box);
+    void clear();
+    //! Add a draw of count indices from indexOffset (in bytes, as in MeshData) of the given type
+    void add(GLenum indexType, GLsizei count, GLint indexOffset, GLint baseVertex, const DrawMaterial& material);
+    const std::vector<DrawElementsIndirectCommand>& commands(int batch) const;
+    const std::vector<DrawMaterial>& materials(int batch) const;
+    //! Draws of all the batches
+    size_t drawCount() const;
+
+private:
+    std::vector<DrawElementsIndirectCommand> mCommands[BATCH_COUNT];
+    std::vector<DrawMaterial> mMaterials[BATCH_COUNT];
+};
+
+#endif // INDIRECTDRAWLIST_H
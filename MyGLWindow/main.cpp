@@ -1,4 +1,5 @@
 #include "meshload.h"
+#include "cpuprofiler.h"
 
 #include <QSurfaceFormat>
 #include <QtGui/QGuiApplication>
@@ -19,10 +20,22 @@ int main(int argc, char* argv[]) {
     format.setVersion(4, 5);
 
     MeshLoad window;
+    //Smaller vertices for the GPU, see VertexQuantizer
+    window.setCompactVertices(app.arguments().contains("--compact"));
+    //One texture per image and a bind per mesh, instead of a texture array (See TextureAtlas)
+    window.setPackTextures(!app.arguments().contains("--no-atlas"));
+    //A draw call per mesh, instead of all of them with glMultiDrawElementsIndirect
+    window.setMultiDrawIndirect(!app.arguments().contains("--no-indirect"));
     window.setFormat(format);
     window.resize(640, 480);
     window.setTitle("Hierachical Mesh Loader");
     window.show();
 
-    return app.exec();
+    int result = app.exec();
+    //Everything the CPU profiler kept, the loading too
+    int trace = app.arguments().indexOf("--trace");
+    if (trace >= 0 && trace + 1 < app.arguments().size()) {
+        CpuProfiler::instance().writeTrace(app.arguments().at(trace + 1));
+    }
+    return result;
 }
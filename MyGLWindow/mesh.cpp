@@ -1,7 +1,14 @@
 #include "mesh.h"
 
 #include <QDebug>
-#include <set>
+#include <algorithm>
+#include <utility>
+
+#include "geometrykernels.h"
+#include "normalgenerator.h"
+#include "overdrawoptimizer.h"
+#include "parallel.h"
+#include "vertexwelder.h"
 
 #define GLM_FORCE_PURE
 #define GLM_FORCE_RADIANS
@@ -13,7 +20,7 @@ using glm::vec3;
 using glm::vec4;
 using glm::mat4;
 
-Mesh::Mesh() : mHasNormals(false), mHasTexture(false) {
+Mesh::Mesh() : mHasNormals(false), mHasTexture(false), mLayout(INTERLEAVED_LAYOUT) {
     mLowerCorner = mUpperCorner = vec3(0.0f);
 }
 
@@ -25,12 +32,187 @@ Mesh::~Mesh() {
 
 }
 
-std::vector<unsigned int> Mesh::getIndices() const {
+const std::vector<unsigned int>& Mesh::getIndices() const {
     return mIndices;
 }
 
+ArrayView<const unsigned int> Mesh::indicesView() const {
+    return ArrayView<const unsigned int>(mIndices);
+}
+
+ArrayView<const Vertex> Mesh::verticesView() const {
+    if (mLayout == SEPARATED_LAYOUT) {
+        return ArrayView<const Vertex>();
+    }
+    return ArrayView<const Vertex>(mVertices);
+}
+
+void Mesh::releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        vertices = std::move(mVertices);
+    } else {
+        vertices = getVertices();
+    }
+    indices = std::move(mIndices);
+    clear();
+}
+
 std::vector<Vertex> Mesh::getVertices() const {
-    return mVertices;
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        return mVertices;
+    }
+    std::vector<Vertex> vertices(vertexCount());
+    interleave(vertices.data());
+    return vertices;
+}
+
+void Mesh::interleave(Vertex* destination) const {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        std::copy(mVertices.begin(), mVertices.end(), destination);
+        return;
+    }
+    parallel::forRange(mPositions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            destination[i].position = mPositions[i];
+            destination[i].normal = mHasNormals ? mNormals[i] : vec3(0.0f);
+            destination[i].textCoords = mHasTexture ? mTextCoords[i] : glm::vec2(0.0f);
+        }
+    });
+}
+
+VertexLayout Mesh::layout() const {
+    return mLayout;
+}
+
+void Mesh::setLayout(VertexLayout layout) {
+    if (layout == mLayout) {
+        return;
+    }
+    if (layout == SEPARATED_LAYOUT) {
+        std::vector<Vertex> vertices;
+        vertices.swap(mVertices);
+        mLayout = SEPARATED_LAYOUT;
+        setVertices(vertices);
+    } else {
+        mVertices = getVertices();
+        mLayout = INTERLEAVED_LAYOUT;
+        mPositions.clear();
+        mPositions.shrink_to_fit();
+        mNormals.clear();
+        mNormals.shrink_to_fit();
+        mTextCoords.clear();
+        mTextCoords.shrink_to_fit();
+    }
+}
+
+void Mesh::setVertices(std::vector<Vertex>& vertices) {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        mVertices.swap(vertices);
+        vertices.clear();
+        return;
+    }
+    //Only the attributes that the mesh has get a stream
+    mVertices.clear();
+    mPositions.resize(vertices.size());
+    mNormals.resize(mHasNormals ? vertices.size() : 0);
+    mTextCoords.resize(mHasTexture ? vertices.size() : 0);
+    parallel::forRange(vertices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            mPositions[i] = vertices[i].position;
+            if (mHasNormals) {
+                mNormals[i] = vertices[i].normal;
+            }
+            if (mHasTexture) {
+                mTextCoords[i] = vertices[i].textCoords;
+            }
+        }
+    });
+    std::vector<Vertex>().swap(vertices);
+}
+
+void Mesh::resizeVertices(size_t count) {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        mVertices.resize(count);
+    } else {
+        mPositions.resize(count);
+        mNormals.resize(mHasNormals ? count : 0);
+        mTextCoords.resize(mHasTexture ? count : 0);
+    }
+}
+
+void Mesh::copyVertex(size_t from, size_t to) {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        mVertices[to] = mVertices[from];
+    } else {
+        mPositions[to] = mPositions[from];
+        if (mHasNormals) {
+            mNormals[to] = mNormals[from];
+        }
+        if (mHasTexture) {
+            mTextCoords[to] = mTextCoords[from];
+        }
+    }
+}
+
+namespace {
+//Move element i of the view to remap[i]
+template <typename T>
+void permute(StridedView<T> view, const std::vector<unsigned int>& remap) {
+    std::vector<T> old(view.size());
+    for (size_t i = 0; i < old.size(); ++i) {
+        old[i] = view[i];
+    }
+    for (size_t i = 0; i < old.size(); ++i) {
+        view[remap[i]] = old[i];
+    }
+}
+}
+
+void Mesh::reorderVertices(size_t first, const std::vector<unsigned int>& remap) {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        permute(StridedView<Vertex>(mVertices.data() + first, remap.size()), remap);
+        return;
+    }
+    permute(positionView().slice(first, remap.size()), remap);
+    if (mHasNormals) {
+        permute(normalView().slice(first, remap.size()), remap);
+    }
+    if (mHasTexture) {
+        permute(textCoordView().slice(first, remap.size()), remap);
+    }
+}
+
+StridedView<vec3> Mesh::positionView() {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        return StridedView<vec3>(mVertices.empty() ? nullptr : &mVertices[0].position, mVertices.size(), sizeof(Vertex));
+    }
+    return StridedView<vec3>(mPositions.data(), mPositions.size());
+}
+
+StridedView<const vec3> Mesh::positionView() const {
+    return const_cast<Mesh*>(this)->positionView();
+}
+
+StridedView<vec3> Mesh::normalView() {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        return StridedView<vec3>(mVertices.empty() ? nullptr : &mVertices[0].normal, mVertices.size(), sizeof(Vertex));
+    }
+    return StridedView<vec3>(mNormals.data(), mNormals.size());
+}
+
+StridedView<const vec3> Mesh::normalView() const {
+    return const_cast<Mesh*>(this)->normalView();
+}
+
+StridedView<glm::vec2> Mesh::textCoordView() {
+    if (mLayout == INTERLEAVED_LAYOUT) {
+        return StridedView<glm::vec2>(mVertices.empty() ? nullptr : &mVertices[0].textCoords, mVertices.size(), sizeof(Vertex));
+    }
+    return StridedView<glm::vec2>(mTextCoords.data(), mTextCoords.size());
+}
+
+StridedView<const glm::vec2> Mesh::textCoordView() const {
+    return const_cast<Mesh*>(this)->textCoordView();
 }
 
 bool Mesh::loadFromFile(const QString& fileName) {
@@ -97,86 +279,55 @@ bool Mesh::loadFromFile(const QString& fileName) {
         addTexture(material);
     }
 
+    if (mLayout == SEPARATED_LAYOUT) {
+        std::vector<Vertex> vertices;
+        vertices.swap(mVertices);
+        setVertices(vertices);
+    }
     updateBoundingBox();
     return true;
 }
 
 bool Mesh::loadVerticesAndIndices(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, bool normals, bool textCoords) {
 
-    if (vertices.empty()) {
-        return false;
-    } else {
-        mVertices = vertices;
-    }
-
-    if (indices.empty()) {
+    if (vertices.empty() || indices.empty()) {
         return false;
-    } else {
-        mIndices = indices;
     }
 
+    mIndices = indices;
     mHasNormals = normals;
     mHasTexture = textCoords;
+    std::vector<Vertex> copy(vertices);
+    setVertices(copy);
 
     updateBoundingBox();
     return true;
 }
 
-bool Mesh::loadFromTriangles(const std::vector<Triangle>& triangles) {
-
-    auto lessThan = [](const vec3& a, const vec3& b){
-        //Two vertex positions that are less than square root of EPSILON
-        //apart are consider the same vertex
-        const float EPSILON = 0.00000001f;  // sqrt(EPSILON) = 0.0001
-        //check equality
-        if (glm::length2(a - b) < EPSILON) {
-            return false;
-        }
-        //Lexicographical order
-        if (glm::abs(a.x - b.x) > EPSILON) {
-            return a.x < b.x;
-        } else if (glm::abs(a.y - b.y) > EPSILON) {
-            return a.y < b.y;
-        } else {
-            return a.z < b.z;
-        }
-    };
-    //This set will be used to get rid of the duplicate vertex
-    std::set<vec3, decltype(lessThan)> tmpStorage(lessThan);
+bool Mesh::loadFromTriangles(const std::vector<Triangle>& triangles, float tolerance) {
     //Clear the previous data in the indices and points arrays, since we are about to start a new indexing
-    mIndices.clear();
-    mVertices.clear();
-    //Insert all the vertex in the tmp_storage
-    for (auto t : triangles) {
-        tmpStorage.insert(t.p0);
-        tmpStorage.insert(t.p1);
-        tmpStorage.insert(t.p2);
-    }
-
-    //Insert index for the vertices
-    for (auto t : triangles) {
-        // First vertex of triangle
-        auto it = tmpStorage.find(t.p0);
-        auto index = std::distance(tmpStorage.begin(), it);
-        mIndices.push_back(static_cast<unsigned int>(index));
-        // Second
-        it = tmpStorage.find(t.p1);
-        index = std::distance(tmpStorage.begin(), it);
-        mIndices.push_back(static_cast<unsigned int>(index));
-        // Third
-        it = tmpStorage.find(t.p2);
-        index = std::distance(tmpStorage.begin(), it);
-        mIndices.push_back(static_cast<unsigned int>(index));
-    }
-
-    //Create the Vertex storage
-    Vertex tmpVertex;
-    for (auto position : tmpStorage) {
-        tmpVertex.position = position;
-        mVertices.push_back(tmpVertex);
-    }
-
+    clear();
+    //A vector of triangles is just a vector of corners (three per triangle)
+    static_assert(sizeof(Triangle) == 3 * sizeof(vec3), "Triangle must be three packed vec3");
+    const vec3* corners = triangles.empty() ? nullptr : &triangles[0].p0;
+    std::vector<vec3> positions;
+    VertexWelder welder(tolerance);
+    welder.weld(corners, 3 * triangles.size(), positions, mIndices);
+
+    //Create the Vertex storage, in the separated layout the positions are all we need
     mHasNormals = mHasTexture = false;
+    if (mLayout == SEPARATED_LAYOUT) {
+        mPositions.swap(positions);
+    } else {
+        mVertices.resize(positions.size());
+        parallel::forRange(positions.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                mVertices[i].position = positions[i];
+                mVertices[i].normal = vec3(0.0f);
+                mVertices[i].textCoords = glm::vec2(0.0f);
+            }
+        });
+    }
 
     updateBoundingBox();
     return true;
@@ -184,7 +335,7 @@ bool Mesh::loadFromTriangles(const std::vector<Triangle>& triangles) {
 }
 
 bool Mesh::empthy() const {
-    return mVertices.empty();
+    return vertexCount() == 0;
 }
 
 bool Mesh::hasTexture() const {
@@ -197,25 +348,58 @@ bool Mesh::hasNormals() const {
 
 void Mesh::clear() {
     mVertices.clear();
+    mPositions.clear();
+    mNormals.clear();
+    mTextCoords.clear();
     mIndices.clear();
     mHasNormals = mHasTexture = false;
     mLowerCorner = mUpperCorner = vec3(0.0f);
 }
 
 void Mesh::transform(const mat4& T) {
+    //Positions, normals and the new bounding box in a single pass
+    StridedView<vec3> normals = mHasNormals ? normalView() : StridedView<vec3>();
+    geometry::transform(positionView(), normals, T, mLowerCorner, mUpperCorner);
+}
 
-    for (auto& v : mVertices) {
-        v.position = vec3(T * vec4(v.position, 1.0f));
+void Mesh::recalculateNormals(NormalWeighting weighting, float creaseAngle) {
+    NormalGenerator generator(weighting, creaseAngle);
+    std::vector<vec3> normals;
+    std::vector<unsigned int> copies;
+    generator.generate(positionView(), mIndices, normals, copies);
+    //The vertices split by the crease angle go at the end
+    size_t count = vertexCount();
+    mHasNormals = true;
+    resizeVertices(count + copies.size());
+    for (size_t i = 0; i < copies.size(); ++i) {
+        copyVertex(copies[i], count + i);
     }
+    StridedView<vec3> normalStream = normalView();
+    for (size_t i = 0; i < normals.size(); ++i) {
+        normalStream[i] = normals[i];
+    }
+    mHasNormals = !empthy();
+}
 
-    if (mHasNormals) {
-        mat4 normalMat = glm::inverse(glm::transpose(T));
-        for (auto& v : mVertices) {
-            v.normal = vec3(normalMat * vec4(v.normal, 0.0f));
-        }
+VertexCacheReport Mesh::optimizeVertexCache(unsigned int cacheSize, float overdrawThreshold) {
+    VertexCacheOptimizer optimizer(cacheSize);
+    VertexCacheReport report;
+    report.before = optimizer.analyze(mIndices.data(), mIndices.size(), vertexCount());
+    optimizer.reorderTriangles(mIndices.data(), mIndices.size(), vertexCount());
+    if (overdrawThreshold >= 1.0f) {
+        OverdrawOptimizer overdraw(overdrawThreshold, cacheSize);
+        overdraw.reorderTriangles(mIndices.data(), mIndices.size(), positionView());
     }
+    std::vector<unsigned int> remap;
+    optimizer.reorderVertices(mIndices.data(), mIndices.size(), vertexCount(), remap);
+    reorderVertices(0, remap);
+    report.after = optimizer.analyze(mIndices.data(), mIndices.size(), vertexCount());
+    return report;
+}
 
-    updateBoundingBox();
+VertexCacheStats Mesh::vertexCacheStats(unsigned int cacheSize) const {
+    VertexCacheOptimizer optimizer(cacheSize);
+    return optimizer.analyze(mIndices.data(), mIndices.size(), vertexCount());
 }
 
 void Mesh::toUnitCube() {
@@ -242,6 +426,14 @@ vec3 Mesh::getBBSize() const {
     return mUpperCorner - mLowerCorner;
 }
 
+vec3 Mesh::getBBLowerCorner() const {
+    return mLowerCorner;
+}
+
+vec3 Mesh::getBBUpperCorner() const {
+    return mUpperCorner;
+}
+
 size_t Mesh::trianglesCount() const {
     return mIndices.size() / 3;
 }
@@ -251,7 +443,7 @@ size_t Mesh::indicesCount() const {
 }
 
 size_t Mesh::vertexCount() const {
-    return mVertices.size();
+    return mLayout == INTERLEAVED_LAYOUT ? mVertices.size() : mPositions.size();
 }
 
 bool Mesh::save(const QString& fileName) const {
@@ -277,25 +469,27 @@ bool Mesh::save(const QString& fileName) const {
     //Get handle
     auto meshPtr = scene->mMeshes[0];
     //Allocate space for vertex data
-    meshPtr->mVertices = new aiVector3D[mVertices.size()];
+    const size_t count = vertexCount();
+    meshPtr->mVertices = new aiVector3D[count];
     if (mHasNormals) {
-        meshPtr->mNormals = new aiVector3D[mVertices.size()];
-        meshPtr->mNumVertices = static_cast<unsigned int>(mVertices.size());
+        meshPtr->mNormals = new aiVector3D[count];
+        meshPtr->mNumVertices = static_cast<unsigned int>(count);
     }
     if (mHasTexture) {
-        meshPtr->mTextureCoords[0] = new aiVector3D[mVertices.size()];
-        meshPtr->mNumUVComponents[0] = static_cast<unsigned int>(mVertices.size());
+        meshPtr->mTextureCoords[0] = new aiVector3D[count];
+        meshPtr->mNumUVComponents[0] = static_cast<unsigned int>(count);
     }
-    //Fill vertex data
-    Vertex v;
-    for (size_t i = 0; i < mVertices.size(); ++i) {
-        v = mVertices[i];
-        meshPtr->mVertices[i] = aiVector3D(v.position.x, v.position.y, v.position.z);
+    //Fill vertex data (the same way for both layouts)
+    StridedView<const vec3> positions = positionView();
+    StridedView<const vec3> normals = normalView();
+    StridedView<const glm::vec2> textCoords = textCoordView();
+    for (size_t i = 0; i < count; ++i) {
+        meshPtr->mVertices[i] = aiVector3D(positions[i].x, positions[i].y, positions[i].z);
         if (mHasNormals) {
-            meshPtr->mNormals[i] = aiVector3D(v.normal.x, v.normal.y, v.normal.z);
+            meshPtr->mNormals[i] = aiVector3D(normals[i].x, normals[i].y, normals[i].z);
         }
         if (mHasTexture) {
-            meshPtr->mTextureCoords[0][i] = aiVector3D(v.textCoords.s, v.textCoords.t, 0);
+            meshPtr->mTextureCoords[0][i] = aiVector3D(textCoords[i].s, textCoords[i].t, 0);
         }
     }
 
@@ -322,16 +516,7 @@ bool Mesh::save(const QString& fileName) const {
 }
 
 void Mesh::updateBoundingBox() {
-
-    mLowerCorner = FLT_MAX * vec3(1.0f);
-    mUpperCorner = -FLT_MAX * vec3(1.0f);
-
-    for (auto v : mVertices) {
-        //Check if this vertex changes the bounding box
-        mUpperCorner = glm::max(v.position, mUpperCorner);
-        mLowerCorner = glm::min(v.position, mLowerCorner);
-    }
-
+    geometry::bounds(positionView(), mLowerCorner, mUpperCorner);
 }
 
 void Mesh::addTexture(const aiMaterial* mat) {
@@ -4,6 +4,10 @@
 #include <QString>
 #include <glm/glm.hpp>
 
+#include "arrayview.h"
+#include "stridedview.h"
+#include "vertexcacheoptimizer.h"
+
 #include <assimp/IOSystem.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/Exporter.hpp>
@@ -32,6 +36,26 @@ struct Triangle {
     glm::vec3 p1;
     glm::vec3 p2;
 };
+//! How the triangles around a vertex are weighted when calculating its normal
+/*!
+  UNIFORM_WEIGHTS gives the same weight to every triangle, AREA_WEIGHTS
+  weights them by their area and ANGLE_WEIGHTS by the angle that they have
+  at the vertex (the most robust to irregular tessellations).
+*/
+enum NormalWeighting {UNIFORM_WEIGHTS, AREA_WEIGHTS, ANGLE_WEIGHTS};
+//! How a \class Mesh stores its vertices in main memmory
+/*!
+  INTERLEAVED_LAYOUT (the default) keeps an array of \struct Vertex, which is
+  exactly what the GPU receives. SEPARATED_LAYOUT keeps one array (stream)
+  per attribute: positions, normals and texture coordinates. The streams of
+  the attributes that the mesh does not have are not even allocated.
+
+  The separated layout makes the passes that only touch positions (transform,
+  bounding box, unit cube, normals generation) read a third of the memmory.
+  The interleaved vertices are then assembled only when they are requested
+  (See getVertices and interleave), usually just before the upload to the GPU.
+*/
+enum VertexLayout {INTERLEAVED_LAYOUT, SEPARATED_LAYOUT};
 //! A class  that can be used to load a \class Mesh from file and do basic operations with it
 /*!
   This class only deals with simple model that contain just a single mesh. If you
@@ -51,13 +75,34 @@ class Mesh {
 protected:
     bool mHasNormals;
     bool mHasTexture;
+    VertexLayout mLayout;
+    //Vertices in the interleaved layout
     std::vector<Vertex> mVertices;
+    //Vertices in the separated layout (one stream per attribute)
+    std::vector<glm::vec3> mPositions;
+    std::vector<glm::vec3> mNormals;
+    std::vector<glm::vec2> mTextCoords;
     std::vector<unsigned int> mIndices;
     glm::vec3 mUpperCorner;
     glm::vec3 mLowerCorner;
     std::string mDiffuseText;
     void updateBoundingBox();
     void addTexture(const aiMaterial* mat);
+    //! Replace all the vertices, storing them in the current layout (vertices is left empthy)
+    void setVertices(std::vector<Vertex>& vertices);
+    //! Change the number of vertices, in the current layout
+    void resizeVertices(size_t count);
+    //! Copy all the attributes of the vertex from into the vertex to
+    void copyVertex(size_t from, size_t to);
+    //! Move the vertex first + i to first + remap[i], for all the remap
+    void reorderVertices(size_t first, const std::vector<unsigned int>& remap);
+    //! Views of each attribute that work with both layouts
+    StridedView<glm::vec3> positionView();
+    StridedView<const glm::vec3> positionView() const;
+    StridedView<glm::vec3> normalView();
+    StridedView<const glm::vec3> normalView() const;
+    StridedView<glm::vec2> textCoordView();
+    StridedView<const glm::vec2> textCoordView() const;
 public:
     //! Simple constructor that does nothing.
     /*!
@@ -71,7 +116,12 @@ public:
       give you the date you will need to render it.
     */
     explicit Mesh(const QString& fileName);
-    ~Mesh();
+    virtual ~Mesh();
+    //! A Mesh can be moved (without copying its arrays) and copied.
+    Mesh(Mesh&& other) = default;
+    Mesh& operator=(Mesh&& other) = default;
+    Mesh(const Mesh& other) = default;
+    Mesh& operator=(const Mesh& other) = default;
     //! Erases the data and then load a new \class Mesh form the file.
     bool loadFromFile(const QString& fileName);
     //! Queries if this Mesh has no data.
@@ -82,20 +132,62 @@ public:
     bool hasNormals() const;
     //! Release the memmory on this Mesh
     void clear();
+    //! Queries how this Mesh stores its vertices in main memmory
+    VertexLayout layout() const;
+    //! Change how this Mesh stores its vertices, converting the current ones
+    /*!
+      The layout is kept by the load functions. So, calling it on an empthy
+      Mesh makes all the following loads go straight to that layout.
+    */
+    void setLayout(VertexLayout layout);
+    //! Write all the vertices, in the interleaved format, into destination
+    /*!
+      The destination needs room for vertexCount() vertices. It can be the
+      memmory of a mapped GPU buffer, so a Mesh in the separated layout is
+      interleaved exactly once: while it is uploaded.
+    */
+    void interleave(Vertex* destination) const;
     //! Transform all the vertices of the mesh by T
     void transform(const glm::mat4& T);
     //! Center and scale this Mesh. So it if thigly contained by a unit cube
     //! center at the origin.
     void toUnitCube();
-    //! Not yet implemented!
-    void recalculateNormals();
+    //! Calculate (and replace) the normal vectors of all the vertices
+    /*!
+      The normal of each vertex is the weighted average of the normals of
+      the triangles that share it. If a creaseAngle (in degrees) smaller than
+      180 is given, the triangles that meet at an angle bigger than it are not
+      smoothed together. Instead, the shared vertex is duplicated so the edge
+      looks sharp. See \class NormalGenerator for the details.
+    */
+    virtual void recalculateNormals(NormalWeighting weighting = ANGLE_WEIGHTS, float creaseAngle = 180.0f);
+    //! Reorder the triangles and then the vertices to render this Mesh faster
+    /*!
+      The triangles are reordered so the GPU post-transform cache reuses more
+      vertices, and the vertices in the order that the triangles use them.
+      The geometry does not change, only the order of the arrays. See
+      \class VertexCacheOptimizer. The returned report has the ACMR and ATVR
+      of the mesh before and after.
+
+      If an overdrawThreshold (of at least 1) is given, the triangles are also
+      sorted so the outer surface is drawn first, which reduces the shaded
+      fragments. In exchange, each group of triangles that is moved can have
+      an ACMR up to overdrawThreshold times the one of the whole mesh. See
+      \class OverdrawOptimizer.
+    */
+    virtual VertexCacheReport optimizeVertexCache(unsigned int cacheSize = VertexCacheOptimizer::DEFAULT_CACHE_SIZE,
+                                                  float overdrawThreshold = 0.0f);
+    //! Measure how well the current indices use a post-transform cache of cacheSize
+    virtual VertexCacheStats vertexCacheStats(unsigned int cacheSize = VertexCacheOptimizer::DEFAULT_CACHE_SIZE) const;
     //! get the indices needed for glElementDraw* commands in a vector
     /*!
       One of the important interface functions. Since Model always stores data
       as an indexed array. This will give you an array with the indexes that you
       can use it to draw if you bound a corresponding VBO (See getVertices)
     */
-    std::vector<unsigned int> getIndices() const;
+    const std::vector<unsigned int>& getIndices() const;
+    //! A view of the indices, without copying them (See \class ArrayView)
+    ArrayView<const unsigned int> indicesView() const;
     //! get the vertices needed to create a VBO for getiing this mesh into the GPU
     /*!
       One of the important interface functions. Since Mesh always stores data
@@ -105,8 +197,24 @@ public:
 
       Remember that the Mesh is always a triangular mesh so the number of
       indices is number of triangles times three
+
+      It works with both layouts, in the separated one the vertices are
+      interleaved on the fly.
     */
     std::vector<Vertex> getVertices() const;
+    //! A view of the interleaved vertices, without copying them
+    /*!
+      Use it to pass the vertices straight to the GPU buffer. It is only
+      available in the interleaved layout, in the separated one the view is
+      empthy and you should use interleave instead.
+    */
+    ArrayView<const Vertex> verticesView() const;
+    //! Move the vertices and indices out of this Mesh, which is left empthy
+    /*!
+      It is the cheapest way to take the data: the arrays are handed over,
+      not copied. The vertices are interleaved first if needed.
+    */
+    void releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
     //! Clear and cretes a new Mesh using the data provided
     /*!
       Recreates the object by providing data. The Mesh are indexed, so they
@@ -122,12 +230,12 @@ public:
       you can provide a set of triangles. The format of the triangles is fixed
 
       In order to create an indexed mesh for triangles, the Mesh will join all
-      the vertex that are DELTA apart and will consider them the same vertex.
-      This tends to create smoth meshes.
+      the vertex that are less than tolerance apart and will consider them the
+      same vertex (See \class VertexWelder). This tends to create smoth meshes.
 
       It will produce a mesh witout normal nor texture coordinates.
     */
-    bool loadFromTriangles(const std::vector<Triangle>& triangles);
+    bool loadFromTriangles(const std::vector<Triangle>& triangles, float tolerance = 0.0001f);
     //! Calculate the scale factor tha will make this an
     /*!
       Recreates the object by providing data. Since the mesh is triangulated
@@ -144,6 +252,9 @@ public:
     glm::vec3 getBBCenter() const;
     //! Get the lenght for the sides of an axis aligned bounding box
     glm::vec3 getBBSize() const;
+    //! Get the corners (minimum and maximum) of the axis aligned bounding box
+    glm::vec3 getBBLowerCorner() const;
+    glm::vec3 getBBUpperCorner() const;
     //! Get the number of triangles in this Mesh
     size_t trianglesCount() const;
     //! Get the number of indices in this Mesh (Three per triangle)
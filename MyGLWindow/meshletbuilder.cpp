@@ -0,0 +1,140 @@
+#include "meshletbuilder.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+
+namespace {
+//Bounds of the triangles [first, first + count) of indices
+void computeBounds(const unsigned int* indices, size_t count, StridedView<const vec3> positions, Meshlet& meshlet) {
+    vec3 lower(FLT_MAX);
+    vec3 upper(-FLT_MAX);
+    vec3 normalSum(0.0f);
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        const vec3& p0 = positions[indices[i]];
+        const vec3& p1 = positions[indices[i + 1]];
+        const vec3& p2 = positions[indices[i + 2]];
+        lower = glm::min(lower, glm::min(p0, glm::min(p1, p2)));
+        upper = glm::max(upper, glm::max(p0, glm::max(p1, p2)));
+        vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length > 0.0f) {
+            normalSum += n / length;
+        }
+    }
+    meshlet.center = 0.5f * (lower + upper);
+    meshlet.radius = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        meshlet.radius = glm::max(meshlet.radius, glm::distance(meshlet.center, positions[indices[i]]));
+    }
+    //The axis is the average normal, and the cone opens to the farthest normal
+    float length = glm::length(normalSum);
+    meshlet.coneAxis = length > 0.0f ? normalSum / length : vec3(0.0f, 0.0f, 1.0f);
+    float minCos = length > 0.0f ? 1.0f : -1.0f;
+    for (size_t i = 0; i + 2 < count; i += 3) {
+        const vec3& p0 = positions[indices[i]];
+        vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float l = glm::length(n);
+        if (l > 0.0f) {
+            minCos = glm::min(minCos, glm::dot(meshlet.coneAxis, n / l));
+        }
+    }
+    meshlet.coneCos = glm::clamp(minCos, -1.0f, 1.0f);
+    meshlet.coneSin = glm::sqrt(1.0f - meshlet.coneCos * meshlet.coneCos);
+}
+}
+
+MeshletBuilder::MeshletBuilder(unsigned int maxVertices, unsigned int maxTriangles) :
+    mMaxVertices(std::max(maxVertices, 3u)), mMaxTriangles(std::max(maxTriangles, 1u)) {
+}
+
+void MeshletBuilder::build(const unsigned int* indices, size_t indexCount, StridedView<const vec3> positions,
+                           std::vector<Meshlet>& meshlets) const {
+    //The meshlet that last used each vertex, so it is only counted once per meshlet
+    std::vector<size_t> usedBy(positions.size(), ~size_t(0));
+    size_t meshletId = 0;
+    size_t first = 0;
+    unsigned int vertices = 0;
+    auto close = [&](size_t end) {
+        Meshlet meshlet;
+        meshlet.firstIndex = static_cast<int>(first);
+        meshlet.howMany = static_cast<int>(end - first);
+        computeBounds(indices + first, end - first, positions, meshlet);
+        meshlets.push_back(meshlet);
+        first = end;
+        vertices = 0;
+        ++meshletId;
+    };
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        unsigned int newVertices = 0;
+        for (size_t c = 0; c < 3; ++c) {
+            newVertices += usedBy[indices[t + c]] != meshletId ? 1 : 0;
+        }
+        if (vertices + newVertices > mMaxVertices || (t - first) / 3 >= mMaxTriangles) {
+            close(t);
+            newVertices = 3;
+        }
+        for (size_t c = 0; c < 3; ++c) {
+            usedBy[indices[t + c]] = meshletId;
+        }
+        vertices += newVertices;
+    }
+    if (indexCount - indexCount % 3 > first) {
+        close(indexCount - indexCount % 3);
+    }
+}
+
+MeshletCuller::MeshletCuller() : mEye(0.0f) {
+    setView(mat4(1.0f), vec3(0.0f));
+}
+
+void MeshletCuller::setView(const mat4& PVM, const vec3& eye) {
+    mEye = eye;
+    //Gribb and Hartmann: each plane is the last row of the matrix plus or minus another row
+    vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = vec4(PVM[0][i], PVM[1][i], PVM[2][i], PVM[3][i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        mPlanes[2 * i] = rows[3] + rows[i];
+        mPlanes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (vec4& plane : mPlanes) {
+        float length = glm::length(vec3(plane));
+        if (length > 0.0f) {
+            plane = plane / length;
+        }
+    }
+}
+
+bool MeshletCuller::outsideFrustum(const Meshlet& meshlet) const {
+    for (const vec4& plane : mPlanes) {
+        if (glm::dot(vec3(plane), meshlet.center) + plane.w < -meshlet.radius) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MeshletCuller::backFacing(const Meshlet& meshlet) const {
+    //A triangle faces away if dot(n, p - eye) > 0. From the center, the
+    //smallest of those is cos(angle to the axis + cone angle) times the distance,
+    //and any point of the sphere takes at most the radius out of it
+    vec3 view = meshlet.center - mEye;
+    float distance = glm::length(view);
+    //A cone of more than 90 degrees always has a normal towards the camera
+    if (meshlet.coneCos <= 0.0f || distance <= meshlet.radius) {
+        return false;
+    }
+    float cosAngle = glm::dot(view, meshlet.coneAxis) / distance;
+    float sinAngle = glm::sqrt(glm::max(0.0f, 1.0f - cosAngle * cosAngle));
+    float minCos = cosAngle * meshlet.coneCos - sinAngle * meshlet.coneSin;
+    return distance * minCos > meshlet.radius;
+}
+
+bool MeshletCuller::visible(const Meshlet& meshlet) const {
+    return !outsideFrustum(meshlet) && !backFacing(meshlet);
+}
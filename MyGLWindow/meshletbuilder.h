@@ -0,0 +1,75 @@
+#ifndef MESHLETBUILDER_H
+#define MESHLETBUILDER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "stridedview.h"
+
+//! A small cluster of consecutive triangles of a mesh, with its bounds
+/*!
+  The triangles of a meshlet are a range of the indices of its mesh, so it
+  is drawn with the index buffer of the mesh (See \class MeshletCuller).
+*/
+struct Meshlet {
+    //! Place of the first index of this meshlet, counted from the first index of its mesh
+    int firstIndex;
+    //! Number of indexes in this meshlet
+    int howMany;
+    //! Bounding sphere of the triangles
+    glm::vec3 center;
+    float radius;
+    //! Cone that contains the normals of all the triangles: its axis and half angle
+    glm::vec3 coneAxis;
+    float coneCos;
+    float coneSin;
+};
+
+//! A class that splits the triangles of a mesh into meshlets.
+/*!
+  The triangles are taken in their current order, and a new meshlet starts
+  when the next triangle would need more than maxVertices different
+  vertices or maxTriangles triangles. So the index buffer does not change.
+  After \class Mesh optimizeVertexCache the triangles go around vertices,
+  so the consecutive triangles are close to each other and face similar
+  directions, which keeps the spheres and the cones tight.
+*/
+class MeshletBuilder {
+public:
+    static const unsigned int DEFAULT_MAX_VERTICES = 64;
+    static const unsigned int DEFAULT_MAX_TRIANGLES = 124;
+    explicit MeshletBuilder(unsigned int maxVertices = DEFAULT_MAX_VERTICES,
+                            unsigned int maxTriangles = DEFAULT_MAX_TRIANGLES);
+    //! Append the meshlets of a mesh (its indices index positions) to meshlets
+    void build(const unsigned int* indices, size_t indexCount, StridedView<const glm::vec3> positions,
+               std::vector<Meshlet>& meshlets) const;
+
+private:
+    unsigned int mMaxVertices;
+    unsigned int mMaxTriangles;
+};
+
+//! A class that decides which meshlets need to be drawn from a camera.
+/*!
+  A meshlet is skipped if its bounding sphere is outside the view frustum,
+  or if the camera is behind all of its triangles: every normal in the cone
+  points away from the camera, for any point of the sphere. Back face
+  culling would discard those triangles anyway, but only after the vertex
+  shader ran for them.
+*/
+class MeshletCuller {
+public:
+    MeshletCuller();
+    //! Cull in model space: PVM is the whole transformation and eye the camera in model space
+    void setView(const glm::mat4& PVM, const glm::vec3& eye);
+    bool outsideFrustum(const Meshlet& meshlet) const;
+    bool backFacing(const Meshlet& meshlet) const;
+    //! Queries if any triangle of the meshlet can be seen
+    bool visible(const Meshlet& meshlet) const;
+
+private:
+    //! Frustum planes (normalized), the inside is where dot(xyz, p) + w >= 0
+    glm::vec4 mPlanes[6];
+    glm::vec3 mEye;
+};
+
+#endif // MESHLETBUILDER_H
@@ -1,9 +1,15 @@
 #include "meshload.h"
 #include "model.h"
+#include "assetmanager.h"
+#include "cpuprofiler.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <QString>
 #include <QtGui/QScreen>
 #include <QFileInfo>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
 
 using glm::vec3;
 using glm::mat4;
@@ -14,11 +20,23 @@ using glm::rotate;
 using glm::scale;
 using glm::radians;
 
-MeshLoad::MeshLoad() : mNanoseconds(0), mGLProgPtr(nullptr), mFrame(0) {
+MeshLoad::MeshLoad() : mGLProgPtr(nullptr), mFrame(0), mUnitCube(1.0f),
+                       mSphereCenter(0.0f), mSphereRadius(0.0f) {
     richText(false);
     mAlpha = 1.5f;
     mRotating = false;
+    mCompactVertices = false;
+    mPackTextures = true;
+    mIndirect = true;
+    mUseLods = true;
+    mLodPixelError = 1.0f;
+    mCullMeshlets = true;
+    mLogPicks = false;
+    mGeometryReady = false;
+    mLoadFailed = false;
+    mPendingImages = 0;
     mModelFolder = "../models/Nyra/";
+    mModelFile = mModelFolder + "Nyra_pose.obj";
 }
 
 MeshLoad::~MeshLoad() {
@@ -27,6 +45,24 @@ MeshLoad::~MeshLoad() {
     tearDownGL();
 }
 
+void MeshLoad::setCompactVertices(bool compact) {
+    mCompactVertices = compact;
+}
+
+void MeshLoad::setPackTextures(bool pack) {
+    mPackTextures = pack;
+}
+
+void MeshLoad::setMultiDrawIndirect(bool indirect) {
+    mIndirect = indirect;
+}
+
+void MeshLoad::setModelFile(const QString& fileName) {
+    mModelFile = fileName;
+    //The textures are looked for next to it
+    mModelFolder = QFileInfo(fileName).path() + "/";
+}
+
 void MeshLoad::tearDownGL() {
     //Release GPU memmory
     mVertexBuffer.destroy();
@@ -37,44 +73,206 @@ void MeshLoad::tearDownGL() {
         delete mGLProgPtr;
     }
     //Release more GPU memmory (textures)
-    for (int i = 0; i < mTextPtr.length(); ++i) {
-        if (mTextPtr[i]) {
-            delete mTextPtr[i];
-        }
+    mTextPtr.clear();
+    mTextures.clear();
+    for (QOpenGLTexture* textureArray : mTextureArrays) {
+        delete textureArray;
     }
+    mTextureArrays.clear();
+    mRing.destroy();
+    mGpuProfiler.destroy();
     //Stop logging in this context
     stopLog();
 }
 
 void MeshLoad::createGeometry() {
-    mVertices.clear();
-    mIndexes.clear();
+    PROFILE_ZONE("createGeometry");
     /*This is the code that we are testing, we load a model
-     * that consist of several Meshes and textures into memmory CPU*/
-    Model model(mModelFolder + "Nyra_pose.obj");
-    model.toUnitCube();
-    std::vector<MeshData> sep = model.getSeparators();
-    mSeparators = QVector<MeshData>(sep.begin(), sep.end());
-    std::vector<unsigned int> indices = model.getIndices();
-    mIndexes = QVector<unsigned int>(indices.begin(), indices.end());
-    std::vector<Vertex> vertices = model.getVertices();
-    mVertices = QVector<Vertex>(vertices.begin(), vertices.end());
+     * that consist of several Meshes and textures into memmory CPU.
+     * The asset manager loaded it in a worker thread, only the first run
+     * imports it with Assimp, then it is mapped from the geometry cache*/
+    const ModelGeometry& model = mModel.get();
+    vec3 lower = model.lowerCorner();
+    vec3 upper = model.upperCorner();
+    //They say where the packed indices of each mesh are
+    mSeparators.assign(model.separators().begin(), model.separators().end());
+    mMeshlets.assign(model.meshlets().begin(), model.meshlets().end());
+    findMaterials(model);
+    //Same transformation as Mesh::toUnitCube, but in the model matrix.
+    //So the vertices can go to the GPU untouched
+    vec3 size = upper - lower;
+    float s = 1.0f / glm::max(size.x, glm::max(size.y, size.z));
+    mUnitCube = scale(mat4(1.0f), vec3(s));
+    mUnitCube = glm::translate(mUnitCube, -0.5f * (upper + lower));
+    mSphereCenter = 0.5f * (upper + lower);
+    mSphereRadius = 0.5f * glm::length(size);
     //Since we use the model to get the paths for the textures, I need to do this here
-    for (auto t : model.getTextures()) {
+    for (const auto& t : model.textures()) {
         QFileInfo file = QString::fromStdString(t.filePath);
         mTextNames.push_back(mModelFolder + file.fileName());
+        //They are decoded in the workers too, meanwhile their meshes are not drawn
+        mImages.push_back(AssetManager::instance().loadImage(mTextNames.back()));
+        mTextPtr.push_back(nullptr);
+        ++mPendingImages;
+    }
+}
+
+void MeshLoad::findMaterials(const ModelGeometry& model) {
+    PROFILE_ZONE("findMaterials");
+    //Meshes with the same pair of textures have the same material
+    std::map<std::pair<int, int>, int> materials;
+    mMaterialIds.assign(mSeparators.size(), 0);
+    mMeshCenters.assign(mSeparators.size(), vec3(0.0f));
+    ArrayView<const Vertex> vertices = model.vertices();
+    const unsigned char* indexData = model.indexData().data();
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        const MeshData& sep = mSeparators[i];
+        auto found = materials.insert(std::make_pair(std::make_pair(sep.diffuseIndex, sep.specIndex),
+                                                     int(materials.size())));
+        mMaterialIds[i] = found.first->second;
+        //The center of its bounding box, for its depth
+        vec3 lower(std::numeric_limits<float>::max());
+        vec3 upper(-std::numeric_limits<float>::max());
+        const unsigned char* first = indexData + sep.indexOffset;
+        for (GLsizei k = 0; k < sep.howMany; ++k) {
+            size_t index = sep.indexType == GL_UNSIGNED_SHORT ? reinterpret_cast<const GLushort*>(first)[k] :
+                                                                reinterpret_cast<const GLuint*>(first)[k];
+            const vec3& position = vertices[size_t(sep.startVertex) + index].position;
+            lower = glm::min(lower, position);
+            upper = glm::max(upper, position);
+        }
+        mMeshCenters[i] = sep.howMany > 0 ? 0.5f * (lower + upper) : vec3(0.0f);
     }
 }
 
 void MeshLoad::initTexture()  {
+    if (mPendingImages == 0) {
+        return;
+    }
+    PROFILE_ZONE("initTexture");
+    if (mPackTextures) {
+        initTextureArray();
+        return;
+    }
     //Remember for QT texture object as well as GLProgram needs to be pointers
-    for (int i = 0; i < mTextNames.length(); ++i) {
-        QOpenGLTexture* textPtr= new QOpenGLTexture(QImage(mTextNames[i]).mirrored());
-        textPtr->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-        textPtr->setMagnificationFilter(QOpenGLTexture::Linear);
-        textPtr->setWrapMode(QOpenGLTexture::Repeat);
-        mTextPtr.push_back(textPtr);
+    for (int i = 0; i < mTextPtr.length(); ++i) {
+        AssetHandle<DecodedImage>& image = mImages[size_t(i)];
+        if (image.isNull() || !image.isFinished()) {
+            continue;
+        }
+        if (image.isReady()) {
+            mTextPtr[i] = mTextures.texture(image.get());
+        }
+        //The manager keeps the image in its cache, this window does not need it anymore
+        image = AssetHandle<DecodedImage>();
+        --mPendingImages;
+    }
+    if (mPendingImages == 0) {
+        qDebug() << "Textures:" << mTextures.imageCount() << "images in" << mTextures.textureCount()
+                 << "textures, the shared ones saved" << mTextures.savedBytes() << "bytes of video memmory";
+    }
+}
+
+void MeshLoad::initTextureArray() {
+    //The size of the layers depends on all the images, so they are packed at once
+    for (const AssetHandle<DecodedImage>& image : mImages) {
+        if (!image.isFinished()) {
+            return;
+        }
+    }
+    PROFILE_ZONE("initTextureArray");
+    std::vector<const DecodedImage*> images;
+    for (const AssetHandle<DecodedImage>& image : mImages) {
+        images.push_back(image.isReady() ? &image.get() : nullptr);
+    }
+    mAtlas.pack(images);
+    for (int array = 0; array < mAtlas.arrayCount(); ++array) {
+        mTextureArrays.push_back(mAtlas.upload(array, images));
+    }
+    qDebug() << "Texture arrays:" << images.size() << "images in" << mAtlas.layerCount() << "layers of"
+             << mAtlas.arrayCount() << "arrays, occupancy" << mAtlas.occupancy() << "," << mAtlas.sharedCount()
+             << "shared saved" << mAtlas.savedBytes() << "bytes of video memmory";
+    mImages.clear();
+    mPendingImages = 0;
+}
+
+bool MeshLoad::drawMaterial(size_t mesh, DrawMaterial& material) const {
+    const MeshData& sep = mSeparators[mesh];
+    //The shader only uses the box with compact vertices
+    QuantizationBox box = mCompactVertices ? mBoxes[mesh] : QuantizationBox{vec3(0.0f), vec3(1.0f)};
+    if (!mPackTextures) {
+        //Only the box, the textures are bound
+        material = IndirectDrawList::material(TextureSlot(), TextureSlot(), box);
+        return true;
+    }
+    if (mTextureArrays.empty()) {
+        return false;
     }
+    const TextureSlot& diffuse = mAtlas.textureSlots()[size_t(sep.diffuseIndex)];
+    const TextureSlot& specular = mAtlas.textureSlots()[size_t(sep.specIndex)];
+    if (diffuse.layer < 0 || specular.layer < 0) {
+        return false;
+    }
+    material = IndirectDrawList::material(diffuse, specular, box);
+    return true;
+}
+
+void MeshLoad::submitIndirect() {
+    if (mIndirectDraws.drawCount() == 0) {
+        return;
+    }
+    PROFILE_ZONE("submitIndirect");
+    //Written straight into the region of this frame of the ring
+    const GLsizeiptr commandsSize = GLsizeiptr(mIndirectDraws.drawCount() * sizeof(DrawElementsIndirectCommand));
+    const GLsizeiptr materialsSize = GLsizeiptr(mIndirectDraws.drawCount() * sizeof(DrawMaterial));
+    const GLintptr commandsOffset = mRing.allocate(commandsSize, GLintptr(sizeof(GLuint)));
+    const GLintptr materialsOffset = mRing.allocate(materialsSize, mRing.storageAlignment());
+    if (commandsOffset < 0 || materialsOffset < 0) {
+        return;
+    }
+    //The batches one after the other, in both ranges
+    GLint firstDraw[IndirectDrawList::BATCH_COUNT];
+    GLint draws = 0;
+    DrawElementsIndirectCommand* commandData = static_cast<DrawElementsIndirectCommand*>(mRing.pointer(commandsOffset));
+    DrawMaterial* materialData = static_cast<DrawMaterial*>(mRing.pointer(materialsOffset));
+    for (int batch = 0; batch < IndirectDrawList::BATCH_COUNT; ++batch) {
+        const std::vector<DrawElementsIndirectCommand>& commands = mIndirectDraws.commands(batch);
+        firstDraw[batch] = draws;
+        std::copy(commands.begin(), commands.end(), commandData + draws);
+        std::copy(mIndirectDraws.materials(batch).begin(), mIndirectDraws.materials(batch).end(), materialData + draws);
+        draws += GLint(commands.size());
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mRing.buffer());
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_MATERIALS_BINDING, mRing.buffer(), materialsOffset, materialsSize);
+    //All the meshes with the same index type in a single call
+    for (int batch = 0; batch < IndirectDrawList::BATCH_COUNT; ++batch) {
+        const GLsizei count = GLsizei(mIndirectDraws.commands(batch).size());
+        if (count == 0) {
+            continue;
+        }
+        mGLProgPtr->setUniformValue("uFirstDraw", firstDraw[batch]);
+        const GLintptr offset = commandsOffset + GLintptr(firstDraw[batch]) * GLintptr(sizeof(DrawElementsIndirectCommand));
+        glMultiDrawElementsIndirect(GL_TRIANGLES, IndirectDrawList::indexType(batch),
+                                    reinterpret_cast<void*>(offset), count, 0);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_MATERIALS_BINDING, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+bool MeshLoad::bindMaterial(const MeshData& sep) {
+    if (mPackTextures) {
+        //The arrays are bound once per frame, where the textures are goes with each draw
+        return true;
+    }
+    if (!mTextPtr[sep.diffuseIndex] || !mTextPtr[sep.specIndex]) {
+        //Its textures are still loading (or failed to)
+        return false;
+    }
+    //Bind the texture pointer as texture unit 0 (the units of the samplers are in the shader)
+    mTextPtr[sep.diffuseIndex]->bind(0);
+    //Bind the texture pointer as texture unit 1
+    mTextPtr[sep.specIndex]->bind(1);
+    return true;
 }
 
 void MeshLoad::resizeGL(int width, int height) {
@@ -86,18 +284,58 @@ void MeshLoad::resizeGL(int width, int height) {
 }
 
 void MeshLoad::initializeGL() {
+    PROFILE_ZONE("initializeGL");
     initializeOpenGLFunctions();
     startLog();
     qDebug().noquote() << versionInfo();
-    //Fill the arrays with data from the file into CPU side
-    createGeometry();
-    //Load the textures from images into GLtextures
-    initTexture();
+    //Start loading the model from the file into CPU side, the window is
+    //shown (empthy) meanwhile. See uploadGeometry
+    connect(&AssetManager::instance(), &AssetManager::progress, this, [](int finished, int requested) {
+        qDebug() << "Assets loaded" << finished << "of" << requested;
+    });
+    mModel = AssetManager::instance().loadModel(mModelFile);
     //Prepare the OpenGL shader program
-    mGLProgPtr = new QOpenGLShaderProgram(this);
-    mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Vertex, "../MyGLWindow/shaders/texturedVertex.vert");
-    mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Fragment, "../MyGLWindow/shaders/phongTexture.frag");
-    mGLProgPtr->link();
+    //The draws take their textures from the texture arrays, and gl_DrawID needs an extension before 4.6
+    if (mIndirect && (!mPackTextures || !glContext()->hasExtension("GL_ARB_shader_draw_parameters"))) {
+        qDebug() << "No multi draw indirect: it needs packed textures and GL_ARB_shader_draw_parameters";
+        mIndirect = false;
+    }
+    {
+        PROFILE_ZONE("link shaders");
+        mGLProgPtr = new QOpenGLShaderProgram(this);
+        if (mIndirect) {
+            mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Vertex, "../MyGLWindow/shaders/texturedVertexIndirect.vert");
+            mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Fragment, "../MyGLWindow/shaders/phongTextureIndirect.frag");
+        } else {
+            mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Vertex, "../MyGLWindow/shaders/texturedVertex.vert");
+            mGLProgPtr->addShaderFromSourceFile(QOpenGLShader::Fragment, mPackTextures ?
+                                                "../MyGLWindow/shaders/phongTextureArray.frag" :
+                                                "../MyGLWindow/shaders/phongTexture.frag");
+        }
+        mGLProgPtr->link();
+    }
+    //Some application's specific graphic initial state
+    glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    //Some camera projection parameters. Actual matrices will be calculated in resize
+    mFovY = 30.0f;
+    mNear = 1.0f;
+    mFar = 5.0f;
+    // Camera's default position
+    vec3 eye = vec3(0.0f, 0.0f, 4.0f);
+    vec3 center = vec3(0.0f, 0.0f, 0.0f);
+    vec3 up = vec3(0.0f, 1.0f, 0.0f);
+    mV = lookAt(eye, center, up);
+    //GPU times of the parts of each frame, read a few frames later (See GpuProfiler)
+    mGpuProfiler.create(this);
+}
+
+void MeshLoad::uploadGeometry() {
+    PROFILE_ZONE("uploadGeometry");
+    //Fill the arrays with data from the model into CPU side
+    createGeometry();
     int posAttr = mGLProgPtr->attributeLocation("posAttr");
     int normAttr = mGLProgPtr->attributeLocation("normalAttr");
     int textAttr = mGLProgPtr->attributeLocation("textCoordAttr");
@@ -113,21 +351,47 @@ void MeshLoad::initializeGL() {
         mVertexBuffer.create();
         mVertexBuffer.bind();
         mVertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        mVertexBuffer.allocate(mVertices.constData(), mVertices.size() * int(sizeof(Vertex)));
+        //Straight from the mapped cache entry
+        ArrayView<const Vertex> vertices = mModel.get().vertices();
+        std::vector<CompactVertex> compact;
+        if (mCompactVertices) {
+            VertexQuantizer quantizer;
+            QuantizationError error = quantizer.quantize(vertices, ArrayView<const MeshData>(mSeparators), compact, mBoxes);
+            qDebug() << "Compact vertices:" << vertices.sizeInBytes() << "->" << compact.size() * sizeof(CompactVertex)
+                     << "bytes, max error position" << error.position << "normal" << error.normal
+                     << "degrees, texture coordinates" << error.textCoords;
+            mVertexBuffer.allocate(compact.data(), int(compact.size() * sizeof(CompactVertex)));
+        } else {
+            mVertexBuffer.allocate(vertices.data(), int(vertices.sizeInBytes()));
+        }
         //Another one for the indices
         mIndexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
         mIndexBuffer.create();
         mIndexBuffer.bind();
         mIndexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        mIndexBuffer.allocate(mIndexes.constData(), mIndexes.size() * int(sizeof(unsigned int)));
+        ArrayView<const unsigned char> indices = mModel.get().indexData();
+        mIndexBuffer.allocate(indices.data(), int(indices.sizeInBytes()));
+        //The picking BVH is built in a worker, the mouse picks once it is ready
+        mBvh = AssetManager::instance().loadBvh(mModelFile);
         //Feed up vertex atribute to the Shader program
         mGLProgPtr->enableAttributeArray(posAttr);
         mGLProgPtr->enableAttributeArray(normAttr);
         mGLProgPtr->enableAttributeArray(textAttr);
         //This is an interleaved VBO
-        mGLProgPtr->setAttributeBuffer(posAttr, GL_FLOAT, offsetof(Vertex, position), 3, sizeof(Vertex));
-        mGLProgPtr->setAttributeBuffer(normAttr, GL_FLOAT, offsetof(Vertex, normal), 3, sizeof(Vertex));
-        mGLProgPtr->setAttributeBuffer(textAttr, GL_FLOAT, offsetof(Vertex, textCoords), 2, sizeof(Vertex));
+        if (mCompactVertices) {
+            //Normalized integers arrive to the shader as floats in [0, 1] (or [-1, 1])
+            const GLsizei stride = sizeof(CompactVertex);
+            glVertexAttribPointer(GLuint(posAttr), 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+                                  reinterpret_cast<void*>(offsetof(CompactVertex, position)));
+            glVertexAttribPointer(GLuint(normAttr), 2, GL_SHORT, GL_TRUE, stride,
+                                  reinterpret_cast<void*>(offsetof(CompactVertex, normal)));
+            glVertexAttribPointer(GLuint(textAttr), 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                                  reinterpret_cast<void*>(offsetof(CompactVertex, textCoords)));
+        } else {
+            mGLProgPtr->setAttributeBuffer(posAttr, GL_FLOAT, offsetof(Vertex, position), 3, sizeof(Vertex));
+            mGLProgPtr->setAttributeBuffer(normAttr, GL_FLOAT, offsetof(Vertex, normal), 3, sizeof(Vertex));
+            mGLProgPtr->setAttributeBuffer(textAttr, GL_FLOAT, offsetof(Vertex, textCoords), 2, sizeof(Vertex));
+        }
         // Release (unbind) all
         mVAO.release();
         mGLProgPtr->disableAttributeArray(posAttr);
@@ -136,35 +400,65 @@ void MeshLoad::initializeGL() {
         mIndexBuffer.release();
         mVertexBuffer.release();
         mGLProgPtr->release();
-        //Once we have a copy in the GPU there is no need to keep a CPU copy (unless you want to)
-        mIndexes.clear();
-        mVertices.clear();
+        //Once we have a copy in the GPU there is no need to keep a CPU copy (unless you want to).
+        //The asset manager keeps the mapping, not a copy, in case another window opens it
+        mModel = AssetHandle<ModelGeometry>();
     }
-    //Some application's specific graphic initial state
-    glClearColor(0.15f, 0.15f, 0.15f, 1.0f);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    //Some camera projection parameters. Actual matrices will be calculated in resize
-    mFovY = 30.0f;
-    mNear = 1.0f;
-    mFar = 5.0f;
-    // Camera's default position
-    vec3 eye = vec3(0.0f, 0.0f, 4.0f);
-    vec3 center = vec3(0.0f, 0.0f, 0.0f);
-    vec3 up = vec3(0.0f, 1.0f, 0.0f);
-    mV = lookAt(eye, center, up);
-    //For the time query
-    glGenQueries(1, &mTimerQuery);
-    glBeginQuery(GL_TIME_ELAPSED, mTimerQuery);
+    //Room for the most draws a frame can have: a run of visible meshlets every other meshlet, or the whole mesh
+    size_t maxDraws = 0;
+    for (const MeshData& sep : mSeparators) {
+        maxDraws += size_t(std::max(1, (sep.meshletCount + 1) / 2));
+    }
+    //A block per draw at the alignment of the uniform buffers (256 bytes at most in practice), or a command
+    //and its material for the indirect draws. A few more alignments of slack between the allocations
+    const size_t perDraw = std::max(size_t(256), sizeof(DrawElementsIndirectCommand) + sizeof(DrawMaterial));
+    if (!mRing.create(this, GLsizeiptr(maxDraws * perDraw + 4 * 256 + sizeof(CameraBlock)))) {
+        //Without it there is no camera to draw with
+        qDebug() << "Unable to map the frame ring, there is nothing to draw";
+        mLoadFailed = true;
+        return;
+    }
+    mGeometryReady = true;
+}
+
+float MeshLoad::projectedScale(const mat4& VM) const {
+    //The biggest scale of the model matrix, for the radius in view space
+    float scale = glm::max(glm::length(vec3(VM[0])), glm::max(glm::length(vec3(VM[1])), glm::length(vec3(VM[2]))));
+    float radius = scale * mSphereRadius;
+    //The nearest point of the sphere, so no part of it gets a bigger error
+    float distance = glm::max(-(VM * glm::vec4(mSphereCenter, 1.0f)).z - radius, mNear);
+    //Pixels per unit of view space at that distance
+    float pixels = 0.5f * float(height() * devicePixelRatio()) * mP[1][1] / distance;
+    return pixels * scale;
 }
 
 void MeshLoad::paintGL() {
-    //Finish the previous time query
-    glEndQuery(GL_TIME_ELAPSED);
-    glGetQueryObjectui64v(mTimerQuery, GL_QUERY_RESULT, &mNanoseconds);
+    PROFILE_FRAME();
+    PROFILE_ZONE("paintGL");
+    mGpuProfiler.beginFrame();
+    GpuZone frameZone(mGpuProfiler, "frame");
     //Clear screen and start the show
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+        GpuZone clearZone(mGpuProfiler, "clear");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    //Nothing to draw until the model is loaded, and the textures as they arrive
+    if (!mGeometryReady && mModel.isReady()) {
+        uploadGeometry();
+    }
+    if (!mGeometryReady && mModel.isFailed()) {
+        qDebug() << "Unable to load the model" << mModel.path() << ", there is nothing to draw";
+        mModel = AssetHandle<ModelGeometry>();
+        mLoadFailed = true;
+    }
+    if (!mGeometryReady) {
+        //Keep polling while it loads, but not after it failed
+        if (!mLoadFailed) {
+            update();
+        }
+        return;
+    }
+    initTexture();
     mGLProgPtr->bind();
     //Calculate view matrix
     mat4 V = mV * mBall.getRotation();
@@ -177,39 +471,144 @@ void MeshLoad::paintGL() {
         mM = rotate(mM, radians(angle), axis);
     }
     mM = scale(mM, vec3(1.5f));
-    //Pass uniform values to shaders
-    mGLProgPtr->setUniformValue("PVM", toQt(mP * V * mM));
-    mGLProgPtr->setUniformValue("VM", toQt(V * mM));
+    mM = mM * mUnitCube;
+    //Pass uniform values to shaders, written as they are (glm is column major too) in the ring
+    mRing.beginFrame();
+    CameraBlock camera;
+    camera.VM = V * mM;
+    camera.PVM = mP * V * mM;
     //Since we are working in view space in fragment shader
-    mGLProgPtr->setUniformValue("NormalMat", toQt(glm::inverse(glm::transpose(V * mM))));
-    mGLProgPtr->setUniformValue("uAlpha", mAlpha);
+    camera.NormalMat = glm::inverse(glm::transpose(V * mM));
+    camera.alpha = mAlpha;
+    camera.compactVertices = mCompactVertices;
+    const GLintptr cameraOffset = mRing.write(camera);
+    if (cameraOffset < 0) {
+        mRing.endFrame();
+        mGLProgPtr->release();
+        update();
+        return;
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, mRing.buffer(), cameraOffset, sizeof(CameraBlock));
+    //The error in model units that still looks like the full mesh
+    float maxError = mUseLods ? mLodPixelError / projectedScale(V * mM) : 0.0f;
+    //The meshlets are culled in model space, where their bounds are
+    MeshletCuller culler;
+    culler.setView(mP * V * mM, vec3(glm::inverse(V * mM) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
     mVAO.bind();
+    if (!mTextureArrays.empty()) {
+        //All the textures of the model, once
+        for (size_t unit = 0; unit < mTextureArrays.size(); ++unit) {
+            mTextureArrays[unit]->bind(GLuint(unit));
+        }
+    }
+    //Sort the meshes by material, and front to back inside each one
+    const mat4 VM = V * mM;
     {
-        for (int i = 0; i < mSeparators.size(); ++i) {
-            MeshData sep = mSeparators[i];
+        PROFILE_ZONE("sort queue");
+        mQueue.clear();
+        for (size_t i = 0; i < mSeparators.size(); ++i) {
+            const MeshData& sep = mSeparators[i];
             if (sep.specIndex == -1 || sep.diffuseIndex == -1) {
                 //This mesh does not have specular texture
                 //Do not render (Not with this shader at least)
                 continue;
             }
-            //Bind the texture pointer as texture unit 0
-            mTextPtr[sep.diffuseIndex]->bind(0);
-            mGLProgPtr->setUniformValue("uDiffuseMap", 0);
-            //Bind the texture pointer as texture unit 0
-            mTextPtr[sep.specIndex]->bind(1);
-            mGLProgPtr->setUniformValue("uSpecularMap", 1);
-            glDrawElementsBaseVertex(GL_TRIANGLES, sep.howMany, GL_UNSIGNED_INT,
-                                     reinterpret_cast<void*>(sep.startIndex * int(sizeof(unsigned int))),
-                                     sep.startVertex);
-            mTextPtr[sep.specIndex]->release();
+            float depth = -(VM * glm::vec4(mMeshCenters[i], 1.0f)).z;
+            mQueue.push(RenderQueue::makeKey(RenderQueue::OPAQUE_PASS, 0, unsigned(mMaterialIds[i]), depth), uint32_t(i));
         }
+        mQueue.sort();
+    }
+    //With indirect draws they are only collected in that order, and submitted all of them at the end
+    mIndirectDraws.clear();
+    int boundMaterial = -1;
+    size_t boundMesh = 0;
+    {
+        PROFILE_ZONE("draw meshes");
+        for (const RenderItem& item : mQueue.items()) {
+            const size_t i = item.index;
+            const MeshData& sep = mSeparators[i];
+            //Where its textures are and its box, that go with each of its draws
+            DrawMaterial material;
+            if (!drawMaterial(i, material)) {
+                continue;
+            }
+            if (!mIndirect) {
+                //The textures only when the material changes
+                if (mMaterialIds[i] != boundMaterial) {
+                    if (!bindMaterial(sep)) {
+                        continue;
+                    }
+                    boundMaterial = mMaterialIds[i];
+                    boundMesh = i;
+                }
+                const GLintptr drawOffset = mRing.write(material);
+                if (drawOffset < 0) {
+                    continue;
+                }
+                glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BINDING, mRing.buffer(), drawOffset, sizeof(DrawMaterial));
+            }
+            //The draws of each mesh, when they are submitted on their own
+            const int meshZone = mIndirect ? -1 : mGpuProfiler.beginZone("mesh", int(i));
+            //Each mesh has its own index type (See Model::packIndices)
+            GLsizei howMany;
+            GLint indexOffset;
+            int level = Model::selectLod(sep, maxError);
+            Model::lodRange(sep, level, howMany, indexOffset);
+            if (mCullMeshlets && level == 0 && sep.meshletCount > 0) {
+                //One draw per run of consecutive visible meshlets
+                const GLint indexSize = sep.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+                mDrawCounts.clear();
+                mDrawOffsets.clear();
+                GLint runEnd = -1;
+                for (GLint k = sep.firstMeshlet; k < sep.firstMeshlet + sep.meshletCount; ++k) {
+                    const Meshlet& meshlet = mMeshlets[size_t(k)];
+                    if (!culler.visible(meshlet)) {
+                        continue;
+                    }
+                    if (meshlet.firstIndex == runEnd) {
+                        mDrawCounts.back() += meshlet.howMany;
+                    } else {
+                        mDrawCounts.push_back(meshlet.howMany);
+                        mDrawOffsets.push_back(reinterpret_cast<void*>(intptr_t(indexOffset + indexSize * meshlet.firstIndex)));
+                    }
+                    runEnd = meshlet.firstIndex + meshlet.howMany;
+                }
+                if (mIndirect) {
+                    for (size_t run = 0; run < mDrawCounts.size(); ++run) {
+                        mIndirectDraws.add(sep.indexType, mDrawCounts[run], GLint(reinterpret_cast<intptr_t>(mDrawOffsets[run])),
+                                           sep.startVertex, material);
+                    }
+                } else {
+                    mDrawBaseVertices.assign(mDrawCounts.size(), sep.startVertex);
+                    glMultiDrawElementsBaseVertex(GL_TRIANGLES, mDrawCounts.data(), sep.indexType, mDrawOffsets.data(),
+                                                  GLsizei(mDrawCounts.size()), mDrawBaseVertices.data());
+                }
+            } else if (mIndirect) {
+                mIndirectDraws.add(sep.indexType, howMany, indexOffset, sep.startVertex, material);
+            } else {
+                glDrawElementsBaseVertex(GL_TRIANGLES, howMany, sep.indexType,
+                                         reinterpret_cast<void*>(intptr_t(indexOffset)),
+                                         sep.startVertex);
+            }
+            mGpuProfiler.endZone(meshZone);
+        }
+    }
+    if (!mPackTextures && boundMaterial >= 0) {
+        mTextPtr[mSeparators[boundMesh].diffuseIndex]->release(0);
+        mTextPtr[mSeparators[boundMesh].specIndex]->release(1);
+    }
+    if (mIndirect) {
+        GpuZone indirectZone(mGpuProfiler, "indirect");
+        submitIndirect();
+    }
+    mRing.endFrame();
+    for (size_t unit = 0; unit < mTextureArrays.size(); ++unit) {
+        mTextureArrays[unit]->release(GLuint(unit));
     }
     mVAO.release();
     mGLProgPtr->release();
     ++mFrame;
     update();
-    //Start a timer query
-    glBeginQuery(GL_TIME_ELAPSED, mTimerQuery);
 }
 
 //Application specific (keys)
@@ -230,9 +629,41 @@ void MeshLoad::keyPressEvent(QKeyEvent* event) {
             event->accept();
         break;
 
+        case Qt::Key_L:
+            mUseLods = !mUseLods;
+            event->accept();
+        break;
+
+        case Qt::Key_C:
+            mCullMeshlets = !mCullMeshlets;
+            event->accept();
+        break;
+
+        case Qt::Key_P:
+            mLogPicks = !mLogPicks;
+            event->accept();
+        break;
+
         default:
             //You did not handle it pass the event to parent
             BaseGLWindow::keyPressEvent(event);
         break;
     }
 }
+
+void MeshLoad::mouseMoveEvent(QMouseEvent* event) {
+    if (event->buttons() == Qt::NoButton && mBvh.isReady()) {
+        RayHit hit;
+        auto start = std::chrono::steady_clock::now();
+        bool found = pick(event->localPos(), mBvh.get(), hit);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (hit.mesh != mHovered.mesh || hit.triangle != mHovered.triangle) {
+            if (found && mLogPicks) {
+                qDebug() << "Picked mesh" << hit.mesh << "triangle" << hit.triangle << "at" << toQt(hit.position)
+                         << "in" << seconds * 1.0e6 << "us";
+            }
+            mHovered = hit;
+        }
+    }
+    BaseGLWindow::mouseMoveEvent(event);
+}
@@ -8,6 +8,13 @@
 #include <QVector>
 
 #include "model.h"
+#include "assetmanager.h"
+#include "textureregistry.h"
+#include "textureatlas.h"
+#include "indirectdrawlist.h"
+#include "renderqueue.h"
+#include "framering.h"
+#include "vertexquantizer.h"
 #include "baseGLwindow.h"
 
 class MeshLoad : public BaseGLWindow
@@ -15,37 +22,111 @@ class MeshLoad : public BaseGLWindow
 public:
     MeshLoad();
     ~MeshLoad() override;
+    //! Upload the vertices as \struct CompactVertex (16 bytes instead of 32). Call it before show
+    void setCompactVertices(bool compact);
+    //! Pack all the textures in one texture array, bound once per frame (the default). Call it before show
+    void setPackTextures(bool pack);
+    //! Submit all the meshes with glMultiDrawElementsIndirect (the default, if the textures are packed). Call it before show
+    void setMultiDrawIndirect(bool indirect);
+    //! The model to show, its textures are next to it. Call it before show
+    void setModelFile(const QString& fileName);
 
 protected:
     void initializeGL() override;
     void resizeGL(int width, int height) override;
     void paintGL() override;
 
-    GLuint64 mNanoseconds;
-    GLuint mTimerQuery;
     QOpenGLShaderProgram* mGLProgPtr;
+    //Not owned, byte-identical images share one texture of mTextures
     QVector<QOpenGLTexture*> mTextPtr;
+    TextureRegistry mTextures;
+    //Or all of them in the layers of a few texture arrays, where mAtlas tells each one is
+    bool mPackTextures;
+    TextureAtlas mAtlas;
+    std::vector<QOpenGLTexture*> mTextureArrays;
+    //The draws of a frame, in a GL_DRAW_INDIRECT_BUFFER and their materials in a storage buffer
+    bool mIndirect;
+    IndirectDrawList mIndirectDraws;
+    //The uniform blocks of each frame, and the indirect draws (See \class FrameRing)
+    FrameRing mRing;
+    //The meshes to draw each frame, sorted (See \class RenderQueue)
+    RenderQueue mQueue;
+    //Meshes with the same textures have the same material
+    std::vector<int> mMaterialIds;
+    //Center of the bounding box of each mesh, in model units, for its depth
+    std::vector<glm::vec3> mMeshCenters;
     QVector<QString> mTextNames;
     QVector<glm::vec3> mColors;
-    QVector<MeshData> mSeparators;
+    std::vector<MeshData> mSeparators;
+    //Kept in the CPU, the culling uses their bounds every frame
+    std::vector<Meshlet> mMeshlets;
+    //The draws of the visible meshlets of a mesh, for glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> mDrawCounts;
+    std::vector<void*> mDrawOffsets;
+    std::vector<GLint> mDrawBaseVertices;
     QString mModelFolder;
+    QString mModelFile;
 
     int mFrame;
     float mAlpha;
     bool mRotating;
+    bool mCompactVertices;
+    //Draw each mesh with the coarsest level of detail that looks the same
+    bool mUseLods;
+    //How far (in pixels) a level of detail can be from the mesh on screen
+    float mLodPixelError;
+    //Skip the meshlets outside of the view or facing away before drawing
+    bool mCullMeshlets;
+    //Triangles of the model (in model units) to pick them with the mouse, built in a worker after the upload
+    AssetHandle<TriangleBvh> mBvh;
+    //The last picked mesh and triangle, so only the changes are reported
+    RayHit mHovered;
+    //Log the triangle under the mouse when it changes (P key)
+    bool mLogPicks;
 
     // OpenGL State Information
     QOpenGLBuffer mVertexBuffer;
     QOpenGLBuffer mIndexBuffer;
     QOpenGLVertexArrayObject mVAO;
 
-    QVector<Vertex> mVertices;
-    QVector<unsigned int> mIndexes;
+    //The geometry, mapped from the geometry cache, only kept until it is uploaded to the GPU.
+    //The model loads in a worker thread (See \class AssetManager) and so do the images
+    AssetHandle<ModelGeometry> mModel;
+    std::vector<AssetHandle<DecodedImage>> mImages;
+    //Images that are still decoding
+    int mPendingImages;
+    bool mGeometryReady;
+    //The model could not be loaded, there is nothing to draw
+    bool mLoadFailed;
+    //How to decode the positions of each mesh, when the vertices are compact
+    std::vector<QuantizationBox> mBoxes;
+    //Puts the model inside a unit cube centered at the origin
+    glm::mat4 mUnitCube;
+    //Bounding sphere of the model, in model units
+    glm::vec3 mSphereCenter;
+    float mSphereRadius;
+    //Pixels on screen per unit of the model, for the bounding sphere under mP and mV
+    float projectedScale(const glm::mat4& VM) const;
     void createGeometry();
+    //! Fill mMaterialIds and mMeshCenters
+    void findMaterials(const ModelGeometry& model);
+    //! Upload the model to the GPU, once it is loaded
+    void uploadGeometry();
+    //! Create the textures of the images that are already decoded
     void initTexture();
+    //! Pack and upload the texture array, once all the images are decoded
+    void initTextureArray();
+    //! Bind the textures of a mesh, or set where they are in the array. False if they are not there (yet)
+    bool bindMaterial(const MeshData& sep);
+    //! The material of a mesh for its draws. False if its textures are not there (yet)
+    bool drawMaterial(size_t mesh, DrawMaterial& material) const;
+    //! Upload the draws of this frame and submit them, a multi draw per index type
+    void submitIndirect();
     void tearDownGL();
 
     void keyPressEvent(QKeyEvent* event) override;
+    //! Report the triangle under the mouse when it is not dragging the trackball (once the BVH is ready)
+    void mouseMoveEvent(QMouseEvent* event) override;
 };
 
 #endif // MESHLOAD_H
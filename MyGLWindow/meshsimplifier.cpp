@@ -0,0 +1,362 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using glm::vec3;
+using glm::dvec3;
+
+namespace {
+//Weight of the planes that keep the borders in place, relative to the faces
+const double BORDER_WEIGHT = 10.0;
+
+//The symmetric 4x4 matrix of the sum of the squared distances to some planes
+struct Quadric {
+    double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+    //Area covered by the planes, to get a distance back from the error
+    double weight;
+
+    Quadric() : a2(0.0), b2(0.0), c2(0.0), ab(0.0), ac(0.0), bc(0.0),
+                ad(0.0), bd(0.0), cd(0.0), d2(0.0), weight(0.0) {}
+    //Add the plane dot(n, x) + d = 0, with a unit normal n
+    void addPlane(const dvec3& n, double d, double w) {
+        a2 += w * n.x * n.x;
+        b2 += w * n.y * n.y;
+        c2 += w * n.z * n.z;
+        ab += w * n.x * n.y;
+        ac += w * n.x * n.z;
+        bc += w * n.y * n.z;
+        ad += w * n.x * d;
+        bd += w * n.y * d;
+        cd += w * n.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+    Quadric& operator+=(const Quadric& other) {
+        a2 += other.a2;
+        b2 += other.b2;
+        c2 += other.c2;
+        ab += other.ab;
+        ac += other.ac;
+        bc += other.bc;
+        ad += other.ad;
+        bd += other.bd;
+        cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+        return *this;
+    }
+    //Weighted sum of the squared distances from p to the planes
+    double error(const vec3& p) const {
+        double x = double(p.x);
+        double y = double(p.y);
+        double z = double(p.z);
+        double e = a2 * x * x + b2 * y * y + c2 * z * z +
+                   2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z) + d2;
+        return std::max(e, 0.0);
+    }
+};
+
+enum VertexKind {INTERIOR_VERTEX, BORDER_VERTEX, LOCKED_VERTEX};
+
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    double cost;
+};
+
+//An edge as a sortable key (smaller vertex first) and the triangle where it was found
+struct EdgeRecord {
+    uint64_t key;
+    size_t triangle;
+    bool operator<(const EdgeRecord& other) const {
+        return key < other.key;
+    }
+};
+
+uint64_t edgeKey(unsigned int a, unsigned int b) {
+    return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+}
+
+//The state of a simplification, kept from one level to the next
+class Simplification {
+public:
+    Simplification(const unsigned int* indices, size_t indexCount, StridedView<const vec3> positions) :
+        mIndices(indices, indices + indexCount), mPositions(positions), mQuadrics(positions.size()),
+        mKinds(positions.size(), INTERIOR_VERTEX), mRemap(positions.size()), mLocked(positions.size(), 0),
+        mError(0.0) {
+        for (size_t i = 0; i < mRemap.size(); ++i) {
+            mRemap[i] = static_cast<unsigned int>(i);
+        }
+        classifyVertices();
+        initQuadrics();
+    }
+
+    const std::vector<unsigned int>& indices() const {
+        return mIndices;
+    }
+
+    float error() const {
+        return float(mError);
+    }
+
+    //Collapse edges until there are at most target indices. False if it stalls before
+    bool simplify(size_t target) {
+        while (mIndices.size() > target) {
+            //Only seams, borders or flips left, or so few that the passes are pointless
+            if (!collapsePass(target)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::vector<unsigned int> mIndices;
+    StridedView<const vec3> mPositions;
+    std::vector<Quadric> mQuadrics;
+    std::vector<unsigned char> mKinds;
+    //Where each vertex went (itself if it is still there)
+    std::vector<unsigned int> mRemap;
+    //Vertices already used by a collapse of the current pass
+    std::vector<unsigned char> mLocked;
+    double mError;
+    std::vector<EdgeRecord> mEdges;
+    std::vector<Collapse> mCollapses;
+    std::vector<size_t> mAdjacencyStart;
+    std::vector<size_t> mAdjacency;
+
+    void collectEdges() {
+        mEdges.clear();
+        mEdges.reserve(mIndices.size());
+        for (size_t t = 0; t + 2 < mIndices.size(); t += 3) {
+            for (size_t c = 0; c < 3; ++c) {
+                mEdges.push_back(EdgeRecord{edgeKey(mIndices[t + c], mIndices[t + (c + 1) % 3]), t / 3});
+            }
+        }
+        std::sort(mEdges.begin(), mEdges.end());
+    }
+
+    //Seams and non manifold vertices are locked, the ones of the open edges are border
+    void classifyVertices() {
+        std::vector<unsigned int> order(mPositions.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = static_cast<unsigned int>(i);
+        }
+        auto less = [this](unsigned int a, unsigned int b) {
+            const vec3& p = mPositions[a];
+            const vec3& q = mPositions[b];
+            return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+        };
+        std::sort(order.begin(), order.end(), less);
+        for (size_t i = 1; i < order.size(); ++i) {
+            if (!less(order[i - 1], order[i])) {
+                mKinds[order[i - 1]] = LOCKED_VERTEX;
+                mKinds[order[i]] = LOCKED_VERTEX;
+            }
+        }
+        collectEdges();
+        for (size_t i = 0; i < mEdges.size();) {
+            size_t run = 1;
+            while (i + run < mEdges.size() && mEdges[i + run].key == mEdges[i].key) {
+                ++run;
+            }
+            unsigned int a = unsigned(mEdges[i].key >> 32);
+            unsigned int b = unsigned(mEdges[i].key & 0xFFFFFFFFu);
+            unsigned char kind = run == 1 ? BORDER_VERTEX : run > 2 ? LOCKED_VERTEX : INTERIOR_VERTEX;
+            mKinds[a] = std::max(mKinds[a], kind);
+            mKinds[b] = std::max(mKinds[b], kind);
+            i += run;
+        }
+    }
+
+    void initQuadrics() {
+        for (size_t t = 0; t + 2 < mIndices.size(); t += 3) {
+            dvec3 p0 = dvec3(mPositions[mIndices[t]]);
+            dvec3 p1 = dvec3(mPositions[mIndices[t + 1]]);
+            dvec3 p2 = dvec3(mPositions[mIndices[t + 2]]);
+            dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(n);
+            if (length == 0.0) {
+                continue;
+            }
+            n /= length;
+            for (size_t c = 0; c < 3; ++c) {
+                mQuadrics[mIndices[t + c]].addPlane(n, -glm::dot(n, p0), 0.5 * length);
+            }
+        }
+        //The open edges also keep their vertices on a plane perpendicular to the face
+        for (size_t i = 0; i < mEdges.size(); ++i) {
+            bool single = (i == 0 || mEdges[i - 1].key != mEdges[i].key) &&
+                          (i + 1 == mEdges.size() || mEdges[i + 1].key != mEdges[i].key);
+            if (!single) {
+                continue;
+            }
+            const unsigned int* triangle = mIndices.data() + 3 * mEdges[i].triangle;
+            unsigned int a = unsigned(mEdges[i].key >> 32);
+            unsigned int b = unsigned(mEdges[i].key & 0xFFFFFFFFu);
+            dvec3 pa = dvec3(mPositions[a]);
+            dvec3 pb = dvec3(mPositions[b]);
+            dvec3 faceNormal = glm::cross(dvec3(mPositions[triangle[1]]) - dvec3(mPositions[triangle[0]]),
+                                          dvec3(mPositions[triangle[2]]) - dvec3(mPositions[triangle[0]]));
+            dvec3 n = glm::cross(pb - pa, faceNormal);
+            double length = glm::length(n);
+            if (length == 0.0) {
+                continue;
+            }
+            n /= length;
+            double w = BORDER_WEIGHT * glm::dot(pb - pa, pb - pa);
+            mQuadrics[a].addPlane(n, -glm::dot(n, pa), w);
+            mQuadrics[b].addPlane(n, -glm::dot(n, pb), w);
+        }
+    }
+
+    //Can from collapse onto to? A border vertex only moves along its border
+    bool allowed(unsigned int from, bool borderEdge) const {
+        return mKinds[from] == INTERIOR_VERTEX || (mKinds[from] == BORDER_VERTEX && borderEdge);
+    }
+
+    double cost(unsigned int from, unsigned int to) const {
+        Quadric q = mQuadrics[from];
+        q += mQuadrics[to];
+        return q.error(mPositions[to]);
+    }
+
+    //Would moving from to the position of to flip any of the triangles that stay?
+    bool flips(unsigned int from, unsigned int to) const {
+        const vec3& target = mPositions[to];
+        for (size_t k = mAdjacencyStart[from]; k < mAdjacencyStart[from + 1]; ++k) {
+            const unsigned int* triangle = mIndices.data() + 3 * mAdjacency[k];
+            unsigned int v[3] = {mRemap[triangle[0]], mRemap[triangle[1]], mRemap[triangle[2]]};
+            if (v[0] == to || v[1] == to || v[2] == to || v[0] == v[1] || v[1] == v[2] || v[0] == v[2]) {
+                //It disappears (or already did)
+                continue;
+            }
+            vec3 p[3] = {mPositions[v[0]], mPositions[v[1]], mPositions[v[2]]};
+            vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (size_t c = 0; c < 3; ++c) {
+                if (v[c] == from) {
+                    p[c] = target;
+                }
+            }
+            vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void buildAdjacency() {
+        mAdjacencyStart.assign(mPositions.size() + 1, 0);
+        for (unsigned int v : mIndices) {
+            ++mAdjacencyStart[v + 1];
+        }
+        for (size_t i = 1; i < mAdjacencyStart.size(); ++i) {
+            mAdjacencyStart[i] += mAdjacencyStart[i - 1];
+        }
+        mAdjacency.resize(mIndices.size());
+        std::vector<size_t> next(mAdjacencyStart.begin(), mAdjacencyStart.end() - 1);
+        for (size_t i = 0; i < mIndices.size(); ++i) {
+            mAdjacency[next[mIndices[i]]++] = i / 3;
+        }
+    }
+
+    //Make the cheapest collapses that do not touch each other, as many as needed for target.
+    //False if it could not make a tenth of them
+    bool collapsePass(size_t target) {
+        collectEdges();
+        mCollapses.clear();
+        for (size_t i = 0; i < mEdges.size();) {
+            size_t run = 1;
+            while (i + run < mEdges.size() && mEdges[i + run].key == mEdges[i].key) {
+                ++run;
+            }
+            unsigned int a = unsigned(mEdges[i].key >> 32);
+            unsigned int b = unsigned(mEdges[i].key & 0xFFFFFFFFu);
+            bool borderEdge = run == 1;
+            i += run;
+            Collapse best = {0, 0, -1.0};
+            if (allowed(a, borderEdge)) {
+                best = Collapse{a, b, cost(a, b)};
+            }
+            if (allowed(b, borderEdge)) {
+                double c = cost(b, a);
+                if (best.cost < 0.0 || c < best.cost) {
+                    best = Collapse{b, a, c};
+                }
+            }
+            if (best.cost >= 0.0) {
+                mCollapses.push_back(best);
+            }
+        }
+        std::sort(mCollapses.begin(), mCollapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        //An interior collapse removes two triangles
+        const size_t triangles = mIndices.size() / 3;
+        const size_t needed = (triangles - target / 3 + 1) / 2;
+        buildAdjacency();
+        std::fill(mLocked.begin(), mLocked.end(), 0);
+        size_t performed = 0;
+        for (const Collapse& collapse : mCollapses) {
+            if (performed >= needed) {
+                break;
+            }
+            if (mLocked[collapse.from] || mLocked[collapse.to] || flips(collapse.from, collapse.to)) {
+                continue;
+            }
+            mRemap[collapse.from] = collapse.to;
+            Quadric& q = mQuadrics[collapse.to];
+            q += mQuadrics[collapse.from];
+            mError = std::max(mError, std::sqrt(collapse.cost / std::max(q.weight, 1e-30)));
+            mLocked[collapse.from] = 1;
+            mLocked[collapse.to] = 1;
+            ++performed;
+        }
+
+        //Apply the collapses and drop the triangles that became degenerate
+        size_t written = 0;
+        for (size_t t = 0; t + 2 < mIndices.size(); t += 3) {
+            unsigned int a = mRemap[mIndices[t]];
+            unsigned int b = mRemap[mIndices[t + 1]];
+            unsigned int c = mRemap[mIndices[t + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            mIndices[written++] = a;
+            mIndices[written++] = b;
+            mIndices[written++] = c;
+        }
+        mIndices.resize(written);
+        return performed > 0 && performed * 10 >= needed;
+    }
+};
+}
+
+void MeshSimplifier::simplify(const unsigned int* indices, size_t indexCount, StridedView<const vec3> positions,
+                              const std::vector<size_t>& targets, std::vector<std::vector<unsigned int>>& levels,
+                              std::vector<float>& errors) const {
+    levels.clear();
+    errors.clear();
+    if (indexCount < 3 || positions.size() == 0) {
+        return;
+    }
+    Simplification simplification(indices, indexCount - indexCount % 3, positions);
+    size_t previous = indexCount;
+    for (size_t target : targets) {
+        bool reached = simplification.simplify(target);
+        const std::vector<unsigned int>& level = simplification.indices();
+        if (level.empty() || level.size() >= previous) {
+            break;
+        }
+        levels.push_back(level);
+        errors.push_back(simplification.error());
+        previous = level.size();
+        if (!reached) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "stridedview.h"
+
+//! A class that simplifies a mesh into a chain of levels of detail (LOD).
+/*!
+  It removes vertices by edge collapses, in the order given by the quadric
+  error metric of Garland and Heckbert 1997: the cost of moving a vertex is
+  the (area weighted) squared distance to the planes of the triangles that
+  it had in the original mesh. A vertex always collapses onto one of its
+  neighbours, so the levels only use vertices of the original mesh and can
+  be drawn with its vertex buffer and a smaller index buffer.
+
+  Each level continues from the previous one, so the whole chain costs
+  about the same as the coarsest level alone.
+
+  The borders of the mesh only collapse along themselves, and the seams
+  (different vertices in the same position, as the ones that have a
+  different texture coordinate or normal at each side) never move. So the
+  levels do not open cracks. A collapse that would flip a triangle is not
+  made.
+*/
+class MeshSimplifier {
+public:
+    //! Simplify a mesh to each of the targets (decreasing numbers of indices)
+    /*!
+      On return, levels has the indices of each level and errors its error:
+      the (RMS) distance, in the units of positions, between the level and
+      the original surface. If a level can not be simplified any further
+      (only seams and borders left) the chain stops there, so levels can
+      have less elements than targets.
+    */
+    void simplify(const unsigned int* indices, size_t indexCount, StridedView<const glm::vec3> positions,
+                  const std::vector<size_t>& targets, std::vector<std::vector<unsigned int>>& levels,
+                  std::vector<float>& errors) const;
+};
+
+#endif // MESHSIMPLIFIER_H
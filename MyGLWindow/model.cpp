@@ -1,6 +1,40 @@
 #include <QDebug>
+#include <QDir>
 #include "model.h"
+#include "geometrycache.h"
+#include "normalgenerator.h"
+#include "meshsimplifier.h"
+#include "overdrawoptimizer.h"
+#include "parallel.h"
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+//Faces or vertices converted by each task, so a big mesh is also split among the threads
+const unsigned int IMPORT_PIECE = 65536;
+
+//A range of the faces or of the vertices of a mesh, and where it goes in the arrays of the model
+struct ImportPiece {
+    const aiMesh* mesh;
+    unsigned int first;
+    unsigned int last;
+    size_t target;
+    bool faces;
+};
+
+//The same file can be written as "maps\skin.png", "./maps/skin.png" or "maps//skin.png"
+std::string normalizedPath(const std::string& path) {
+    QString normalized = QString::fromStdString(path);
+    normalized.replace('\\', '/');
+    return QDir::cleanPath(normalized).toStdString();
+}
+}
 
+const unsigned int Model::IMPORT_FLAGS = aiProcess_GenNormals |
+                                         aiProcess_Triangulate |
+                                         aiProcess_JoinIdenticalVertices;
 
 Model::Model() : Mesh() {
 
@@ -11,13 +45,11 @@ Model::Model(const QString& fileName) : Mesh(){
 }
 
 bool Model::load(const QString& fileName) {
+    PROFILE_ZONE("import model");
     // Create an instance of the Importer class
     Assimp::Importer importer;
 
-    const aiScene* scenePtr = importer.ReadFile( fileName.toStdString(),
-          aiProcess_GenNormals       |
-          aiProcess_Triangulate            |
-          aiProcess_JoinIdenticalVertices);
+    const aiScene* scenePtr = importer.ReadFile(fileName.toStdString(), IMPORT_FLAGS);
 
     /* If the import failed, report it (I am guessing that he will be able
      to check if the file exist and if its writable itself. */
@@ -26,160 +58,584 @@ bool Model::load(const QString& fileName) {
         return false;
     }
 
-    mIndices.clear();
-    mVertices.clear();
+    return load(scenePtr);
+}
+
+bool Model::load(const aiScene* scene) {
+    PROFILE_ZONE("convert scene");
+    if (!scene || !scene->mRootNode) {
+        return false;
+    }
+    clear();
     mSeparators.clear();
+    mMeshlets.clear();
+    mTexturesData.clear();
     //Start the recursivelly process at the root
-    processNode(scenePtr->mRootNode, scenePtr);
+    std::vector<const aiMesh*> meshes;
+    processNode(scene->mRootNode, scene, meshes);
+    addMeshes(meshes, scene);
+    if (mLayout == SEPARATED_LAYOUT) {
+        std::vector<Vertex> vertices;
+        vertices.swap(mVertices);
+        setVertices(vertices);
+    }
     updateBoundingBox();
 
     return true;
 }
 
-std::vector<MeshData> Model::getSeparators() const {
+bool Model::load(const QString& fileName, const GeometryCache& cache) {
+    CachedModel cached;
+    if (cache.open(fileName, IMPORT_FLAGS, cached)) {
+        return load(cached);
+    }
+    if (!load(fileName)) {
+        return false;
+    }
+    //The entries keep the model ready to render, so it is optimized only once
+    VertexCacheReport report = optimizeVertexCache();
+    qDebug().noquote() << QString("Vertex cache ACMR %1 -> %2, ATVR %3 -> %4")
+                          .arg(double(report.before.acmr()), 0, 'f', 3).arg(double(report.after.acmr()), 0, 'f', 3)
+                          .arg(double(report.before.atvr()), 0, 'f', 3).arg(double(report.after.atvr()), 0, 'f', 3);
+    //Also the levels of detail, simplifying is even slower than importing
+    generateLods();
+    buildMeshlets();
+    size_t lodTriangles[MAX_LODS] = {};
+    for (const MeshData& sep : mSeparators) {
+        for (int k = 0; k < sep.lodCount; ++k) {
+            lodTriangles[k] += size_t(sep.lods[k].howMany) / 3;
+        }
+    }
+    QString levels = QString::number(trianglesCount());
+    for (size_t triangles : lodTriangles) {
+        levels += " " + QString::number(triangles);
+    }
+    qDebug().noquote() << "Triangles per level of detail:" << levels;
+    cache.store(fileName, IMPORT_FLAGS, *this);
+    return true;
+}
+
+bool Model::load(const CachedModel& cached) {
+    PROFILE_ZONE("load cached model");
+    clear();
+    ArrayView<const Vertex> vertices = cached.vertices();
+    ArrayView<const unsigned char> indexData = cached.indexData();
+    ArrayView<const MeshData> separators = cached.separators();
+    mHasNormals = cached.hasNormals();
+    mHasTexture = cached.hasTexture();
+    std::vector<Vertex> storage(vertices.begin(), vertices.end());
+    setVertices(storage);
+    //The entry has packed indices, widen them back to 32 bits
+    mSeparators.assign(separators.begin(), separators.end());
+    for (MeshData& sep : mSeparators) {
+        const unsigned char* first = indexData.data() + sep.indexOffset;
+        sep.startIndex = static_cast<GLint>(mIndices.size());
+        if (sep.indexType == GL_UNSIGNED_SHORT) {
+            const GLushort* packed = reinterpret_cast<const GLushort*>(first);
+            mIndices.insert(mIndices.end(), packed, packed + sep.howMany);
+        } else {
+            const unsigned int* packed = reinterpret_cast<const unsigned int*>(first);
+            mIndices.insert(mIndices.end(), packed, packed + sep.howMany);
+        }
+        sep.indexType = GL_UNSIGNED_INT;
+        sep.indexOffset = sep.startIndex * int(sizeof(unsigned int));
+    }
+    //And the levels of detail after all of them
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        MeshData& sep = mSeparators[i];
+        const GLenum packedType = separators[i].indexType;
+        for (int k = 0; k < sep.lodCount; ++k) {
+            MeshLod& lod = sep.lods[k];
+            const unsigned char* first = indexData.data() + lod.indexOffset;
+            lod.startIndex = static_cast<GLint>(mIndices.size());
+            if (packedType == GL_UNSIGNED_SHORT) {
+                const GLushort* packed = reinterpret_cast<const GLushort*>(first);
+                mIndices.insert(mIndices.end(), packed, packed + lod.howMany);
+            } else {
+                const unsigned int* packed = reinterpret_cast<const unsigned int*>(first);
+                mIndices.insert(mIndices.end(), packed, packed + lod.howMany);
+            }
+            lod.indexOffset = lod.startIndex * int(sizeof(unsigned int));
+        }
+    }
+    ArrayView<const Meshlet> meshlets = cached.meshlets();
+    mMeshlets.assign(meshlets.begin(), meshlets.end());
+    mTexturesData = cached.textures();
+    mLowerCorner = cached.lowerCorner();
+    mUpperCorner = cached.upperCorner();
+    return true;
+}
+
+const std::vector<MeshData>& Model::getSeparators() const {
     return mSeparators;
 }
 
+ArrayView<const MeshData> Model::separatorsView() const {
+    return ArrayView<const MeshData>(mSeparators);
+}
+
 int Model::numMeshes() {
     //We have separator at the bigining and at the end
     return static_cast<int>(mSeparators.size() - 1);
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
-    // Process all the meshes (if any) in this node
-    for(unsigned int i = 0; i < node->mNumMeshes; i++) {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        addMeshData(mesh, scene);
+void Model::recalculateNormals(NormalWeighting weighting, float creaseAngle) {
+    NormalGenerator generator(weighting, creaseAngle);
+    std::vector<Vertex> source = getVertices();
+    StridedView<const glm::vec3> positions = positionView();
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    vertices.reserve(source.size());
+    indices.reserve(mIndices.size());
+    //The indices of each mesh are relative to its first vertex, so each mesh
+    //is processed on its own and then placed after the previous one
+    std::vector<unsigned int> meshIndices;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> copies;
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        MeshData& sep = mSeparators[i];
+        size_t firstVertex = size_t(sep.startVertex);
+        size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : source.size();
+        meshIndices.assign(mIndices.begin() + sep.startIndex, mIndices.begin() + sep.startIndex + sep.howMany);
+        generator.generate(positions.slice(firstVertex, lastVertex - firstVertex), meshIndices, normals, copies);
+        sep.startVertex = static_cast<GLint>(vertices.size());
+        sep.startIndex = static_cast<GLint>(indices.size());
+        sep.indexOffset = sep.startIndex * int(sizeof(unsigned int));
+        sep.lodCount = 0;
+        sep.meshletCount = 0;
+        for (size_t k = firstVertex; k < lastVertex; ++k) {
+            vertices.push_back(source[k]);
+        }
+        //The vertices split by the crease angle go after the ones of this mesh
+        for (unsigned int copy : copies) {
+            vertices.push_back(source[firstVertex + copy]);
+        }
+        for (size_t k = 0; k < normals.size(); ++k) {
+            vertices[size_t(sep.startVertex) + k].normal = normals[k];
+        }
+        indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
     }
+    mHasNormals = !vertices.empty();
+    setVertices(vertices);
+    mIndices.swap(indices);
+    mMeshlets.clear();
+}
 
-    // Then, recursivelly procees the child nodes
-    for(unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+VertexCacheReport Model::optimizeVertexCache(unsigned int cacheSize, float overdrawThreshold) {
+    //The vertices are going to move
+    clearLods();
+    clearMeshlets();
+    VertexCacheOptimizer optimizer(cacheSize);
+    OverdrawOptimizer overdraw(overdrawThreshold, cacheSize);
+    const StridedView<const glm::vec3> positions = positionView();
+    std::vector<VertexCacheReport> reports(mSeparators.size());
+    //The meshes do not share indices nor vertices, so they can go in parallel
+    parallel::forRange(mSeparators.size(), [&](size_t begin, size_t end) {
+        std::vector<unsigned int> remap;
+        for (size_t i = begin; i < end; ++i) {
+            const MeshData& sep = mSeparators[i];
+            size_t firstVertex = size_t(sep.startVertex);
+            size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : vertexCount();
+            unsigned int* indices = mIndices.data() + sep.startIndex;
+            size_t indexCount = size_t(sep.howMany);
+            size_t count = lastVertex - firstVertex;
+            reports[i].before = optimizer.analyze(indices, indexCount, count);
+            optimizer.reorderTriangles(indices, indexCount, count);
+            if (overdrawThreshold >= 1.0f) {
+                overdraw.reorderTriangles(indices, indexCount, positions.slice(firstVertex, count));
+            }
+            optimizer.reorderVertices(indices, indexCount, count, remap);
+            reorderVertices(firstVertex, remap);
+            reports[i].after = optimizer.analyze(indices, indexCount, count);
+        }
+    }, 1);
+    VertexCacheReport total;
+    for (const VertexCacheReport& report : reports) {
+        total.before += report.before;
+        total.after += report.after;
     }
+    return total;
 }
 
-void Model::addMeshData(const aiMesh* mesh, const aiScene* scene) {
-    //Parse Mesh data
-    if (!mesh || !mesh->HasPositions() || !scene) {
-        qDebug() << "Weird mesh without vertex positions!";
-        return;
+VertexCacheStats Model::vertexCacheStats(unsigned int cacheSize) const {
+    VertexCacheOptimizer optimizer(cacheSize);
+    VertexCacheStats total;
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        const MeshData& sep = mSeparators[i];
+        size_t firstVertex = size_t(sep.startVertex);
+        size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : vertexCount();
+        total += optimizer.analyze(mIndices.data() + sep.startIndex, size_t(sep.howMany), lastVertex - firstVertex);
     }
+    return total;
+}
 
-    MeshData bookMark;
-    /* First the indices */
-    unsigned int numFaces = mesh->mNumFaces;
-    //I believe that I need to calculate an offset
-    //unsigned int offset = mVertices.size();
-    unsigned int indicesBefore = static_cast<unsigned int>(mIndices.size());
-    for (unsigned int t = 0; t < numFaces; ++t) {
-        const aiFace* face = &mesh->mFaces[t];
-        for (unsigned int i = 0; i < face->mNumIndices; ++i) {
-            mIndices.push_back(face->mIndices[i]);
+void Model::packIndices(std::vector<unsigned char>& packed, std::vector<MeshData>& separators) const {
+    separators = mSeparators;
+    size_t bytes = 0;
+    for (MeshData& sep : separators) {
+        const unsigned int* first = mIndices.data() + sep.startIndex;
+        unsigned int maxIndex = 0;
+        for (GLsizei i = 0; i < sep.howMany; ++i) {
+            maxIndex = std::max(maxIndex, first[i]);
+        }
+        sep.indexType = maxIndex <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        //Each type needs to start at a multiple of its size
+        size_t size = sep.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(unsigned int);
+        bytes = (bytes + size - 1) / size * size;
+        sep.indexOffset = static_cast<GLint>(bytes);
+        bytes += size * size_t(sep.howMany);
+        //The levels of detail use the same vertices, so the same type, right after
+        for (int k = 0; k < sep.lodCount; ++k) {
+            sep.lods[k].indexOffset = static_cast<GLint>(bytes);
+            bytes += size * size_t(sep.lods[k].howMany);
+        }
+    }
+    packed.assign(bytes, 0);
+    auto pack = [&](GLenum type, GLint startIndex, GLsizei howMany, GLint indexOffset) {
+        const unsigned int* first = mIndices.data() + startIndex;
+        if (type == GL_UNSIGNED_SHORT) {
+            GLushort* destination = reinterpret_cast<GLushort*>(packed.data() + indexOffset);
+            for (GLsizei i = 0; i < howMany; ++i) {
+                destination[i] = static_cast<GLushort>(first[i]);
+            }
+        } else {
+            std::memcpy(packed.data() + indexOffset, first, size_t(howMany) * sizeof(unsigned int));
+        }
+    };
+    for (const MeshData& sep : separators) {
+        pack(sep.indexType, sep.startIndex, sep.howMany, sep.indexOffset);
+        for (int k = 0; k < sep.lodCount; ++k) {
+            pack(sep.indexType, sep.lods[k].startIndex, sep.lods[k].howMany, sep.lods[k].indexOffset);
         }
     }
-    unsigned int indicesAfter = static_cast<unsigned int>(mIndices.size());
-    bookMark.startIndex = int(indicesBefore);
-    bookMark.howMany = int(indicesAfter - indicesBefore);
+}
 
-    /* Now, the Vertices */
-    Vertex v;
-    mHasNormals = mesh->HasNormals();
-    mHasTexture = mesh->HasTextureCoords(0);
-    bookMark.startVertex = int(mVertices.size());
-    for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+void Model::clearLods() {
+    size_t end = 0;
+    for (MeshData& sep : mSeparators) {
+        sep.lodCount = 0;
+        end = std::max(end, size_t(sep.startIndex) + size_t(sep.howMany));
+    }
+    mIndices.resize(end);
+}
 
-        v.position.x = mesh->mVertices[i].x;
-        v.position.y = mesh->mVertices[i].y;
-        v.position.z = mesh->mVertices[i].z;
+void Model::clearMeshlets() {
+    for (MeshData& sep : mSeparators) {
+        sep.firstMeshlet = 0;
+        sep.meshletCount = 0;
+    }
+    mMeshlets.clear();
+}
 
-        if (mHasNormals) {
-            v.normal.x = mesh->mNormals[i].x;
-            v.normal.y = mesh->mNormals[i].y;
-            v.normal.z = mesh->mNormals[i].z;
-        }
+void Model::buildMeshlets(unsigned int maxVertices, unsigned int maxTriangles) {
+    clearMeshlets();
+    MeshletBuilder builder(maxVertices, maxTriangles);
+    const StridedView<const glm::vec3> positions = positionView();
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        MeshData& sep = mSeparators[i];
+        size_t firstVertex = size_t(sep.startVertex);
+        size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : vertexCount();
+        sep.firstMeshlet = static_cast<GLint>(mMeshlets.size());
+        builder.build(mIndices.data() + sep.startIndex, size_t(sep.howMany),
+                      positions.slice(firstVertex, lastVertex - firstVertex), mMeshlets);
+        sep.meshletCount = static_cast<GLint>(mMeshlets.size()) - sep.firstMeshlet;
+    }
+}
+
+const std::vector<Meshlet>& Model::getMeshlets() const {
+    return mMeshlets;
+}
 
-        if (mHasTexture) {
-            v.textCoords.s = mesh->mTextureCoords[0][i].x;
-            v.textCoords.t = mesh->mTextureCoords[0][i].y;
+void Model::generateLods(int levels, float ratio) {
+    clearLods();
+    levels = std::max(0, std::min(levels, MAX_LODS));
+    MeshSimplifier simplifier;
+    VertexCacheOptimizer optimizer;
+    const StridedView<const glm::vec3> positions = positionView();
+    std::vector<std::vector<std::vector<unsigned int>>> meshLevels(mSeparators.size());
+    std::vector<std::vector<float>> meshErrors(mSeparators.size());
+    //Each mesh is simplified on its own, and all of them at the same time
+    parallel::forRange(mSeparators.size(), [&](size_t begin, size_t end) {
+        std::vector<size_t> targets;
+        for (size_t i = begin; i < end; ++i) {
+            const MeshData& sep = mSeparators[i];
+            size_t firstVertex = size_t(sep.startVertex);
+            size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : vertexCount();
+            size_t count = lastVertex - firstVertex;
+            //Stop before the levels are just a handful of triangles
+            targets.clear();
+            float triangles = float(sep.howMany / 3);
+            for (int k = 0; k < levels; ++k) {
+                triangles *= ratio;
+                if (triangles < 16.0f) {
+                    break;
+                }
+                targets.push_back(3 * size_t(triangles));
+            }
+            simplifier.simplify(mIndices.data() + sep.startIndex, size_t(sep.howMany),
+                                positions.slice(firstVertex, count), targets, meshLevels[i], meshErrors[i]);
+            for (std::vector<unsigned int>& level : meshLevels[i]) {
+                optimizer.reorderTriangles(level.data(), level.size(), count);
+            }
         }
+    }, 1);
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        MeshData& sep = mSeparators[i];
+        sep.lodCount = static_cast<GLint>(meshLevels[i].size());
+        for (size_t k = 0; k < meshLevels[i].size(); ++k) {
+            MeshLod& lod = sep.lods[k];
+            lod.startIndex = static_cast<GLint>(mIndices.size());
+            lod.howMany = static_cast<GLsizei>(meshLevels[i][k].size());
+            lod.indexOffset = lod.startIndex * int(sizeof(unsigned int));
+            lod.error = meshErrors[i][k];
+            mIndices.insert(mIndices.end(), meshLevels[i][k].begin(), meshLevels[i][k].end());
+        }
+    }
+}
 
-        mVertices.push_back(v);
+int Model::selectLod(const MeshData& mesh, float maxError) {
+    //The errors grow with the level
+    int level = 0;
+    while (level < mesh.lodCount && mesh.lods[level].error <= maxError) {
+        ++level;
     }
+    return level;
+}
 
-    int specularTexture = -1;
-    int diffuseTexture = -1;
-    if (mesh->mMaterialIndex > 0) {
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        diffuseTexture = addDiffuseTexture(material);
-        specularTexture = addSpecularTexture(material);
+void Model::lodRange(const MeshData& mesh, int level, GLsizei& howMany, GLint& indexOffset) {
+    if (level <= 0 || level > mesh.lodCount) {
+        howMany = mesh.howMany;
+        indexOffset = mesh.indexOffset;
+    } else {
+        howMany = mesh.lods[level - 1].howMany;
+        indexOffset = mesh.lods[level - 1].indexOffset;
     }
+}
 
-    bookMark.diffuseIndex = diffuseTexture;
-    bookMark.specIndex = specularTexture;
-    mSeparators.push_back(bookMark);
+size_t Model::splitMeshes(size_t maxVertices) {
+    const unsigned int NOT_USED = ~0u;
+    maxVertices = std::max<size_t>(maxVertices, 3);
+    std::vector<Vertex> source = getVertices();
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<MeshData> separators;
+    vertices.reserve(source.size());
+    indices.reserve(mIndices.size());
+    //Place of each vertex of the mesh in the current piece, and the vertices of the piece
+    std::vector<unsigned int> local;
+    std::vector<unsigned int> used;
+    for (size_t i = 0; i < mSeparators.size(); ++i) {
+        MeshData sep = mSeparators[i];
+        size_t firstVertex = size_t(sep.startVertex);
+        size_t lastVertex = i + 1 < mSeparators.size() ? size_t(mSeparators[i + 1].startVertex) : source.size();
+        const unsigned int* meshIndices = mIndices.data() + sep.startIndex;
+        size_t indexCount = size_t(sep.howMany);
+        local.assign(lastVertex - firstVertex, NOT_USED);
+        used.clear();
+        //Close the current piece: its vertices go after the ones of the previous one
+        auto addPiece = [&](size_t firstIndex) {
+            MeshData piece = sep;
+            piece.startVertex = static_cast<GLint>(vertices.size());
+            piece.startIndex = static_cast<GLint>(firstIndex);
+            piece.howMany = static_cast<GLsizei>(indices.size() - firstIndex);
+            piece.indexType = GL_UNSIGNED_INT;
+            piece.indexOffset = piece.startIndex * int(sizeof(unsigned int));
+            piece.lodCount = 0;
+            piece.meshletCount = 0;
+            for (unsigned int v : used) {
+                vertices.push_back(source[firstVertex + v]);
+                local[v] = NOT_USED;
+            }
+            used.clear();
+            separators.push_back(piece);
+        };
+        size_t firstIndex = indices.size();
+        if (lastVertex - firstVertex <= maxVertices) {
+            //Small enough, it stays as it is (unused vertices included)
+            for (size_t k = 0; k < lastVertex - firstVertex; ++k) {
+                used.push_back(static_cast<unsigned int>(k));
+            }
+            indices.insert(indices.end(), meshIndices, meshIndices + indexCount);
+            addPiece(firstIndex);
+            continue;
+        }
+        for (size_t t = 0; t + 2 < indexCount; t += 3) {
+            size_t newVertices = 0;
+            for (size_t c = 0; c < 3; ++c) {
+                newVertices += local[meshIndices[t + c]] == NOT_USED ? 1 : 0;
+            }
+            if (used.size() + newVertices > maxVertices) {
+                addPiece(firstIndex);
+                firstIndex = indices.size();
+            }
+            for (size_t c = 0; c < 3; ++c) {
+                unsigned int& v = local[meshIndices[t + c]];
+                if (v == NOT_USED) {
+                    v = static_cast<unsigned int>(used.size());
+                    used.push_back(meshIndices[t + c]);
+                }
+                indices.push_back(v);
+            }
+        }
+        if (indices.size() > firstIndex) {
+            addPiece(firstIndex);
+        }
+    }
+    size_t added = separators.size() - mSeparators.size();
+    setVertices(vertices);
+    mIndices.swap(indices);
+    mSeparators.swap(separators);
+    mMeshlets.clear();
+    return added;
 }
 
-int Model::addDiffuseTexture(const aiMaterial* mat) {
-    if (!mat) {
-        return -1;
+void Model::processNode(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& meshes) {
+    // Process all the meshes (if any) in this node
+    for(unsigned int i = 0; i < node->mNumMeshes; i++) {
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
-    std::string textPath = "";
-    if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
-        aiString fileName;
-        mat->GetTexture(aiTextureType_DIFFUSE, 0, &fileName);
-        textPath = std::string(fileName.C_Str());
-    } else {
-        //NO diffuse texture for this Mesh
-        return -1;
+    // Then, recursivelly procees the child nodes
+    for(unsigned int i = 0; i < node->mNumChildren; i++) {
+        processNode(node->mChildren[i], scene, meshes);
     }
+}
 
-    //Check if this texture is already in the vector
+void Model::addMeshes(const std::vector<const aiMesh*>& meshes, const aiScene* scene) {
+    //First (in the order of the meshes) find where the indices and vertices
+    //of each mesh go, and add its textures. Nothing else depends on the order
+    std::vector<ImportPiece> pieces;
+    //Textures by normalized path, so each one is looked up in constant time
+    std::unordered_map<std::string, int> textures;
     for (size_t i = 0; i < mTexturesData.size(); ++i) {
-        if (mTexturesData[i].filePath == textPath) {
-            return int(i);
+        textures.emplace(normalizedPath(mTexturesData[i].filePath), int(i));
+    }
+    size_t indexCount = mIndices.size();
+    size_t vertexCount = mVertices.size();
+    for (const aiMesh* mesh : meshes) {
+        if (!mesh || !mesh->HasPositions() || !scene) {
+            qDebug() << "Weird mesh without vertex positions!";
+            continue;
         }
+        MeshData bookMark;
+        bookMark.startIndex = int(indexCount);
+        bookMark.startVertex = int(vertexCount);
+        //After aiProcess_Triangulate, usually every face has three indices
+        const bool triangles = mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE;
+        for (unsigned int first = 0; first < mesh->mNumFaces; first += IMPORT_PIECE) {
+            unsigned int last = std::min(mesh->mNumFaces, first + IMPORT_PIECE);
+            pieces.push_back(ImportPiece{mesh, first, last, indexCount, true});
+            if (triangles) {
+                indexCount += 3 * size_t(last - first);
+            } else {
+                for (unsigned int t = first; t < last; ++t) {
+                    indexCount += mesh->mFaces[t].mNumIndices;
+                }
+            }
+        }
+        for (unsigned int first = 0; first < mesh->mNumVertices; first += IMPORT_PIECE) {
+            unsigned int last = std::min(mesh->mNumVertices, first + IMPORT_PIECE);
+            pieces.push_back(ImportPiece{mesh, first, last, vertexCount + first, false});
+        }
+        vertexCount += mesh->mNumVertices;
+        bookMark.howMany = int(indexCount) - bookMark.startIndex;
+        bookMark.indexType = GL_UNSIGNED_INT;
+        bookMark.indexOffset = bookMark.startIndex * int(sizeof(unsigned int));
+        bookMark.lodCount = 0;
+        bookMark.firstMeshlet = 0;
+        bookMark.meshletCount = 0;
+        mHasNormals = mesh->HasNormals();
+        mHasTexture = mesh->HasTextureCoords(0);
+
+        int specularTexture = -1;
+        int diffuseTexture = -1;
+        if (mesh->mMaterialIndex > 0) {
+            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            diffuseTexture = addTexture(material, aiTextureType_DIFFUSE, textures);
+            specularTexture = addTexture(material, aiTextureType_SPECULAR, textures);
+        }
+
+        bookMark.diffuseIndex = diffuseTexture;
+        bookMark.specIndex = specularTexture;
+        mSeparators.push_back(bookMark);
     }
 
-    //It's is not then create it an push it into the vector
-    TextureImage text;
-    text.type = DIFFUSE;
-    text.filePath = textPath;
-    mTexturesData.push_back(text);
-    return static_cast<int>(mTexturesData.size() - 1);
+    //Then convert the pieces concurrently. Each one writes only its own part
+    //of the arrays, so the result is the same as converting them in order
+    mIndices.resize(indexCount);
+    mVertices.resize(vertexCount);
+    parallel::forRange(pieces.size(), [this, &pieces](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            const ImportPiece& piece = pieces[p];
+            const aiMesh* mesh = piece.mesh;
+            if (piece.faces) {
+                unsigned int* target = mIndices.data() + piece.target;
+                for (unsigned int t = piece.first; t < piece.last; ++t) {
+                    const aiFace& face = mesh->mFaces[t];
+                    target = std::copy(face.mIndices, face.mIndices + face.mNumIndices, target);
+                }
+                continue;
+            }
+            const bool normals = mesh->HasNormals();
+            const bool textCoords = mesh->HasTextureCoords(0);
+            Vertex* target = mVertices.data() + piece.target;
+            for (unsigned int i = piece.first; i < piece.last; ++i, ++target) {
+                target->position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+                target->normal = normals ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z)
+                                         : glm::vec3(0.0f);
+                target->textCoords = textCoords ? glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y)
+                                                : glm::vec2(0.0f);
+            }
+        }
+    }, 1);
 }
 
-int Model::addSpecularTexture(const aiMaterial* mat) {
-    if (!mat) {
-        return -1;
-    }
-
-    std::string textPath = "";
-    if (mat->GetTextureCount(aiTextureType_SPECULAR) > 0) {
-        aiString fileName;
-        mat->GetTexture(aiTextureType_SPECULAR, 0, &fileName);
-        textPath = std::string(fileName.C_Str());
-    } else {
-        //NO specular texture for this Mesh
+int Model::addTexture(const aiMaterial* material, aiTextureType type, std::unordered_map<std::string, int>& registry) {
+    if (!material || material->GetTextureCount(type) == 0) {
+        //NO texture of this type for this Mesh
         return -1;
     }
+    aiString fileName;
+    material->GetTexture(type, 0, &fileName);
+    std::string textPath = std::string(fileName.C_Str());
 
     //Check if this texture is already in the vector
-    for (size_t i = 0; i < mTexturesData.size(); ++i) {
-        if (mTexturesData[i].filePath == textPath) {
-            return int(i);
-        }
+    std::string key = normalizedPath(textPath);
+    auto found = registry.find(key);
+    if (found != registry.end()) {
+        return found->second;
     }
 
     //It's is not then create it an push it into the vector
     TextureImage text;
-    text.type = SPECULAR;
+    text.type = type == aiTextureType_SPECULAR ? SPECULAR : DIFFUSE;
     text.filePath = textPath;
     mTexturesData.push_back(text);
-    return static_cast<int>(mTexturesData.size() - 1);
+    int id = static_cast<int>(mTexturesData.size() - 1);
+    registry.emplace(key, id);
+    return id;
 }
 
-
-std::vector<TextureImage> Model::getTextures() const {
+const std::vector<TextureImage>& Model::getTextures() const {
     return mTexturesData;
 }
+
+ArrayView<const TextureImage> Model::texturesView() const {
+    return ArrayView<const TextureImage>(mTexturesData);
+}
+
+void Model::releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    std::vector<MeshData> separators;
+    std::vector<TextureImage> textures;
+    releaseGeometry(vertices, indices, separators, textures);
+}
+
+void Model::releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+                            std::vector<MeshData>& separators, std::vector<TextureImage>& textures) {
+    Mesh::releaseGeometry(vertices, indices);
+    separators = std::move(mSeparators);
+    textures = std::move(mTexturesData);
+    mSeparators.clear();
+    mMeshlets.clear();
+    mTexturesData.clear();
+}
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include <assimp/IOSystem.hpp>
 #include <assimp/Importer.hpp>
@@ -10,6 +11,29 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "mesh.h"
+#include "meshletbuilder.h"
+
+class GeometryCache;
+class CachedModel;
+
+//! Maximum number of simplified versions that a mesh can have (See Model generateLods)
+const int MAX_LODS = 4;
+
+//! A simplified version (level of detail) of a mesh of a \class Model
+/*!
+  It uses the same vertices of the mesh (and so its startVertex and
+  indexType), with its own indices.
+*/
+typedef struct MeshLod {
+    //! The place of the first index of this level.
+    GLint startIndex;
+    //! Number of indexes in this level.
+    GLsizei howMany;
+    //! Place of the first index of this level in the index buffer, in bytes
+    GLint indexOffset;
+    //! How far (in model units) this level is from the surface of the mesh
+    float error;
+} MeshLod;
 
 //!  A simple struct that act as a separator of the Meshes in this model.
 /*!
@@ -38,6 +62,24 @@ typedef struct MeshData {
      * or -1 if this mesh does not have a diffuse texture
     */
     int diffuseIndex;
+    //! Type of the indices of this mesh in the index buffer
+    /*! GL_UNSIGNED_INT in the indices of the Model. In a packed buffer
+        (See Model packIndices) it is GL_UNSIGNED_SHORT if all the indices
+        of this mesh fit in 16 bits.
+    */
+    GLenum indexType;
+    //! Place of the first index of this mesh in the index buffer, in bytes
+    /*! To be used as the indices pointer of glDrawElementsBaseVertex
+    */
+    GLint indexOffset;
+    //! Number of simplified versions of this mesh in lods
+    GLint lodCount;
+    //! The simplified versions of this mesh, from the finest to the coarsest
+    MeshLod lods[MAX_LODS];
+    //! Place of the first meshlet of this mesh in the meshlets of the Model
+    GLint firstMeshlet;
+    //! Number of meshlets of this mesh (See Model buildMeshlets)
+    GLint meshletCount;
 } MeshData;
 
 enum TextType {DIFFUSE, SPECULAR, NORMALS, OTHER};
@@ -80,19 +122,50 @@ class Model : public Mesh {
 
 protected:
     std::vector<TextureImage> mTexturesData;
-    void processNode(aiNode* node, const aiScene* scene);
-    void addMeshData(const aiMesh* mesh, const aiScene* scene);
-    int addDiffuseTexture(const aiMaterial* material);
-    int addSpecularTexture(const aiMaterial* material);
+    //! Collect the meshes of node and then of its children, in the order they are added
+    void processNode(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& meshes);
+    //! Append the meshes to the arrays, sizing all of them first and converting them in parallel
+    void addMeshes(const std::vector<const aiMesh*>& meshes, const aiScene* scene);
+    //! Index in mTexturesData of the first texture of type of the material (-1 if none)
+    /*!
+      registry has the index of each texture by its normalized path, so a
+      file that several materials use is added once.
+    */
+    int addTexture(const aiMaterial* material, aiTextureType type, std::unordered_map<std::string, int>& registry);
     std::vector<MeshData> mSeparators;
+    std::vector<Meshlet> mMeshlets;
+    //! Remove the levels of detail of every mesh (and their indices)
+    void clearLods();
+    //! Remove the meshlets of every mesh
+    void clearMeshlets();
 
 public:
+    //! The Assimp post-processing steps applied on every load
+    static const unsigned int IMPORT_FLAGS;
     //! Simple constructor that only initialices the data struct.
     Model();
     //! Loads this 3D model from the fileName
     explicit Model(const QString& fileName);
+    //! A Model can be moved (without copying its arrays) and copied.
+    Model(Model&& other) = default;
+    Model& operator=(Model&& other) = default;
+    Model(const Model& other) = default;
+    Model& operator=(const Model& other) = default;
     //! Clears the current data. Then loads this 3D model from the fileName
     bool load(const QString& fileName);
+    //! Clears the current data. Then converts a scene already imported by Assimp
+    bool load(const aiScene* scene);
+    //! Same as load, but going through a \class GeometryCache
+    /*!
+      If the cache has an up to date entry for the file, Assimp is not used
+      at all: the arrays are just copied from the mapped entry. Otherwise the
+      file is imported, optimized (See optimizeVertexCache), its levels of
+      detail and meshlets generated (See generateLods and buildMeshlets) and
+      the entry is written for the next time.
+    */
+    bool load(const QString& fileName, const GeometryCache& cache);
+    //! Clears the current data. Then copies the model from an entry of the cache
+    bool load(const CachedModel& cached);
     //! Get a vector of MeshData that act as a separator of the meshes.
     /*!
       Get a vector of MeshData, since all the model data is contained in a 
@@ -100,7 +173,9 @@ public:
       They provide with all the date nneded to render each mesh using
       glDrawElementsBaseVertex.
     */
-    std::vector<MeshData> getSeparators() const;
+    const std::vector<MeshData>& getSeparators() const;
+    //! A view of the separators, without copying them
+    ArrayView<const MeshData> separatorsView() const;
     //! Get the filenames of each of the textures in this model.
     /*!
       Get the filenames of each of the textures in this model.
@@ -108,7 +183,92 @@ public:
       string is placed. So the vector always contain as many elements as mesh
       are in the model
     */
-    std::vector<TextureImage> getTextures() const;
+    const std::vector<TextureImage>& getTextures() const;
+    //! A view of the textures, without copying them
+    ArrayView<const TextureImage> texturesView() const;
+    //! Move the vertices and indices out of this Model, which is left empthy
+    /*!
+      The separators, meshlets and textures describe those arrays, so they
+      are dropped too. Use the overload below to take them as well.
+    */
+    void releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+    //! Move all the data out of this Model, which is left empthy
+    /*!
+      Same as \class Mesh releaseGeometry, but it also hands over the
+      separators of the meshes and the textures table. Use it when the Model
+      is only a loader, so its arrays can go to the GPU without any copy.
+    */
+    void releaseGeometry(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+                         std::vector<MeshData>& separators, std::vector<TextureImage>& textures);
+    //! Calculate (and replace) the normal vectors of all the meshes
+    /*!
+      Same as \class Mesh recalculateNormals, but each mesh of the model is
+      processed on its own. If the crease angle splits some vertices, the
+      separators are updated to the new place of each mesh.
+    */
+    void recalculateNormals(NormalWeighting weighting = ANGLE_WEIGHTS, float creaseAngle = 180.0f) override;
+    //! Reorder the triangles and vertices of every mesh to render them faster
+    /*!
+      Same as \class Mesh optimizeVertexCache, but each mesh is reordered on
+      its own (and all of them at the same time), inside its own range of
+      indices and vertices. So the separators do not change. The report adds
+      up the stats of all the meshes.
+    */
+    VertexCacheReport optimizeVertexCache(unsigned int cacheSize = VertexCacheOptimizer::DEFAULT_CACHE_SIZE,
+                                          float overdrawThreshold = 0.0f) override;
+    VertexCacheStats vertexCacheStats(unsigned int cacheSize = VertexCacheOptimizer::DEFAULT_CACHE_SIZE) const override;
+    //! Pack the indices using the smallest type that each mesh allows
+    /*!
+      The indices of a mesh are relative to its startVertex. So, if the mesh
+      has up to 65536 vertices they are written as 16 bits integers, halving
+      their memmory and bandwidth. Otherwise they stay as 32 bits integers.
+
+      On return, packed has the bytes of the index buffer and separators a
+      copy of the separators of this Model whose indexType and indexOffset
+      describe the packed buffer. The indices of this Model do not change.
+    */
+    void packIndices(std::vector<unsigned char>& packed, std::vector<MeshData>& separators) const;
+    //! Split the meshes with more than maxVertices vertices into several meshes
+    /*!
+      Each new mesh takes the next triangles, in their current order, while
+      they use up to maxVertices different vertices. The vertices shared by
+      two new meshes are duplicated. With the default, every mesh can then be
+      packed with 16 bits indices (See packIndices). Returns the number of
+      meshes that were added.
+    */
+    size_t splitMeshes(size_t maxVertices = 65536);
+    //! Generate up to levels simplified versions of every mesh (See \class MeshSimplifier)
+    /*!
+      Each level has about ratio times the triangles of the previous one, and
+      its triangles are ordered for the vertex cache. Their indices go after
+      the ones of all the meshes, so drawing the meshes does not change.
+
+      The levels only last while the vertices and indices of the meshes do
+      not change: recalculateNormals, optimizeVertexCache and splitMeshes
+      remove them. So generate them at the end.
+    */
+    void generateLods(int levels = MAX_LODS, float ratio = 0.5f);
+    //! The coarsest level of mesh whose error is at most maxError
+    /*!
+      Returns 0 for the mesh itself or i for mesh.lods[i - 1]. Use it with
+      the error that the camera allows: a pixel, divided by the pixels that
+      a unit of the model takes on screen.
+    */
+    static int selectLod(const MeshData& mesh, float maxError);
+    //! Where the indices of a level of a mesh are (See selectLod)
+    static void lodRange(const MeshData& mesh, int level, GLsizei& howMany, GLint& indexOffset);
+    //! Split every mesh in meshlets (See \class MeshletBuilder)
+    /*!
+      The meshlets of each mesh are ranges of its indices, so they can be
+      drawn (or skipped, See \class MeshletCuller) with the index buffer of
+      the model. They are only for the full mesh, not for its levels of
+      detail. As these, they are removed when the indices change, so build
+      them at the end.
+    */
+    void buildMeshlets(unsigned int maxVertices = MeshletBuilder::DEFAULT_MAX_VERTICES,
+                       unsigned int maxTriangles = MeshletBuilder::DEFAULT_MAX_TRIANGLES);
+    //! The meshlets of all the meshes (See MeshData firstMeshlet)
+    const std::vector<Meshlet>& getMeshlets() const;
     //! Get the number of meshes in this Model.
     int numMeshes();
 };
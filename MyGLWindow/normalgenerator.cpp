@@ -0,0 +1,209 @@
+#include "normalgenerator.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+using glm::vec3;
+
+namespace {
+//Two corner normals closer than this (in cosine) share the same vertex
+const float SAME_NORMAL = 0.99999f;
+
+//The angle of the triangle (p, q, r) at p. Robust also for thin triangles
+inline float cornerAngle(const vec3& p, const vec3& q, const vec3& r) {
+    vec3 u = q - p;
+    vec3 v = r - p;
+    return std::atan2(glm::length(glm::cross(u, v)), glm::dot(u, v));
+}
+}
+
+NormalGenerator::NormalGenerator(NormalWeighting weighting, float creaseAngle) :
+    mWeighting(weighting) {
+    creaseAngle = glm::clamp(creaseAngle, 0.0f, 180.0f);
+    mCosCrease = std::cos(glm::radians(creaseAngle));
+    mSplit = creaseAngle < 180.0f;
+}
+
+void NormalGenerator::generate(StridedView<const vec3> positions, std::vector<unsigned int>& indices,
+                               std::vector<vec3>& normals, std::vector<unsigned int>& copies) const {
+    const size_t vertexCount = positions.size();
+    const size_t triangles = indices.size() / 3;
+    const size_t corners = 3 * triangles;
+    normals.assign(vertexCount, vec3(0.0f));
+    copies.clear();
+    if (vertexCount == 0) {
+        return;
+    }
+
+    //First, the unit normal of each triangle and the weight of each of its corners
+    std::vector<vec3> faceNormal(triangles);
+    std::vector<float> cornerWeight(corners);
+    parallel::forRange(triangles, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            unsigned int i0 = indices[3 * t];
+            unsigned int i1 = indices[3 * t + 1];
+            unsigned int i2 = indices[3 * t + 2];
+            vec3 n(0.0f);
+            float length = 0.0f;
+            if (i0 < vertexCount && i1 < vertexCount && i2 < vertexCount) {
+                n = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]);
+                length = glm::length(n);
+            }
+            if (!(length > 0.0f)) {
+                //Degenerated triangle, it does not contribute to any vertex
+                faceNormal[t] = vec3(0.0f);
+                cornerWeight[3 * t] = cornerWeight[3 * t + 1] = cornerWeight[3 * t + 2] = 0.0f;
+                continue;
+            }
+            faceNormal[t] = n / length;
+            switch (mWeighting) {
+                case UNIFORM_WEIGHTS:
+                    cornerWeight[3 * t] = cornerWeight[3 * t + 1] = cornerWeight[3 * t + 2] = 1.0f;
+                break;
+
+                case AREA_WEIGHTS:
+                    //The length of the cross product is twice the area
+                    cornerWeight[3 * t] = cornerWeight[3 * t + 1] = cornerWeight[3 * t + 2] = 0.5f * length;
+                break;
+
+                case ANGLE_WEIGHTS:
+                {
+                    const vec3& a = positions[i0];
+                    const vec3& b = positions[i1];
+                    const vec3& c = positions[i2];
+                    cornerWeight[3 * t] = cornerAngle(a, b, c);
+                    cornerWeight[3 * t + 1] = cornerAngle(b, c, a);
+                    cornerWeight[3 * t + 2] = cornerAngle(c, a, b);
+                }
+                break;
+            }
+        }
+    });
+
+    //Now, the list of corners around each vertex (a counting sort by vertex)
+    std::vector<unsigned int> first(vertexCount + 1);
+    std::vector<unsigned int> incident;
+    {
+        std::unique_ptr<std::atomic<unsigned int>[]> cursor(new std::atomic<unsigned int>[vertexCount]);
+        parallel::forRange(vertexCount, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                cursor[v].store(0, std::memory_order_relaxed);
+            }
+        });
+        parallel::forRange(corners, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                if (cornerWeight[c] > 0.0f) {
+                    cursor[indices[c]].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+        first[0] = 0;
+        for (size_t v = 0; v < vertexCount; ++v) {
+            first[v + 1] = first[v] + cursor[v].load(std::memory_order_relaxed);
+            cursor[v].store(first[v], std::memory_order_relaxed);
+        }
+        incident.resize(first[vertexCount]);
+        parallel::forRange(corners, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                if (cornerWeight[c] > 0.0f) {
+                    incident[cursor[indices[c]].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(c);
+                }
+            }
+        });
+        //The order of the threads is random, sort so the sums are always done in the same order
+        parallel::forRange(vertexCount, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                std::sort(incident.begin() + first[v], incident.begin() + first[v + 1]);
+            }
+        });
+    }
+
+    if (!mSplit) {
+        //Every vertex gathers the normals of its triangles
+        parallel::forRange(vertexCount, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; ++v) {
+                vec3 n(0.0f);
+                for (unsigned int k = first[v]; k < first[v + 1]; ++k) {
+                    unsigned int c = incident[k];
+                    n += cornerWeight[c] * faceNormal[c / 3];
+                }
+                float length = glm::length(n);
+                normals[v] = length > 0.0f ? n / length : vec3(0.0f);
+            }
+        });
+        return;
+    }
+
+    //With a crease angle, each corner only gathers the triangles of the vertex
+    //that are within the crease angle of its own triangle. Then, the different
+    //normals of a vertex are grouped, and each group needs its own vertex.
+    auto groupCorners = [&](size_t v, std::vector<vec3>& groups, std::vector<unsigned int>& groupOf) {
+        groups.clear();
+        groupOf.clear();
+        for (unsigned int k = first[v]; k < first[v + 1]; ++k) {
+            const vec3& own = faceNormal[incident[k] / 3];
+            vec3 n(0.0f);
+            for (unsigned int l = first[v]; l < first[v + 1]; ++l) {
+                unsigned int c = incident[l];
+                if (glm::dot(own, faceNormal[c / 3]) >= mCosCrease) {
+                    n += cornerWeight[c] * faceNormal[c / 3];
+                }
+            }
+            n = glm::normalize(n);
+            size_t g = 0;
+            while (g < groups.size() && glm::dot(groups[g], n) < SAME_NORMAL) {
+                ++g;
+            }
+            if (g == groups.size()) {
+                groups.push_back(n);
+            }
+            groupOf.push_back(static_cast<unsigned int>(g));
+        }
+    };
+
+    //First sweep only counts how many extra vertices each vertex needs
+    std::vector<unsigned int> extra(vertexCount + 1);
+    parallel::forRange(vertexCount, [&](size_t begin, size_t end) {
+        std::vector<vec3> groups;
+        std::vector<unsigned int> groupOf;
+        for (size_t v = begin; v < end; ++v) {
+            groupCorners(v, groups, groupOf);
+            extra[v] = groups.empty() ? 0 : static_cast<unsigned int>(groups.size() - 1);
+        }
+    });
+    unsigned int total = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        unsigned int count = extra[v];
+        extra[v] = total;
+        total += count;
+    }
+    normals.resize(vertexCount + total);
+    copies.resize(total);
+
+    //Second sweep writes the normals, the copied vertices and their indices
+    parallel::forRange(vertexCount, [&](size_t begin, size_t end) {
+        std::vector<vec3> groups;
+        std::vector<unsigned int> groupOf;
+        for (size_t v = begin; v < end; ++v) {
+            groupCorners(v, groups, groupOf);
+            if (groups.empty()) {
+                continue;
+            }
+            normals[v] = groups[0];
+            for (size_t g = 1; g < groups.size(); ++g) {
+                size_t copy = extra[v] + g - 1;
+                copies[copy] = static_cast<unsigned int>(v);
+                normals[vertexCount + copy] = groups[g];
+            }
+            for (unsigned int k = first[v]; k < first[v + 1]; ++k) {
+                unsigned int g = groupOf[k - first[v]];
+                if (g > 0) {
+                    indices[incident[k]] = static_cast<unsigned int>(vertexCount + extra[v] + g - 1);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,49 @@
+#ifndef NORMALGENERATOR_H
+#define NORMALGENERATOR_H
+
+#include <vector>
+#include "mesh.h"
+#include "stridedview.h"
+
+//! A class that calculates smooth vertex normals of an indexed triangle mesh.
+/*!
+  It is the engine behind \class Mesh recalculateNormals. The normal of a
+  vertex is the weighted average of the normals of the triangles around it.
+  The weights are selected with \enum NormalWeighting.
+
+  The work is done as a gather: first the normal of every triangle is
+  calculated, then a vertex to triangle adjacency is built and finally each
+  vertex adds the normals of its own triangles. So there are no concurrent
+  writes (nor atomics on floats) and the result is the same no matter how many
+  threads are used.
+
+  When a crease angle smaller than 180 degrees is given, the triangles around
+  a vertex whose normals differ more than the crease angle are not smoothed
+  together. In that case the vertex needs to be duplicated as many times as
+  different normals it has, and the indices are updated to use the copies.
+
+  It only reads the positions, through a \class StridedView. So it works the
+  same with interleaved vertices and with separated attribute streams.
+*/
+class NormalGenerator {
+public:
+    //! Create a generator with a weighting mode and a crease angle in degrees
+    explicit NormalGenerator(NormalWeighting weighting = ANGLE_WEIGHTS, float creaseAngle = 180.0f);
+    //! Calculate the normals of the vertices referenced by the indices
+    /*!
+      On return, normals has one normal per position followed by one normal
+      per copied vertex. Vertices that are not used by any (non degenerated)
+      triangle get a zero normal. If the crease angle splits some vertices,
+      copies has (for each new vertex) the vertex that it duplicates. The new
+      vertices go after the existing ones, and the indices already use them.
+    */
+    void generate(StridedView<const glm::vec3> positions, std::vector<unsigned int>& indices,
+                  std::vector<glm::vec3>& normals, std::vector<unsigned int>& copies) const;
+
+private:
+    NormalWeighting mWeighting;
+    float mCosCrease;
+    bool mSplit;
+};
+
+#endif // NORMALGENERATOR_H
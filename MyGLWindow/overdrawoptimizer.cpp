@@ -0,0 +1,143 @@
+#include "overdrawoptimizer.h"
+
+#include <algorithm>
+#include <vector>
+
+using glm::vec3;
+
+namespace {
+//A FIFO post-transform cache, as the one of VertexCacheOptimizer::analyze
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, unsigned int size) :
+        mEntered(vertexCount, 0), mSize(size), mTime(size + 1) {}
+    //Forget everything, as if the cache was flushed
+    void flush() {
+        mTime += mSize + 1;
+    }
+    //Draw a triangle and get how many of its vertices were transformed
+    unsigned int draw(const unsigned int* triangle) {
+        unsigned int misses = 0;
+        for (int c = 0; c < 3; ++c) {
+            size_t& entered = mEntered[triangle[c]];
+            if (mTime - entered > mSize) {
+                entered = mTime++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+private:
+    std::vector<size_t> mEntered;
+    size_t mSize;
+    size_t mTime;
+};
+
+struct Cluster {
+    size_t first;
+    size_t count;
+    float sortKey;
+};
+}
+
+OverdrawOptimizer::OverdrawOptimizer(float threshold, unsigned int cacheSize) : mCacheSize(cacheSize) {
+    setThreshold(threshold);
+}
+
+void OverdrawOptimizer::setThreshold(float threshold) {
+    mThreshold = std::max(threshold, 1.0f);
+}
+
+float OverdrawOptimizer::threshold() const {
+    return mThreshold;
+}
+
+void OverdrawOptimizer::reorderTriangles(unsigned int* indices, size_t indexCount,
+                                         StridedView<const vec3> positions) const {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) {
+        return;
+    }
+
+    //Hard boundaries: the triangles where the current order misses all the
+    //vertices already. Cutting there costs nothing
+    std::vector<size_t> hard;
+    size_t totalMisses = 0;
+    {
+        FifoCache cache(positions.size(), mCacheSize);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            unsigned int misses = cache.draw(indices + 3 * t);
+            totalMisses += misses;
+            if (t == 0 || misses == 3) {
+                hard.push_back(t);
+            }
+        }
+        hard.push_back(triangleCount);
+    }
+    const float targetAcmr = mThreshold * float(totalMisses) / float(triangleCount);
+
+    //Soft boundaries: inside each hard cluster, cut as soon as the piece so far
+    //(starting with a cold cache) is within the threshold
+    std::vector<Cluster> clusters;
+    FifoCache cache(positions.size(), mCacheSize);
+    for (size_t h = 0; h + 1 < hard.size(); ++h) {
+        size_t start = hard[h];
+        size_t misses = 0;
+        cache.flush();
+        for (size_t t = hard[h]; t < hard[h + 1]; ++t) {
+            misses += cache.draw(indices + 3 * t);
+            bool last = t + 1 == hard[h + 1];
+            if (last || float(misses) <= targetAcmr * float(t + 1 - start)) {
+                clusters.push_back(Cluster{start, t + 1 - start, 0.0f});
+                start = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+
+    //Area weighted centroid and normal of each cluster and of the whole mesh
+    std::vector<vec3> centroids(clusters.size(), vec3(0.0f));
+    std::vector<vec3> normals(clusters.size(), vec3(0.0f));
+    vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        float clusterArea = 0.0f;
+        for (size_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+            const vec3& p0 = positions[indices[3 * t]];
+            const vec3& p1 = positions[indices[3 * t + 1]];
+            const vec3& p2 = positions[indices[3 * t + 2]];
+            vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            centroids[c] += area * (p0 + p1 + p2) / 3.0f;
+            normals[c] += n;
+            clusterArea += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += clusterArea;
+        if (clusterArea > 0.0f) {
+            centroids[c] /= clusterArea;
+        }
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+    for (size_t c = 0; c < clusters.size(); ++c) {
+        float length = glm::length(normals[c]);
+        if (length > 0.0f) {
+            clusters[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c] / length);
+        }
+    }
+
+    //Most outward facing first. Stable, so ties keep the cache order
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+        return a.sortKey > b.sortKey;
+    });
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    for (const Cluster& cluster : clusters) {
+        output.insert(output.end(), indices + 3 * cluster.first, indices + 3 * (cluster.first + cluster.count));
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
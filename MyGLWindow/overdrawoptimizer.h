@@ -0,0 +1,43 @@
+#ifndef OVERDRAWOPTIMIZER_H
+#define OVERDRAWOPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include "stridedview.h"
+#include "vertexcacheoptimizer.h"
+
+//! A class that reorders the triangles of a mesh to reduce the overdraw.
+/*!
+  It is the optional second pass of \class Mesh optimizeVertexCache, and it
+  expects the triangles already ordered for the vertex cache (See
+  \class VertexCacheOptimizer). The order is view independent, as described
+  by Sander, Nehab and Barczak 2007:
+
+  1) The triangles are cut in clusters where the cache order already breaks
+  (all the vertices of a triangle miss), and where the cluster has reached an
+  ACMR within threshold times the ACMR of the whole mesh. So the clusters can
+  be moved around loosing a bounded amount of cache efficiency (a little more
+  than the threshold in total, since each cluster starts with a cold cache).
+
+  2) The clusters are sorted from the most to the least outward facing: by
+  how much the cluster's centroid is in front of the centroid of the mesh
+  along the cluster's normal. The outer surface tends to be drawn first, so
+  the early depth test discards more of the hidden fragments before they are
+  shaded.
+*/
+class OverdrawOptimizer {
+public:
+    //! Create an optimizer that can make the ACMR at most threshold times worse
+    explicit OverdrawOptimizer(float threshold = 1.05f,
+                               unsigned int cacheSize = VertexCacheOptimizer::DEFAULT_CACHE_SIZE);
+    void setThreshold(float threshold);
+    float threshold() const;
+    //! Reorder (in place) the clusters of triangles of a cache optimized mesh
+    void reorderTriangles(unsigned int* indices, size_t indexCount,
+                          StridedView<const glm::vec3> positions) const;
+
+private:
+    float mThreshold;
+    unsigned int mCacheSize;
+};
+
+#endif // OVERDRAWOPTIMIZER_H
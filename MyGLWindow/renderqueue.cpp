@@ -0,0 +1,87 @@
+#include "renderqueue.h"
+
+#include <cstring>
+
+namespace {
+const int DEPTH_BITS = 32;
+const int MATERIAL_SHIFT = DEPTH_BITS;
+const int PROGRAM_SHIFT = MATERIAL_SHIFT + RenderQueue::MATERIAL_BITS;
+const int PASS_SHIFT = PROGRAM_SHIFT + RenderQueue::PROGRAM_BITS;
+}
+
+uint64_t RenderQueue::makeKey(Pass pass, unsigned int program, unsigned int material, float depth) {
+    //The bits of a positive float sort as the float does (and behind the camera is as close as it gets)
+    uint32_t depthBits = 0;
+    if (depth > 0.0f) {
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    }
+    if (pass == TRANSPARENT_PASS) {
+        //Back to front, whatever the material
+        material = 0;
+        depthBits = ~depthBits;
+    }
+    return (uint64_t(pass) << PASS_SHIFT) |
+           (uint64_t(program & ((1u << PROGRAM_BITS) - 1)) << PROGRAM_SHIFT) |
+           (uint64_t(material & ((1u << MATERIAL_BITS) - 1)) << MATERIAL_SHIFT) |
+           uint64_t(depthBits);
+}
+
+RenderQueue::Pass RenderQueue::pass(uint64_t key) {
+    return Pass(key >> PASS_SHIFT);
+}
+
+unsigned int RenderQueue::program(uint64_t key) {
+    return unsigned(key >> PROGRAM_SHIFT) & ((1u << PROGRAM_BITS) - 1);
+}
+
+unsigned int RenderQueue::material(uint64_t key) {
+    return unsigned(key >> MATERIAL_SHIFT) & ((1u << MATERIAL_BITS) - 1);
+}
+
+void RenderQueue::clear() {
+    mItems.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t index) {
+    mItems.push_back(RenderItem{key, index});
+}
+
+void RenderQueue::sort() {
+    const size_t n = mItems.size();
+    if (n < 2) {
+        return;
+    }
+    //Least significant byte first. The counts of all the bytes in a single pass over the keys
+    size_t counts[8][256] = {};
+    for (const RenderItem& item : mItems) {
+        for (int digit = 0; digit < 8; ++digit) {
+            ++counts[digit][(item.key >> (8 * digit)) & 0xFF];
+        }
+    }
+    mScratch.resize(n);
+    for (int digit = 0; digit < 8; ++digit) {
+        const int shift = 8 * digit;
+        //Every key has the same byte, the order does not change
+        if (counts[digit][(mItems[0].key >> shift) & 0xFF] == n) {
+            continue;
+        }
+        size_t offsets[256];
+        size_t sum = 0;
+        for (int bucket = 0; bucket < 256; ++bucket) {
+            offsets[bucket] = sum;
+            sum += counts[digit][bucket];
+        }
+        for (const RenderItem& item : mItems) {
+            mScratch[offsets[(item.key >> shift) & 0xFF]++] = item;
+        }
+        mItems.swap(mScratch);
+    }
+}
+
+const std::vector<RenderItem>& RenderQueue::items() const {
+    return mItems;
+}
+
+size_t RenderQueue::size() const {
+    return mItems.size();
+}
@@ -0,0 +1,50 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! An entry of a \class RenderQueue: what to draw (e.g. the index of a mesh) and its sort key
+struct RenderItem {
+    uint64_t key;
+    uint32_t index;
+};
+
+//! The draws of a frame, in the order that needs the fewest state changes
+/*!
+  Each item has a 64 bits key, from the most significant bits:
+  - pass (4 bits): opaque geometry first, then transparent.
+  - program (8 bits): the shader program.
+  - material (20 bits): the textures and other per material state.
+  - depth (32 bits): the view depth as float bits, so opaque items of the
+    same material go front to back (and early Z discards more).
+
+  Transparent items ignore the material and go back to front, as blending
+  needs. The keys are sorted with a radix sort, that takes linear time and
+  skips the bytes that are the same in every key (e.g. a single pass).
+*/
+class RenderQueue {
+public:
+    enum Pass {OPAQUE_PASS, TRANSPARENT_PASS};
+    static const int PROGRAM_BITS = 8;
+    static const int MATERIAL_BITS = 20;
+    //! Key of a draw, depth is the distance along the view direction
+    static uint64_t makeKey(Pass pass, unsigned int program, unsigned int material, float depth);
+    static Pass pass(uint64_t key);
+    static unsigned int program(uint64_t key);
+    static unsigned int material(uint64_t key);
+    //! Start a new frame, the memmory is kept
+    void clear();
+    void push(uint64_t key, uint32_t index);
+    //! Stable sort of the items by key
+    void sort();
+    const std::vector<RenderItem>& items() const;
+    size_t size() const;
+
+private:
+    std::vector<RenderItem> mItems;
+    std::vector<RenderItem> mScratch;
+};
+
+#endif // RENDERQUEUE_H
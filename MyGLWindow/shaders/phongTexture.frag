@@ -1,7 +1,14 @@
 #version 450
-layout(location = 3) uniform float uAlpha;
-layout(location = 4) uniform sampler2D uDiffuseMap;
-layout(location = 5) uniform sampler2D uSpecularMap;
+// Written every frame in the FrameRing (See CameraBlock)
+layout(std140, binding = 1) uniform Camera {
+    mat4 VM;
+    mat4 PVM;
+    mat4 NormalMat;
+    float uAlpha;
+    bool uCompactVertices;
+};
+layout(binding = 0) uniform sampler2D uDiffuseMap;
+layout(binding = 1) uniform sampler2D uSpecularMap;
 
 in vec3 fPosition;
 in vec3 fNormal;
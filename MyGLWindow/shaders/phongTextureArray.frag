@@ -0,0 +1,62 @@
+#version 450
+// Written every frame in the FrameRing (See CameraBlock)
+layout(std140, binding = 1) uniform Camera {
+    mat4 VM;
+    mat4 PVM;
+    mat4 NormalMat;
+    float uAlpha;
+    bool uCompactVertices;
+};
+// The draw, also in the FrameRing (See DrawMaterial). Where the textures of
+// this mesh are: offset.xy, scale.zw in the layers of layers.xy and layers.zw
+layout(std140, binding = 2) uniform Draw {
+    vec4 diffuseSlot;
+    vec4 specularSlot;
+    vec4 positionOffset;
+    vec4 positionScale;
+    ivec4 layers;
+} uDraw;
+// All the textures of the model, in the layers of a few arrays (See TextureAtlas)
+layout(binding = 0) uniform sampler2DArray uMaterialMaps[4];
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTextCoord;
+
+out vec4 fragColor;
+
+vec3 sampleSlot(int array, int layer, vec4 slot) {
+    // The image repeats inside its slot. The gradients are the ones of the
+    // unwrapped coordinates, so the mipmap does not jump at the seam
+    vec2 uv = slot.xy + slot.zw * fract(fTextCoord);
+    // The array is in a uniform block, so it can index the samplers
+    return textureGrad(uMaterialMaps[array], vec3(uv, float(layer)), slot.zw * dFdx(fTextCoord),
+                       slot.zw * dFdy(fTextCoord)).rgb;
+}
+
+void main(void) {
+    //Since we are in view space: v = (0.0, 0.0, 0.0) - fPosition
+    vec3 v = normalize(-fPosition);
+    // This is a directional light in view space (comes from behind
+    // of the camera focus and towards the object)
+    vec3 l = normalize(vec3(0.0, 0.0, 1.0));
+    vec3 n = normalize(fNormal);
+    vec3 h = normalize(l + v);
+    //Material from texture
+    vec3 diffuseMap = sampleSlot(uDraw.layers.x, uDraw.layers.y, uDraw.diffuseSlot);
+    vec3 Ka = 0.1 * diffuseMap;
+    vec3 Ks = 0.9 * diffuseMap;
+    vec3 Kd = sampleSlot(uDraw.layers.z, uDraw.layers.w, uDraw.specularSlot);
+    float alpha = uAlpha;
+    //Light's color (all components are white)
+    vec3 La = vec3(1.0);
+    vec3 Ls = vec3(1.0);
+    vec3 Ld = vec3(1.0);
+    //Phong's shading
+    vec3 ambient = Ka * La;
+    vec3 diffuse = Kd * Ld * max(0.0, dot(n, l));
+    //Well, technically it is Blin - Phong
+    vec3 specular = Ks * Ls * pow(max(0.0, dot(n, h)), alpha);
+    //Final color for this fragment
+    fragColor = vec4(ambient + specular + diffuse, 1.0);
+}
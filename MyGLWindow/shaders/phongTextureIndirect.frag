@@ -0,0 +1,77 @@
+#version 450
+// Written every frame in the FrameRing (See CameraBlock)
+layout(std140, binding = 1) uniform Camera {
+    mat4 VM;
+    mat4 PVM;
+    mat4 NormalMat;
+    float uAlpha;
+    bool uCompactVertices;
+};
+// All the textures of the model, in the layers of a few arrays (See TextureAtlas)
+layout(binding = 0) uniform sampler2DArray uMaterialMaps[4];
+
+// The material of each draw (See texturedVertexIndirect.vert)
+struct DrawMaterial {
+    vec4 diffuseSlot;
+    vec4 specularSlot;
+    vec4 positionOffset;
+    vec4 positionScale;
+    ivec4 layers;
+};
+layout(std430, binding = 0) readonly buffer DrawMaterials {
+    DrawMaterial uDraws[];
+};
+
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTextCoord;
+flat in int fDraw;
+
+out vec4 fragColor;
+
+vec3 sampleSlot(int array, int layer, vec4 slot) {
+    // The image repeats inside its slot. The gradients are the ones of the
+    // unwrapped coordinates, so the mipmap does not jump at the seam
+    vec3 uv = vec3(slot.xy + slot.zw * fract(fTextCoord), float(layer));
+    vec2 dx = slot.zw * dFdx(fTextCoord);
+    vec2 dy = slot.zw * dFdy(fTextCoord);
+    // The array comes from an input, that is not dynamically uniform, so the samplers are not indexed by it
+    switch (array) {
+    case 0:
+        return textureGrad(uMaterialMaps[0], uv, dx, dy).rgb;
+    case 1:
+        return textureGrad(uMaterialMaps[1], uv, dx, dy).rgb;
+    case 2:
+        return textureGrad(uMaterialMaps[2], uv, dx, dy).rgb;
+    default:
+        return textureGrad(uMaterialMaps[3], uv, dx, dy).rgb;
+    }
+}
+
+void main(void) {
+    DrawMaterial material = uDraws[fDraw];
+    //Since we are in view space: v = (0.0, 0.0, 0.0) - fPosition
+    vec3 v = normalize(-fPosition);
+    // This is a directional light in view space (comes from behind
+    // of the camera focus and towards the object)
+    vec3 l = normalize(vec3(0.0, 0.0, 1.0));
+    vec3 n = normalize(fNormal);
+    vec3 h = normalize(l + v);
+    //Material from texture
+    vec3 diffuseMap = sampleSlot(material.layers.x, material.layers.y, material.diffuseSlot);
+    vec3 Ka = 0.1 * diffuseMap;
+    vec3 Ks = 0.9 * diffuseMap;
+    vec3 Kd = sampleSlot(material.layers.z, material.layers.w, material.specularSlot);
+    float alpha = uAlpha;
+    //Light's color (all components are white)
+    vec3 La = vec3(1.0);
+    vec3 Ls = vec3(1.0);
+    vec3 Ld = vec3(1.0);
+    //Phong's shading
+    vec3 ambient = Ka * La;
+    vec3 diffuse = Kd * Ld * max(0.0, dot(n, l));
+    //Well, technically it is Blin - Phong
+    vec3 specular = Ks * Ls * pow(max(0.0, dot(n, h)), alpha);
+    //Final color for this fragment
+    fragColor = vec4(ambient + specular + diffuse, 1.0);
+}
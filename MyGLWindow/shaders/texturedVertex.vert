@@ -3,19 +3,49 @@ layout(location = 0) in vec3 posAttr;
 layout(location = 1) in vec3 normalAttr;
 layout(location = 2) in vec2 textCoordAttr;
 
-layout(location = 0) uniform mat4 VM;
-layout(location = 1) uniform mat4 PVM;
-layout(location = 2) uniform mat4 NormalMat;
+// Written every frame in the FrameRing (See CameraBlock)
+layout(std140, binding = 1) uniform Camera {
+    mat4 VM;
+    mat4 PVM;
+    mat4 NormalMat;
+    float uAlpha;
+    // Compact vertices (See CompactVertex): positions are normalized in the
+    // bounding box of the mesh and normals are octahedral encoded in xy
+    bool uCompactVertices;
+};
+// The draw, also in the FrameRing (See DrawMaterial)
+layout(std140, binding = 2) uniform Draw {
+    vec4 diffuseSlot;
+    vec4 specularSlot;
+    vec4 positionOffset;
+    vec4 positionScale;
+    ivec4 layers;
+} uDraw;
 
 out vec3 fNormal;
 out vec3 fPosition;
 out vec2 fTextCoord;
 
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signNotZero = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signNotZero;
+    }
+    return normalize(n);
+}
+
 void main(void) {
-    gl_Position = PVM * vec4(posAttr, 1.0);
+    vec3 position = posAttr;
+    vec3 normal = normalAttr;
+    if (uCompactVertices) {
+        position = uDraw.positionOffset.xyz + uDraw.positionScale.xyz * posAttr;
+        normal = octahedralDecode(normalAttr.xy);
+    }
+    gl_Position = PVM * vec4(position, 1.0);
     // The lighting calculations will be in veiw space.
-    fPosition = vec3(VM * vec4(posAttr, 1.0));
+    fPosition = vec3(VM * vec4(position, 1.0));
     // NormalMat needs to be in view space too
-    fNormal = vec3(NormalMat * vec4(normalAttr, 0.0));
+    fNormal = vec3(NormalMat * vec4(normal, 0.0));
     fTextCoord = textCoordAttr;
 }
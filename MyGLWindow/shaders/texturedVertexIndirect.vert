@@ -0,0 +1,61 @@
+#version 450
+// gl_DrawIDARB, core only since 4.6
+#extension GL_ARB_shader_draw_parameters : require
+layout(location = 0) in vec3 posAttr;
+layout(location = 1) in vec3 normalAttr;
+layout(location = 2) in vec2 textCoordAttr;
+
+// Written every frame in the FrameRing (See CameraBlock)
+layout(std140, binding = 1) uniform Camera {
+    mat4 VM;
+    mat4 PVM;
+    mat4 NormalMat;
+    float uAlpha;
+    // Compact vertices (See CompactVertex and texturedVertex.vert), the
+    // bounding box of each mesh comes with its draw
+    bool uCompactVertices;
+};
+// Draw of the storage buffer of the first command of this multi draw
+layout(location = 9) uniform int uFirstDraw = 0;
+
+// One per command of the indirect buffer (See IndirectDrawList)
+struct DrawMaterial {
+    vec4 diffuseSlot;
+    vec4 specularSlot;
+    vec4 positionOffset;
+    vec4 positionScale;
+    ivec4 layers;
+};
+layout(std430, binding = 0) readonly buffer DrawMaterials {
+    DrawMaterial uDraws[];
+};
+
+out vec3 fNormal;
+out vec3 fPosition;
+out vec2 fTextCoord;
+flat out int fDraw;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signNotZero = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signNotZero;
+    }
+    return normalize(n);
+}
+
+void main(void) {
+    fDraw = uFirstDraw + gl_DrawIDARB;
+    vec3 position = posAttr;
+    vec3 normal = normalAttr;
+    if (uCompactVertices) {
+        position = uDraws[fDraw].positionOffset.xyz + uDraws[fDraw].positionScale.xyz * posAttr;
+        normal = octahedralDecode(normalAttr.xy);
+    }
+    gl_Position = PVM * vec4(position, 1.0);
+    // The lighting calculations will be in veiw space.
+    fPosition = vec3(VM * vec4(position, 1.0));
+    // NormalMat needs to be in view space too
+    fNormal = vec3(NormalMat * vec4(normal, 0.0));
+    fTextCoord = textCoordAttr;
+}
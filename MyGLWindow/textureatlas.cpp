@@ -0,0 +1,238 @@
+#include "textureatlas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace {
+//The full chain of mipmaps adds a third to the base level
+size_t textureBytes(const QImage& image) {
+    return size_t(image.width()) * size_t(image.height()) * size_t(image.depth() / 8) * 4 / 3;
+}
+
+//Position inside [0, size), the images repeat in their gutter
+int wrap(int i, int size) {
+    return ((i % size) + size) % size;
+}
+}
+
+TextureAtlas::TextureAtlas() : mShared(0), mSavedBytes(0), mUsedTexels(0) {
+}
+
+void TextureAtlas::clear() {
+    mSlots.clear();
+    mCells.clear();
+    mArrays.clear();
+    mShared = 0;
+    mSavedBytes = 0;
+    mUsedTexels = 0;
+}
+
+void TextureAtlas::pack(const std::vector<const DecodedImage*>& images) {
+    clear();
+    mSlots.resize(images.size());
+    //The image whose slot each image takes, and the images of each size
+    std::vector<int> original(images.size(), -1);
+    std::unordered_map<std::string, int> byContent;
+    std::map<std::pair<int, int>, std::vector<int>> bySize;
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (!images[i] || images[i]->image.isNull()) {
+            continue;
+        }
+        const DecodedImage& image = *images[i];
+        if (!image.contentHash.isEmpty()) {
+            auto found = byContent.find(image.contentHash.toStdString());
+            if (found != byContent.end()) {
+                original[i] = found->second;
+                ++mShared;
+                mSavedBytes += textureBytes(image.image);
+                continue;
+            }
+            byContent[image.contentHash.toStdString()] = int(i);
+        }
+        original[i] = int(i);
+        bySize[std::make_pair(image.image.width(), image.image.height())].push_back(int(i));
+    }
+    //The sizes that take the most memmory get their own array
+    std::vector<std::pair<std::pair<int, int>, std::vector<int>>> groups(bySize.begin(), bySize.end());
+    std::stable_sort(groups.begin(), groups.end(), [](const std::pair<std::pair<int, int>, std::vector<int>>& a,
+                                                      const std::pair<std::pair<int, int>, std::vector<int>>& b) {
+        return size_t(a.first.first) * size_t(a.first.second) * a.second.size() >
+               size_t(b.first.first) * size_t(b.first.second) * b.second.size();
+    });
+    const size_t ownArrays = groups.size() <= size_t(MAX_ARRAYS) ? groups.size() : size_t(MAX_ARRAYS - 1);
+    std::vector<Cell> atlas;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (size_t k = 0; k < groups[g].second.size(); ++k) {
+            Cell cell;
+            cell.image = groups[g].second[k];
+            cell.array = int(mArrays.size());
+            cell.layer = int(k);
+            cell.x = 0;
+            cell.y = 0;
+            cell.gutterX = g < ownArrays ? 0 : GUTTER;
+            cell.gutterY = cell.gutterX;
+            if (g < ownArrays) {
+                mCells.push_back(cell);
+            } else {
+                atlas.push_back(cell);
+            }
+        }
+        if (g < ownArrays) {
+            mArrays.push_back(Layers{QSize(groups[g].first.first, groups[g].first.second),
+                                     int(groups[g].second.size())});
+        }
+    }
+    packAtlas(atlas, images);
+    for (const Cell& cell : mCells) {
+        const QImage& image = images[size_t(cell.image)]->image;
+        const QSize& size = mArrays[size_t(cell.array)].size;
+        TextureSlot& slot = mSlots[size_t(cell.image)];
+        slot.array = cell.array;
+        slot.layer = cell.layer;
+        slot.offset = glm::vec2(float(cell.x + cell.gutterX) / size.width(), float(cell.y + cell.gutterY) / size.height());
+        slot.scale = glm::vec2(float(image.width()) / size.width(), float(image.height()) / size.height());
+        mUsedTexels += size_t(image.width() + 2 * cell.gutterX) * size_t(image.height() + 2 * cell.gutterY);
+    }
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (original[i] >= 0) {
+            mSlots[i] = mSlots[size_t(original[i])];
+        }
+    }
+}
+
+void TextureAtlas::packAtlas(std::vector<Cell>& cells, const std::vector<const DecodedImage*>& images) {
+    if (cells.empty()) {
+        return;
+    }
+    //Big enough for the biggest image with its gutter
+    int width = ATLAS_SIZE;
+    int height = ATLAS_SIZE;
+    for (const Cell& cell : cells) {
+        const QImage& image = images[size_t(cell.image)]->image;
+        width = std::max(width, image.width() + 2 * GUTTER);
+        height = std::max(height, image.height() + 2 * GUTTER);
+    }
+    //The tallest first, so each shelf wastes little height
+    std::stable_sort(cells.begin(), cells.end(), [&images](const Cell& a, const Cell& b) {
+        return images[size_t(a.image)]->image.height() > images[size_t(b.image)]->image.height();
+    });
+    const int array = int(mArrays.size());
+    int layer = -1;
+    int shelfY = 0;
+    int shelfHeight = 0;
+    int cursorX = 0;
+    for (Cell& cell : cells) {
+        const QImage& image = images[size_t(cell.image)]->image;
+        const int cellWidth = image.width() + 2 * GUTTER;
+        const int cellHeight = image.height() + 2 * GUTTER;
+        if (cursorX + cellWidth > width) {
+            //Next shelf, or next layer if there is no room for it
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+            cursorX = 0;
+        }
+        if (layer < 0 || shelfY + cellHeight > height) {
+            ++layer;
+            shelfY = 0;
+            shelfHeight = 0;
+            cursorX = 0;
+        }
+        cell.array = array;
+        cell.layer = layer;
+        cell.x = cursorX;
+        cell.y = shelfY;
+        cursorX += cellWidth;
+        shelfHeight = std::max(shelfHeight, cellHeight);
+        mCells.push_back(cell);
+    }
+    mArrays.push_back(Layers{QSize(width, height), layer + 1});
+}
+
+const std::vector<TextureSlot>& TextureAtlas::textureSlots() const {
+    return mSlots;
+}
+
+int TextureAtlas::arrayCount() const {
+    return int(mArrays.size());
+}
+
+QSize TextureAtlas::layerSize(int array) const {
+    return mArrays[size_t(array)].size;
+}
+
+int TextureAtlas::layerCount(int array) const {
+    return mArrays[size_t(array)].count;
+}
+
+int TextureAtlas::layerCount() const {
+    int count = 0;
+    for (const Layers& layers : mArrays) {
+        count += layers.count;
+    }
+    return count;
+}
+
+size_t TextureAtlas::sharedCount() const {
+    return mShared;
+}
+
+size_t TextureAtlas::savedBytes() const {
+    return mSavedBytes;
+}
+
+float TextureAtlas::occupancy() const {
+    size_t texels = 0;
+    for (const Layers& layers : mArrays) {
+        texels += size_t(layers.size.width()) * size_t(layers.size.height()) * size_t(layers.count);
+    }
+    return texels > 0 ? float(mUsedTexels) / float(texels) : 0.0f;
+}
+
+void TextureAtlas::compose(int array, int layer, const std::vector<const DecodedImage*>& images,
+                           std::vector<uchar>& pixels) const {
+    const QSize& size = mArrays[size_t(array)].size;
+    const size_t width = size_t(size.width());
+    pixels.assign(width * size_t(size.height()) * 4, 0);
+    for (const Cell& cell : mCells) {
+        if (cell.array != array || cell.layer != layer) {
+            continue;
+        }
+        //In RGBA8888 and already flipped (See AssetManager loadImage), so rows are copied as they are
+        const QImage& image = images[size_t(cell.image)]->image;
+        const int w = image.width();
+        const int h = image.height();
+        for (int y = -cell.gutterY; y < h + cell.gutterY; ++y) {
+            const uchar* source = image.constScanLine(wrap(y, h));
+            uchar* row = pixels.data() + (size_t(cell.y + cell.gutterY + y) * width + size_t(cell.x + cell.gutterX)) * 4;
+            std::memcpy(row, source, size_t(w) * 4);
+            for (int x = 1; x <= cell.gutterX; ++x) {
+                std::memcpy(row - x * 4, source + wrap(-x, w) * 4, 4);
+                std::memcpy(row + (w - 1 + x) * 4, source + wrap(w - 1 + x, w) * 4, 4);
+            }
+        }
+    }
+}
+
+QOpenGLTexture* TextureAtlas::upload(int array, const std::vector<const DecodedImage*>& images) const {
+    const Layers& layers = mArrays[size_t(array)];
+    QOpenGLTexture* texture = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+    texture->setSize(layers.size.width(), layers.size.height());
+    texture->setLayers(layers.count);
+    texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    texture->setMipLevels(texture->maximumMipLevels());
+    texture->allocateStorage();
+    //One layer at a time, so there is never a copy of the whole array in memmory
+    std::vector<uchar> pixels;
+    for (int layer = 0; layer < layers.count; ++layer) {
+        compose(array, layer, images, pixels);
+        texture->setData(0, layer, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, pixels.data());
+    }
+    texture->generateMipMaps();
+    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    texture->setWrapMode(QOpenGLTexture::Repeat);
+    return texture;
+}
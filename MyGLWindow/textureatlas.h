@@ -0,0 +1,94 @@
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <QtGui/QOpenGLTexture>
+#include <QSize>
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "assetmanager.h"
+
+//! Where an image is inside a \class TextureAtlas
+/*!
+  Its texture coordinates map to the layer as offset + scale * fract(uv),
+  (the images repeat, see phongTextureArray.frag). An image that was not
+  packed (e.g. it failed to load) has layer -1.
+*/
+struct TextureSlot {
+    int array;
+    int layer;
+    glm::vec2 offset;
+    glm::vec2 scale;
+    TextureSlot() : array(-1), layer(-1), offset(0.0f), scale(1.0f) {}
+};
+
+//! Packs the textures of a model into the layers of a few GL_TEXTURE_2D_ARRAY
+/*!
+  The images of the same size go in the layers of an array of that size,
+  one per layer, and repeat with the sampler. There is an array for each of
+  the sizes that take the most memmory, and the images of any other size
+  are packed in shelves in the layers of one last array (an atlas), with a
+  gutter around them: a copy of their opposite border, so the bilinear
+  filter and the first mipmaps repeat them as the hardware would.
+  Byte-identical images (by their content hash) share one slot.
+
+  With every material in MAX_ARRAYS textures at most, a mesh only needs its
+  slots, and the whole model binds its textures once.
+*/
+class TextureAtlas {
+public:
+    //! Texture arrays, that the shader takes as an array of samplers
+    static const int MAX_ARRAYS = 4;
+    //! Smallest layer of the atlas array
+    static const int ATLAS_SIZE = 1024;
+    //! Pixels around the images in the atlas
+    static const int GUTTER = 8;
+    TextureAtlas();
+    //! Plan where each image goes, null images (not loaded) get no slot
+    void pack(const std::vector<const DecodedImage*>& images);
+    void clear();
+    //! Slot of each image given to pack, in the same order
+    const std::vector<TextureSlot>& textureSlots() const;
+    int arrayCount() const;
+    QSize layerSize(int array) const;
+    int layerCount(int array) const;
+    //! Layers of all the arrays
+    int layerCount() const;
+    //! Images that share the slot of a byte-identical one, and the video memmory (with mipmaps) that it saves
+    size_t sharedCount() const;
+    size_t savedBytes() const;
+    //! Fraction of the texels of the layers that belong to an image (or its gutter)
+    float occupancy() const;
+    //! Write the RGBA8888 pixels of a layer (bottom row first), the same images given to pack
+    void compose(int array, int layer, const std::vector<const DecodedImage*>& images,
+                 std::vector<uchar>& pixels) const;
+    //! Create a texture array with all its layers, with the OpenGL context current. The caller owns it
+    QOpenGLTexture* upload(int array, const std::vector<const DecodedImage*>& images) const;
+
+private:
+    //! Rectangle of an image in its layer, gutter included
+    struct Cell {
+        int image;
+        int array;
+        int layer;
+        int x;
+        int y;
+        int gutterX;
+        int gutterY;
+    };
+    struct Layers {
+        QSize size;
+        int count;
+    };
+    //! Place the images of cells in shelves, in the layers of a new array
+    void packAtlas(std::vector<Cell>& cells, const std::vector<const DecodedImage*>& images);
+    std::vector<TextureSlot> mSlots;
+    std::vector<Cell> mCells;
+    std::vector<Layers> mArrays;
+    size_t mShared;
+    size_t mSavedBytes;
+    size_t mUsedTexels;
+};
+
+#endif // TEXTUREATLAS_H
@@ -0,0 +1,61 @@
+#include "textureregistry.h"
+
+namespace {
+//The full chain of mipmaps adds a third to the base level
+size_t textureBytes(const QImage& image) {
+    return size_t(image.width()) * size_t(image.height()) * size_t(image.depth() / 8) * 4 / 3;
+}
+}
+
+TextureRegistry::TextureRegistry(bool shareByContent) : mShareByContent(shareByContent), mImages(0),
+    mSavedBytes(0) {
+}
+
+TextureRegistry::~TextureRegistry() {
+    clear();
+}
+
+QOpenGLTexture* TextureRegistry::texture(const DecodedImage& image) {
+    ++mImages;
+    //Without a hash (or sharing) there is nothing to compare with
+    const bool shared = mShareByContent && !image.contentHash.isEmpty();
+    const std::string key = shared ? image.contentHash.toStdString() : std::string();
+    if (shared) {
+        auto found = mByContent.find(key);
+        if (found != mByContent.end()) {
+            mSavedBytes += textureBytes(image.image);
+            return found->second;
+        }
+    }
+    QOpenGLTexture* texture = new QOpenGLTexture(image.image);
+    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    texture->setWrapMode(QOpenGLTexture::Repeat);
+    mTextures.push_back(texture);
+    if (shared) {
+        mByContent[key] = texture;
+    }
+    return texture;
+}
+
+void TextureRegistry::clear() {
+    for (QOpenGLTexture* texture : mTextures) {
+        delete texture;
+    }
+    mTextures.clear();
+    mByContent.clear();
+    mImages = 0;
+    mSavedBytes = 0;
+}
+
+size_t TextureRegistry::textureCount() const {
+    return mTextures.size();
+}
+
+size_t TextureRegistry::imageCount() const {
+    return mImages;
+}
+
+size_t TextureRegistry::savedBytes() const {
+    return mSavedBytes;
+}
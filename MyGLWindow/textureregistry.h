@@ -0,0 +1,42 @@
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include <QtGui/QOpenGLTexture>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "assetmanager.h"
+
+//! The OpenGL textures of a context, at most one per different image
+/*!
+  Textures are looked up by the content hash of their image (See
+  \struct DecodedImage), so byte-identical images that come from different
+  files share one texture. It owns the textures: clear (or destroy) it with
+  its context current.
+*/
+class TextureRegistry {
+public:
+    //! Without shareByContent every image gets its own texture
+    explicit TextureRegistry(bool shareByContent = true);
+    ~TextureRegistry();
+    //! The texture with the pixels of image, only created if there is none with the same yet
+    QOpenGLTexture* texture(const DecodedImage& image);
+    //! Delete all the textures
+    void clear();
+    //! Textures created, and images that got one of them
+    size_t textureCount() const;
+    size_t imageCount() const;
+    //! Video memmory (with mipmaps) that the shared textures would have taken
+    size_t savedBytes() const;
+
+private:
+    bool mShareByContent;
+    std::unordered_map<std::string, QOpenGLTexture*> mByContent;
+    std::vector<QOpenGLTexture*> mTextures;
+    size_t mImages;
+    size_t mSavedBytes;
+};
+
+#endif // TEXTUREREGISTRY_H
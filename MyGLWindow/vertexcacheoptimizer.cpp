@@ -0,0 +1,178 @@
+#include "vertexcacheoptimizer.h"
+
+#include <algorithm>
+
+const unsigned int VertexCacheOptimizer::DEFAULT_CACHE_SIZE;
+
+namespace {
+const unsigned int NOT_USED = ~0u;
+
+//Vertex to triangle adjacency in compressed rows: the triangles of vertex v
+//are triangles[offsets[v]] ... triangles[offsets[v + 1] - 1]
+struct Adjacency {
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+};
+
+void buildAdjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount, Adjacency& adjacency) {
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        ++adjacency.offsets[indices[i] + 1];
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
+    }
+    adjacency.triangles.resize(indexCount);
+    std::vector<unsigned int> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adjacency.triangles[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+}
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+    triangles += other.triangles;
+    vertices += other.vertices;
+    transforms += other.transforms;
+    return *this;
+}
+
+float VertexCacheStats::acmr() const {
+    return triangles == 0 ? 0.0f : float(transforms) / float(triangles);
+}
+
+float VertexCacheStats::atvr() const {
+    return vertices == 0 ? 0.0f : float(transforms) / float(vertices);
+}
+
+VertexCacheOptimizer::VertexCacheOptimizer(unsigned int cacheSize) {
+    setCacheSize(cacheSize);
+}
+
+void VertexCacheOptimizer::setCacheSize(unsigned int cacheSize) {
+    mCacheSize = std::max(cacheSize, 3u);
+}
+
+unsigned int VertexCacheOptimizer::cacheSize() const {
+    return mCacheSize;
+}
+
+VertexCacheStats VertexCacheOptimizer::analyze(const unsigned int* indices, size_t indexCount, size_t vertexCount) const {
+    VertexCacheStats stats;
+    stats.triangles = indexCount / 3;
+    //A vertex is in the FIFO if less than cacheSize vertices entered after it
+    std::vector<size_t> entered(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    size_t time = mCacheSize + 1;
+    for (size_t i = 0; i < stats.triangles * 3; ++i) {
+        unsigned int v = indices[i];
+        if (!used[v]) {
+            used[v] = true;
+            ++stats.vertices;
+        }
+        if (time - entered[v] > mCacheSize) {
+            entered[v] = time++;
+            ++stats.transforms;
+        }
+    }
+    return stats;
+}
+
+void VertexCacheOptimizer::reorderTriangles(unsigned int* indices, size_t indexCount, size_t vertexCount) const {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+    Adjacency adjacency;
+    buildAdjacency(indices, triangleCount * 3, vertexCount, adjacency);
+    //Triangles not emitted yet around each vertex
+    std::vector<unsigned int> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+    std::vector<size_t> entered(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+    const size_t k = mCacheSize;
+    size_t time = k + 1;
+    size_t cursor = 0;
+
+    //Next vertex, in input order, that still has triangles
+    auto nextLive = [&]() -> unsigned int {
+        while (cursor < vertexCount && live[cursor] == 0) {
+            ++cursor;
+        }
+        return cursor < vertexCount ? static_cast<unsigned int>(cursor) : NOT_USED;
+    };
+
+    unsigned int fan = nextLive();
+    while (fan != NOT_USED) {
+        //Emit all the remaining triangles around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; ++a) {
+            unsigned int t = adjacency.triangles[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for (int c = 0; c < 3; ++c) {
+                unsigned int v = indices[3 * t + c];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - entered[v] > k) {
+                    entered[v] = time++;
+                }
+            }
+        }
+        //The best next fan is the candidate that will still be in the cache
+        //after emitting its own triangles and that is the oldest in it
+        unsigned int best = NOT_USED;
+        long bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            long priority = 0;
+            if (time - entered[v] + 2 * size_t(live[v]) <= k) {
+                priority = long(time - entered[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+        //Dead end: go back to a recently used vertex, or to the next one
+        while (best == NOT_USED && !deadEnds.empty()) {
+            unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0) {
+                best = v;
+            }
+        }
+        fan = best != NOT_USED ? best : nextLive();
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void VertexCacheOptimizer::reorderVertices(unsigned int* indices, size_t indexCount, size_t vertexCount,
+                                           std::vector<unsigned int>& remap) const {
+    remap.assign(vertexCount, NOT_USED);
+    unsigned int next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        unsigned int& v = remap[indices[i]];
+        if (v == NOT_USED) {
+            v = next++;
+        }
+        indices[i] = v;
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        if (remap[v] == NOT_USED) {
+            remap[v] = next++;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef VERTEXCACHEOPTIMIZER_H
+#define VERTEXCACHEOPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+//! How well an index buffer uses the post-transform vertex cache
+/*!
+  It counts the vertex shader invocations (transforms) that a FIFO cache of
+  a given size would need to draw the triangles. From them:
+  ACMR (average cache miss ratio) is transforms per triangle. It goes from
+  3 (no reuse at all) down to about 0.5 for a regular grid.
+  ATVR (average transform to vertex ratio) is transforms per vertex. The
+  ideal is 1: every vertex is transformed only once.
+*/
+struct VertexCacheStats {
+    size_t triangles;
+    size_t vertices;
+    size_t transforms;
+    VertexCacheStats() : triangles(0), vertices(0), transforms(0) {}
+    //! Add the counts of another (disjoint) set of triangles
+    VertexCacheStats& operator+=(const VertexCacheStats& other);
+    float acmr() const;
+    float atvr() const;
+};
+
+//! The stats of a mesh before and after optimizing it
+struct VertexCacheReport {
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+//! A class that reorders an indexed triangle mesh to render it faster.
+/*!
+  It is the engine behind \class Mesh optimizeVertexCache. Two passes:
+
+  1) The triangles are reordered for the post-transform vertex cache with
+  Tipsify (Sander, Nehab and Barczak 2007): it fans around one vertex after
+  another, choosing the next one among the vertices just emitted that will
+  still be in the cache. It is linear in the number of triangles.
+
+  2) The vertices are reordered in the order that the triangles first use
+  them. So the vertex fetches go through memmory almost sequentially.
+
+  Neither pass adds or removes triangles nor vertices.
+*/
+class VertexCacheOptimizer {
+public:
+    //! Size of the FIFO cache used to optimize and to measure, in vertices
+    static const unsigned int DEFAULT_CACHE_SIZE = 16;
+    explicit VertexCacheOptimizer(unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+    void setCacheSize(unsigned int cacheSize);
+    unsigned int cacheSize() const;
+    //! Simulate a FIFO cache drawing the triangles (all indices < vertexCount)
+    VertexCacheStats analyze(const unsigned int* indices, size_t indexCount, size_t vertexCount) const;
+    //! Reorder the triangles (in place) to reduce the cache misses
+    void reorderTriangles(unsigned int* indices, size_t indexCount, size_t vertexCount) const;
+    //! Renumber the vertices in the order of first use by the indices
+    /*!
+      The indices are rewritten in place. On return, remap has for each old
+      vertex its new place. The vertices that no triangle uses go at the end.
+      The caller needs to move the vertex data acordingly.
+    */
+    void reorderVertices(unsigned int* indices, size_t indexCount, size_t vertexCount,
+                         std::vector<unsigned int>& remap) const;
+
+private:
+    unsigned int mCacheSize;
+};
+
+#endif // VERTEXCACHEOPTIMIZER_H
@@ -0,0 +1,133 @@
+#include "vertexquantizer.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#define GLM_FORCE_PURE
+#define GLM_FORCE_RADIANS
+#include <glm/gtc/packing.hpp>
+
+using glm::vec2;
+using glm::vec3;
+
+namespace {
+const float UNORM16 = 65535.0f;
+const float SNORM16 = 32767.0f;
+
+vec2 signNotZero(const vec2& v) {
+    return vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+}
+
+//Project the unit sphere on an octahedron and unfold it into the square [-1, 1]^2
+vec2 octahedralEncode(const vec3& n) {
+    float l1 = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    if (l1 == 0.0f) {
+        return vec2(0.0f);
+    }
+    vec2 p = vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f) {
+        p = (vec2(1.0f) - glm::abs(vec2(p.y, p.x))) * signNotZero(p);
+    }
+    return p;
+}
+
+vec3 octahedralDecode(const vec2& e) {
+    vec3 n(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+    if (n.z < 0.0f) {
+        vec2 p = (vec2(1.0f) - glm::abs(vec2(n.y, n.x))) * signNotZero(vec2(n.x, n.y));
+        n.x = p.x;
+        n.y = p.y;
+    }
+    return glm::normalize(n);
+}
+
+//As the GPU converts normalized integers to floats
+float snorm(GLshort value) {
+    return glm::max(float(value) / SNORM16, -1.0f);
+}
+
+GLshort toSnorm(float value) {
+    return static_cast<GLshort>(glm::round(glm::clamp(value, -1.0f, 1.0f) * SNORM16));
+}
+
+float angleBetween(const vec3& a, const vec3& b) {
+    float la = glm::length(a);
+    float lb = glm::length(b);
+    if (la == 0.0f || lb == 0.0f) {
+        return 0.0f;
+    }
+    float c = glm::clamp(glm::dot(a, b) / (la * lb), -1.0f, 1.0f);
+    return glm::degrees(glm::acos(c));
+}
+
+void merge(QuantizationError& error, const QuantizationError& other) {
+    error.position = glm::max(error.position, other.position);
+    error.normal = glm::max(error.normal, other.normal);
+    error.textCoords = glm::max(error.textCoords, other.textCoords);
+}
+}
+
+CompactVertex VertexQuantizer::encode(const Vertex& vertex, const QuantizationBox& box) {
+    CompactVertex compact;
+    for (int i = 0; i < 3; ++i) {
+        float t = box.scale[i] > 0.0f ? (vertex.position[i] - box.offset[i]) / box.scale[i] : 0.0f;
+        compact.position[i] = static_cast<GLushort>(glm::round(glm::clamp(t, 0.0f, 1.0f) * UNORM16));
+    }
+    compact.position[3] = 0;
+    vec2 normal = octahedralEncode(vertex.normal);
+    compact.normal[0] = toSnorm(normal.x);
+    compact.normal[1] = toSnorm(normal.y);
+    compact.textCoords[0] = static_cast<GLushort>(glm::packHalf1x16(vertex.textCoords.s));
+    compact.textCoords[1] = static_cast<GLushort>(glm::packHalf1x16(vertex.textCoords.t));
+    return compact;
+}
+
+Vertex VertexQuantizer::decode(const CompactVertex& compact, const QuantizationBox& box) {
+    Vertex vertex;
+    for (int i = 0; i < 3; ++i) {
+        vertex.position[i] = box.offset[i] + box.scale[i] * (float(compact.position[i]) / UNORM16);
+    }
+    vertex.normal = octahedralDecode(vec2(snorm(compact.normal[0]), snorm(compact.normal[1])));
+    vertex.textCoords.s = glm::unpackHalf1x16(compact.textCoords[0]);
+    vertex.textCoords.t = glm::unpackHalf1x16(compact.textCoords[1]);
+    return vertex;
+}
+
+QuantizationError VertexQuantizer::quantize(ArrayView<const Vertex> vertices, ArrayView<const MeshData> separators,
+                                            std::vector<CompactVertex>& compact,
+                                            std::vector<QuantizationBox>& boxes) const {
+    compact.resize(vertices.size());
+    boxes.resize(separators.size());
+    std::vector<QuantizationError> errors(separators.size());
+    //One mesh per task, each one only touches its own vertices
+    parallel::forRange(separators.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            size_t first = size_t(separators[i].startVertex);
+            size_t last = i + 1 < separators.size() ? size_t(separators[i + 1].startVertex) : vertices.size();
+            vec3 lower(FLT_MAX);
+            vec3 upper(-FLT_MAX);
+            for (size_t k = first; k < last; ++k) {
+                lower = glm::min(lower, vertices[k].position);
+                upper = glm::max(upper, vertices[k].position);
+            }
+            QuantizationBox& box = boxes[i];
+            box.offset = first < last ? lower : vec3(0.0f);
+            box.scale = first < last ? upper - lower : vec3(0.0f);
+            QuantizationError& error = errors[i];
+            for (size_t k = first; k < last; ++k) {
+                compact[k] = encode(vertices[k], box);
+                Vertex decoded = decode(compact[k], box);
+                error.position = glm::max(error.position, glm::distance(vertices[k].position, decoded.position));
+                error.normal = glm::max(error.normal, angleBetween(vertices[k].normal, decoded.normal));
+                vec2 uvError = glm::abs(vertices[k].textCoords - decoded.textCoords);
+                error.textCoords = glm::max(error.textCoords, glm::max(uvError.x, uvError.y));
+            }
+        }
+    }, 1);
+    QuantizationError total;
+    for (const QuantizationError& error : errors) {
+        merge(total, error);
+    }
+    return total;
+}
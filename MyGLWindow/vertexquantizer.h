@@ -0,0 +1,69 @@
+#ifndef VERTEXQUANTIZER_H
+#define VERTEXQUANTIZER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "arrayview.h"
+#include "model.h"
+
+//! A \struct Vertex compressed to 16 bytes (half of the 32 of the original) for the GPU
+/*!
+  - position: 16 bits unsigned normalized per axis, relative to the bounding
+    box of its mesh (See \struct QuantizationBox). The fourth one is padding.
+  - normal: octahedral encoding in two 16 bits signed normalized integers.
+  - textCoords: two half floats, so repeating coordinates still work.
+
+  The shader decodes them (See texturedVertex.vert).
+*/
+struct CompactVertex {
+    GLushort position[4];
+    GLshort normal[2];
+    GLushort textCoords[2];
+};
+
+//! How to decode the positions of a mesh: position = offset + scale * quantized
+/*!
+  The quantized position is the one that the GPU gives to the shader, in the
+  range [0, 1]. So offset and scale are the corner and the size of the
+  bounding box of the mesh.
+*/
+struct QuantizationBox {
+    glm::vec3 offset;
+    glm::vec3 scale;
+};
+
+//! The biggest difference between the original and the decoded vertices
+struct QuantizationError {
+    //! Distance between positions, in model units
+    float position;
+    //! Angle between normals, in degrees
+    float normal;
+    //! Difference in any texture coordinate
+    float textCoords;
+    QuantizationError() : position(0.0f), normal(0.0f), textCoords(0.0f) {}
+};
+
+//! A class that compresses the vertices of a \class Model for the GPU.
+/*!
+  Each mesh is quantized against its own bounding box, so the precision of
+  the positions is 1 / 65535 of the size of the mesh (not of the model).
+  The error made is measured by decoding every vertex back, exactly as the
+  shader does it.
+*/
+class VertexQuantizer {
+public:
+    //! Compress the vertices of every mesh (vertices of the mesh i start at separators[i].startVertex)
+    /*!
+      On return, compact has one vertex per vertex and boxes one box per
+      separator. Returns the maximum error over all the vertices.
+    */
+    QuantizationError quantize(ArrayView<const Vertex> vertices, ArrayView<const MeshData> separators,
+                               std::vector<CompactVertex>& compact, std::vector<QuantizationBox>& boxes) const;
+    //! Compress a single vertex
+    static CompactVertex encode(const Vertex& vertex, const QuantizationBox& box);
+    //! Decompress a single vertex, as the shader does it
+    static Vertex decode(const CompactVertex& vertex, const QuantizationBox& box);
+};
+
+#endif // VERTEXQUANTIZER_H
@@ -0,0 +1,203 @@
+#include "vertexwelder.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+using glm::vec3;
+
+namespace {
+//Smallest cell size
+const float MIN_CELL = 0.000001f;
+//Cells further than this (2^62) are clamped to it, the infinities too. So the cell coordinates
+//and the loops over them never overflow, however far or small the cells are
+const double MAX_CELL = 4611686018427387904.0;
+//The cell of a NaN coordinate, apart from the others. A NaN is never within tolerance, so it is not welded
+const int64_t NAN_CELL = INT64_MIN;
+
+struct Cell {
+    int64_t x;
+    int64_t y;
+    int64_t z;
+};
+
+inline int64_t cellCoord(float value, float cellSize) {
+    const double cell = std::floor(double(value) / double(cellSize));
+    if (std::isnan(cell)) {
+        return NAN_CELL;
+    }
+    return static_cast<int64_t>(std::max(-MAX_CELL, std::min(cell, MAX_CELL)));
+}
+
+inline Cell cellOf(const vec3& p, float cellSize) {
+    return Cell{cellCoord(p.x, cellSize), cellCoord(p.y, cellSize), cellCoord(p.z, cellSize)};
+}
+//Different cells can land in the same bucket, that is fine since the
+//corners in a bucket are always compared by their actual distance
+inline size_t bucketOf(int64_t x, int64_t y, int64_t z, size_t mask) {
+    uint64_t h = uint64_t(x) * 0x9E3779B97F4A7C15ull;
+    h ^= uint64_t(y) * 0xC2B2AE3D27D4EB4Full;
+    h ^= uint64_t(z) * 0x165667B19E3779F9ull;
+    //Final avalanche (from MurmurHash3) so regular grids spread well
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return static_cast<size_t>(h) & mask;
+}
+
+//The NaN after every number, so the order is strict even with them
+inline bool componentLess(float a, float b) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return !std::isnan(a) && std::isnan(b);
+    }
+    return a < b;
+}
+
+inline bool lexicographicLess(const vec3& a, const vec3& b) {
+    for (int i = 0; i < 3; ++i) {
+        if (componentLess(a[i], b[i])) {
+            return true;
+        } else if (componentLess(b[i], a[i])) {
+            return false;
+        }
+    }
+    return false;
+}
+}
+
+VertexWelder::VertexWelder(float tolerance) : mTolerance(0.0f) {
+    setTolerance(tolerance);
+}
+
+void VertexWelder::setTolerance(float tolerance) {
+    mTolerance = glm::max(tolerance, 0.0f);
+}
+
+float VertexWelder::tolerance() const {
+    return mTolerance;
+}
+
+void VertexWelder::weld(const vec3* corners, size_t count,
+                        std::vector<vec3>& positions,
+                        std::vector<unsigned int>& indices) const {
+    positions.clear();
+    indices.clear();
+    if (!corners || count == 0) {
+        return;
+    }
+
+    //Cells four times the tolerance: the search box around a corner is half a
+    //cell wide, so it usually stays in one cell per axis and never spans more than two
+    const float cellSize = glm::max(4.0f * mTolerance, MIN_CELL);
+    const float tolerance2 = mTolerance * mTolerance;
+    //A power of two table with (at least) one bucket per corner
+    size_t tableSize = 1;
+    while (tableSize < count) {
+        tableSize <<= 1;
+    }
+    const size_t mask = tableSize - 1;
+
+    //First, find the bucket of each corner and count the corners per bucket
+    std::vector<unsigned int> bucket(count);
+    std::unique_ptr<std::atomic<unsigned int>[]> cursor(new std::atomic<unsigned int>[tableSize]);
+    parallel::forRange(tableSize, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            cursor[b].store(0, std::memory_order_relaxed);
+        }
+    });
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Cell c = cellOf(corners[i], cellSize);
+            bucket[i] = static_cast<unsigned int>(bucketOf(c.x, c.y, c.z, mask));
+            cursor[bucket[i]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    //Counting sort of the corners by bucket
+    std::vector<unsigned int> start(tableSize + 1);
+    start[0] = 0;
+    for (size_t b = 0; b < tableSize; ++b) {
+        start[b + 1] = start[b] + cursor[b].load(std::memory_order_relaxed);
+        cursor[b].store(start[b], std::memory_order_relaxed);
+    }
+    std::vector<unsigned int> sorted(count);
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            sorted[cursor[bucket[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<unsigned int>(i);
+        }
+    });
+    cursor.reset();
+
+    //Every corner looks for the first corner within tolerance in the (at most
+    //eight) cells that its search box touches. The order inside a bucket
+    //depends on the threads, but the minimum does not.
+    std::vector<unsigned int> representative(count);
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const vec3& p = corners[i];
+            Cell lo = cellOf(p - vec3(mTolerance), cellSize);
+            Cell hi = cellOf(p + vec3(mTolerance), cellSize);
+            unsigned int best = static_cast<unsigned int>(i);
+            for (int64_t x = lo.x; x <= hi.x; ++x) {
+                for (int64_t y = lo.y; y <= hi.y; ++y) {
+                    for (int64_t z = lo.z; z <= hi.z; ++z) {
+                        size_t b = bucketOf(x, y, z, mask);
+                        for (unsigned int k = start[b]; k < start[b + 1]; ++k) {
+                            unsigned int j = sorted[k];
+                            if (j >= best) {
+                                continue;
+                            }
+                            vec3 d = corners[j] - p;
+                            if (glm::dot(d, d) < tolerance2 || corners[j] == p) {
+                                best = j;
+                            }
+                        }
+                    }
+                }
+            }
+            representative[i] = best;
+        }
+    });
+    sorted.clear();
+    sorted.shrink_to_fit();
+    start.clear();
+    start.shrink_to_fit();
+
+    //Collapse the chains. The representative always comes before the corner
+    //so a single forward sweep is enough
+    std::vector<unsigned int> unique;
+    for (size_t i = 0; i < count; ++i) {
+        representative[i] = representative[representative[i]];
+        if (representative[i] == i) {
+            unique.push_back(static_cast<unsigned int>(i));
+        }
+    }
+
+    //Keep the lexicographical order of the vertices
+    parallel::sort(unique.begin(), unique.end(), [corners](unsigned int a, unsigned int b) {
+        if (lexicographicLess(corners[a], corners[b])) {
+            return true;
+        } else if (lexicographicLess(corners[b], corners[a])) {
+            return false;
+        }
+        return a < b;
+    });
+
+    //Reuse the bucket array to store the final index of each representative
+    positions.resize(unique.size());
+    parallel::forRange(unique.size(), [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            bucket[unique[k]] = static_cast<unsigned int>(k);
+            positions[k] = corners[unique[k]];
+        }
+    });
+    indices.resize(count);
+    parallel::forRange(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            indices[i] = bucket[representative[i]];
+        }
+    });
+}
@@ -0,0 +1,43 @@
+#ifndef VERTEXWELDER_H
+#define VERTEXWELDER_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+//! A class that joins the vertex positions that are closer than a tolerance.
+/*!
+  It is the engine behind \class Mesh loadFromTriangles. Instead of sorting
+  all the corners in a tree, the corners are bucketed in a hashed uniform grid
+  whose cells are four times the tolerance. So, every corner only needs to be
+  compared with the corners that fall in (at most) eight neighbour cells.
+
+  Every step runs across all the cores and the result does not depend on the
+  number of threads: a corner is always welded to the corner with the lowest
+  index that is within tolerance, and the unique positions are returned in
+  lexicographical (x, then y, then z) order. Which is the same order that the
+  old std::set based implementation produced.
+*/
+class VertexWelder {
+public:
+    //! Create a welder. Corners closer than tolerance are the same vertex
+    explicit VertexWelder(float tolerance = 0.0001f);
+    //! Change the distance under which two corners are considered the same
+    void setTolerance(float tolerance);
+    //! Get the distance under which two corners are considered the same
+    float tolerance() const;
+    //! Weld count corner positions into an indexed set of vertices
+    /*!
+      After the call, positions contains the unique vertex positions and
+      indices contains one index (into positions) per input corner. So, if the
+      corners are the three points of each triangle, indices is an index
+      buffer ready to draw with glDrawElements.
+    */
+    void weld(const glm::vec3* corners, size_t count,
+              std::vector<glm::vec3>& positions,
+              std::vector<unsigned int>& indices) const;
+
+private:
+    float mTolerance;
+};
+
+#endif // VERTEXWELDER_H
@@ -0,0 +1,77 @@
+#-------------------------------------------------
+#
+# Renders MyGLWindow offscreen and times its frames
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = RenderBench
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# The window is compiled straight from the MyGLWindow template, all but its main
+SOURCES += \
+    main.cpp \
+    ../MyGLWindow/meshload.cpp \
+    ../MyGLWindow/mesh.cpp \
+    ../MyGLWindow/trackball.cpp \
+    ../MyGLWindow/baseGLwindow.cpp \
+    ../MyGLWindow/model.cpp \
+    ../MyGLWindow/vertexwelder.cpp \
+    ../MyGLWindow/normalgenerator.cpp \
+    ../MyGLWindow/geometrykernels.cpp \
+    ../MyGLWindow/geometrycache.cpp \
+    ../MyGLWindow/vertexcacheoptimizer.cpp \
+    ../MyGLWindow/overdrawoptimizer.cpp \
+    ../MyGLWindow/vertexquantizer.cpp \
+    ../MyGLWindow/meshsimplifier.cpp \
+    ../MyGLWindow/meshletbuilder.cpp \
+    ../MyGLWindow/trianglebvh.cpp \
+    ../MyGLWindow/assetmanager.cpp \
+    ../MyGLWindow/textureregistry.cpp \
+    ../MyGLWindow/textureatlas.cpp \
+    ../MyGLWindow/indirectdrawlist.cpp \
+    ../MyGLWindow/renderqueue.cpp \
+    ../MyGLWindow/framering.cpp \
+    ../MyGLWindow/gpuprofiler.cpp \
+    ../MyGLWindow/cpuprofiler.cpp
+
+HEADERS += \
+    ../MyGLWindow/meshload.h \
+    ../MyGLWindow/baseGLwindow.h \
+    ../MyGLWindow/mesh.h \
+    ../MyGLWindow/trackball.h \
+    ../MyGLWindow/model.h \
+    ../MyGLWindow/parallel.h \
+    ../MyGLWindow/vertexwelder.h \
+    ../MyGLWindow/normalgenerator.h \
+    ../MyGLWindow/stridedview.h \
+    ../MyGLWindow/geometrykernels.h \
+    ../MyGLWindow/arrayview.h \
+    ../MyGLWindow/geometrycache.h \
+    ../MyGLWindow/vertexcacheoptimizer.h \
+    ../MyGLWindow/overdrawoptimizer.h \
+    ../MyGLWindow/vertexquantizer.h \
+    ../MyGLWindow/meshsimplifier.h \
+    ../MyGLWindow/meshletbuilder.h \
+    ../MyGLWindow/trianglebvh.h \
+    ../MyGLWindow/assetmanager.h \
+    ../MyGLWindow/textureregistry.h \
+    ../MyGLWindow/textureatlas.h \
+    ../MyGLWindow/indirectdrawlist.h \
+    ../MyGLWindow/renderqueue.h \
+    ../MyGLWindow/framering.h \
+    ../MyGLWindow/gpuprofiler.h \
+    ../MyGLWindow/cpuprofiler.h
+
+INCLUDEPATH += \
+    $$PWD/../MyGLWindow \
+    $$PWD/../glm \
+    $$PWD/../assimp-v.5.0.0.rc1/include
+
+LIBS += \
+    -L$$PWD/../assimp-v.5.0.0.rc1/lib/ -lassimp
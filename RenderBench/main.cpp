@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QSurfaceFormat>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFramebufferObject>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "meshload.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(const Clock::time_point& start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//! What to render and how
+struct BenchOptions {
+    int width = 1280;
+    int height = 720;
+    int samples = 0;
+    int warmup = 30;
+    int frames = 300;
+    //! Seconds to wait for the model and its textures
+    double loadTimeout = 300.0;
+    QString model;
+    QString output;
+    QString image;
+    bool compact = false;
+    bool atlas = true;
+    bool indirect = true;
+};
+
+//! The times of the measured frames, in milliseconds
+struct FrameTimes {
+    std::vector<double> cpu;
+    std::vector<double> gpu;
+    double seconds = 0.0;
+};
+
+//! A \class MeshLoad that is never shown: it renders in the current context, frame by frame
+/*!
+  The camera follows a scripted path instead of the mouse, so every run
+  draws the same frames: the eye goes in and out twice while the trackball
+  is dragged a little every frame, sideways and up and down, so the model
+  spins and tilts.
+*/
+class OffscreenMeshLoad : public MeshLoad {
+public:
+    //! With the context current and the framebuffer bound
+    void initialize(int width, int height) {
+        initializeGL();
+        //Only for its size, that the projection and the levels of detail use
+        resize(width, height);
+        resizeGL(width, height);
+        mTimestamps.clear();
+    }
+    //! Render until the model and all its textures are on the GPU. False if it failed or timed out
+    bool waitLoaded(double timeout) {
+        Clock::time_point start = Clock::now();
+        while (!(mGeometryReady && mPendingImages == 0)) {
+            if (mLoadFailed || secondsSince(start) > timeout) {
+                return false;
+            }
+            QCoreApplication::processEvents();
+            paintGL();
+            glFinish();
+        }
+        return true;
+    }
+    //! Move the camera to a frame of a path of frames (the first one starts it again)
+    void setCamera(int frame, int frames) {
+        if (frame == 0) {
+            mBall.resetRotation();
+        }
+        const float angle = glm::radians(360.0f) * float(frame) / float(frames);
+        //Always between the near and far planes
+        const float distance = 3.5f + 0.5f * std::cos(2.0f * angle);
+        mV = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        //As the mouse would do it, the trackball adds up the drags
+        const glm::vec2 size = glm::vec2(float(width()), float(height()));
+        const glm::vec2 center = 0.5f * size;
+        mBall.startDrag(center);
+        mBall.drag(center + size * glm::vec2(0.005f, 0.003f * std::sin(angle)));
+        mBall.endDrag();
+    }
+    //! Render frames along the camera path, warmup of them are not measured
+    FrameTimes run(int warmup, int frames) {
+        FrameTimes times;
+        for (int frame = 0; frame < warmup; ++frame) {
+            setCamera(frame, warmup);
+            paintGL();
+        }
+        glFinish();
+        //A timestamp before and after each frame, only read at the end so they never stall
+        mTimestamps.assign(size_t(2 * frames), 0);
+        glGenQueries(GLsizei(mTimestamps.size()), mTimestamps.data());
+        Clock::time_point start = Clock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            setCamera(frame, frames);
+            Clock::time_point frameStart = Clock::now();
+            glQueryCounter(mTimestamps[size_t(2 * frame)], GL_TIMESTAMP);
+            paintGL();
+            glQueryCounter(mTimestamps[size_t(2 * frame + 1)], GL_TIMESTAMP);
+            times.cpu.push_back(secondsSince(frameStart) * 1000.0);
+        }
+        glFinish();
+        times.seconds = secondsSince(start);
+        for (int frame = 0; frame < frames; ++frame) {
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(mTimestamps[size_t(2 * frame)], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(mTimestamps[size_t(2 * frame + 1)], GL_QUERY_RESULT, &end);
+            times.gpu.push_back(double(end - begin) * 1.0e-6);
+        }
+        glDeleteQueries(GLsizei(mTimestamps.size()), mTimestamps.data());
+        mTimestamps.clear();
+        return times;
+    }
+    QString renderer() {
+        return QString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    }
+    QString version() {
+        return QString(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    }
+    //! What is left after the fallbacks of initializeGL
+    bool indirect() const {
+        return mIndirect;
+    }
+
+private:
+    std::vector<GLuint> mTimestamps;
+};
+
+//! Nearest rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = size_t(std::ceil(p / 100.0 * double(sorted.size())));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+std::string jsonString(const QString& text) {
+    std::string json = "\"";
+    for (char c : text.toStdString()) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            continue;
+        }
+        json += c;
+    }
+    return json + "\"";
+}
+
+std::string jsonNumber(double value) {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.4f", value);
+    return number;
+}
+
+//! Mean and percentiles of the frame times
+std::string jsonStats(const std::vector<double>& values) {
+    std::vector<double> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double value : sorted) {
+        sum += value;
+    }
+    const double mean = sorted.empty() ? 0.0 : sum / double(sorted.size());
+    return "{\"mean\": " + jsonNumber(mean) +
+           ", \"min\": " + jsonNumber(sorted.empty() ? 0.0 : sorted.front()) +
+           ", \"p50\": " + jsonNumber(percentile(sorted, 50.0)) +
+           ", \"p90\": " + jsonNumber(percentile(sorted, 90.0)) +
+           ", \"p95\": " + jsonNumber(percentile(sorted, 95.0)) +
+           ", \"p99\": " + jsonNumber(percentile(sorted, 99.0)) +
+           ", \"max\": " + jsonNumber(sorted.empty() ? 0.0 : sorted.back()) + "}";
+}
+
+void usage(const char* program) {
+    std::printf("Usage: %s [--size WxH] [--samples N] [--warmup N] [--frames N] [--model file]\n"
+                "          [--compact] [--no-atlas] [--no-indirect] [--output file.json] [--image file.png]\n"
+                "  Renders MeshLoad offscreen along a scripted camera path and prints the CPU and GPU\n"
+                "  frame times (in milliseconds) as JSON\n", program);
+}
+
+bool parseOptions(const QStringList& arguments, BenchOptions& options) {
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString& argument = arguments.at(i);
+        const bool hasValue = i + 1 < arguments.size();
+        if (argument == "--compact") {
+            options.compact = true;
+        } else if (argument == "--no-atlas") {
+            options.atlas = false;
+        } else if (argument == "--no-indirect") {
+            options.indirect = false;
+        } else if (argument == "--size" && hasValue) {
+            const QStringList size = arguments.at(++i).split('x');
+            if (size.size() != 2) {
+                return false;
+            }
+            options.width = size.at(0).toInt();
+            options.height = size.at(1).toInt();
+        } else if (argument == "--samples" && hasValue) {
+            options.samples = arguments.at(++i).toInt();
+        } else if (argument == "--warmup" && hasValue) {
+            options.warmup = arguments.at(++i).toInt();
+        } else if (argument == "--frames" && hasValue) {
+            options.frames = arguments.at(++i).toInt();
+        } else if (argument == "--model" && hasValue) {
+            options.model = arguments.at(++i);
+        } else if (argument == "--output" && hasValue) {
+            options.output = arguments.at(++i);
+        } else if (argument == "--image" && hasValue) {
+            options.image = arguments.at(++i);
+        } else {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.frames > 0 && options.warmup >= 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    //Without a display, Qt's offscreen platform is enough for a QOffscreenSurface
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    BenchOptions options;
+    if (!parseOptions(app.arguments(), options)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //The same context that MyGLWindow asks for, but the samples are in the framebuffer
+    QSurfaceFormat format;
+    format.setDepthBufferSize(24);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setVersion(4, 5);
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create()) {
+        std::fprintf(stderr, "Unable to create an OpenGL 4.5 core context\n");
+        return EXIT_FAILURE;
+    }
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!surface.isValid() || !context.makeCurrent(&surface)) {
+        std::fprintf(stderr, "Unable to make the offscreen surface current\n");
+        return EXIT_FAILURE;
+    }
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+    fboFormat.setSamples(options.samples);
+    QOpenGLFramebufferObject fbo(options.width, options.height, fboFormat);
+    if (!fbo.isValid() || !fbo.bind()) {
+        std::fprintf(stderr, "Unable to create a %dx%d framebuffer\n", options.width, options.height);
+        return EXIT_FAILURE;
+    }
+
+    //Destroyed before the framebuffer and the context, while the context is current
+    OffscreenMeshLoad window;
+    window.setCompactVertices(options.compact);
+    window.setPackTextures(options.atlas);
+    window.setMultiDrawIndirect(options.indirect);
+    if (!options.model.isEmpty()) {
+        window.setModelFile(options.model);
+    }
+    Clock::time_point start = Clock::now();
+    window.initialize(options.width, options.height);
+    if (!window.waitLoaded(options.loadTimeout)) {
+        std::fprintf(stderr, "The model did not load (or not in %.0f seconds)\n", options.loadTimeout);
+        return EXIT_FAILURE;
+    }
+    const double loadSeconds = secondsSince(start);
+    FrameTimes times = window.run(options.warmup, options.frames);
+    if (!options.image.isEmpty()) {
+        fbo.toImage().save(options.image);
+    }
+
+    std::string json = "{\n";
+    json += "  \"renderer\": " + jsonString(window.renderer()) + ",\n";
+    json += "  \"version\": " + jsonString(window.version()) + ",\n";
+    json += "  \"width\": " + std::to_string(options.width) + ",\n";
+    json += "  \"height\": " + std::to_string(options.height) + ",\n";
+    json += "  \"samples\": " + std::to_string(options.samples) + ",\n";
+    json += "  \"compact\": " + std::string(options.compact ? "true" : "false") + ",\n";
+    json += "  \"atlas\": " + std::string(options.atlas ? "true" : "false") + ",\n";
+    json += "  \"indirect\": " + std::string(window.indirect() ? "true" : "false") + ",\n";
+    json += "  \"warmup\": " + std::to_string(options.warmup) + ",\n";
+    json += "  \"frames\": " + std::to_string(options.frames) + ",\n";
+    json += "  \"load_seconds\": " + jsonNumber(loadSeconds) + ",\n";
+    json += "  \"fps\": " + jsonNumber(double(options.frames) / times.seconds) + ",\n";
+    json += "  \"cpu_ms\": " + jsonStats(times.cpu) + ",\n";
+    json += "  \"gpu_ms\": " + jsonStats(times.gpu) + "\n";
+    json += "}\n";
+    std::fputs(json.c_str(), stdout);
+    if (!options.output.isEmpty()) {
+        QSaveFile file(options.output);
+        if (!file.open(QIODevice::WriteOnly) || file.write(json.data(), qint64(json.size())) != qint64(json.size()) ||
+            !file.commit()) {
+            std::fprintf(stderr, "Unable to write %s\n", options.output.toStdString().c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}